@@ -0,0 +1,85 @@
+#include "BaseLib.h"
+#include "Container.h"
+
+//////////////////////////////////////////////////////////////////////////
+#ifdef CONTAINER_BENCHMARK
+/* the hot paths these types sit on: io threads handing commands to one
+** logic thread, and worker threads looking up and updating shared objects
+** by id. every thread runs the same number of ops. */
+#define BENCH_THREADS	(8)
+#define BENCH_OPS		(200000)
+#define BENCH_KEYS		(10000)
+
+template<class Queue>
+static void BenchProducer(Queue* pQueue)
+{
+	for (int32_t i = 0; i < BENCH_OPS; i++)
+	{
+		int64_t val = i;
+		pQueue->PushBack(val);
+	}
+}
+
+template<class Queue>
+static void BenchConsumer(Queue* pQueue, int64_t total)
+{
+	int64_t val = 0;
+	for (int64_t n = 0; n < total; )
+	{
+		if (pQueue->PopFront(val)) n++;
+	}
+}
+
+template<class Queue>
+static void BenchQueue(const CHAR* szName)
+{
+	Queue queue;
+	int64_t start = TimeUtil::TickMicroseconds();
+	boost::thread_group threads;
+	threads.create_thread(boost::bind(&BenchConsumer<Queue>, &queue, (int64_t)BENCH_THREADS * BENCH_OPS));
+	for (int32_t i = 0; i < BENCH_THREADS; i++)
+		threads.create_thread(boost::bind(&BenchProducer<Queue>, &queue));
+	threads.join_all();
+	double seconds = (TimeUtil::TickMicroseconds() - start) / 1000000.0;
+	printf("queue,%s,%d,%0.3f,%0.0f\n", szName, BENCH_THREADS, seconds, BENCH_THREADS * (double)BENCH_OPS / seconds);
+}
+
+// 90% Peek, 5% ChangeValue, 5% Erase + Add, on random keys
+template<class Map>
+static void BenchMapThread(Map* pMap, uint32_t seed)
+{
+	int64_t val = 0;
+	for (int32_t i = 0; i < BENCH_OPS; i++)
+	{
+		seed = seed * 1103515245 + 12345;
+		int32_t key = (int32_t)((seed >> 8) % BENCH_KEYS);
+		int32_t op = (int32_t)((seed >> 24) % 20);
+		if (op == 0) pMap->ChangeValue(key, (int64_t)i);
+		else if (op == 1) { pMap->Erase(key); pMap->Add(key, (int64_t)i); }
+		else pMap->Peek(key, val);
+	}
+}
+
+template<class Map>
+static void BenchMap(const CHAR* szName)
+{
+	Map map;
+	for (int32_t k = 0; k < BENCH_KEYS; k++) map.Add(k, (int64_t)k);
+	int64_t start = TimeUtil::TickMicroseconds();
+	boost::thread_group threads;
+	for (int32_t i = 0; i < BENCH_THREADS; i++)
+		threads.create_thread(boost::bind(&BenchMapThread<Map>, &map, (uint32_t)(i + 1)));
+	threads.join_all();
+	double seconds = (TimeUtil::TickMicroseconds() - start) / 1000000.0;
+	printf("map,%s,%d,%0.3f,%0.0f\n", szName, BENCH_THREADS, seconds, BENCH_THREADS * (double)BENCH_OPS / seconds);
+}
+
+void ContainerBenchmark()
+{
+	// csv: kind,impl,threads,seconds,ops/s
+	BenchQueue<TSList<int64_t> >("TSList");
+	BenchQueue<TSQueue<int64_t> >("TSQueue");
+	BenchMap<TSMap<int32_t, int64_t> >("TSMap");
+	BenchMap<TSHashMap<int32_t, int64_t> >("TSHashMap");
+}
+#endif
@@ -1,5 +1,10 @@
 #ifndef BASE_CONTAINER_H
 #define BASE_CONTAINER_H
+#include <boost/atomic.hpp>
+#include <boost/unordered_map.hpp>
+
+//#define CONTAINER_BENCHMARK
+
 //////////////////////////////////////////////////////////////////////////
 template<typename Type, int32_t SizeMax>
 class TArray
@@ -397,6 +402,7 @@ class TSMap
 {
 public:
 	typedef boost::container::map<KeyType, ValueType> _mapImpl;
+	typedef typename _mapImpl::iterator TMapIterator;
 public:
 	//! Ԫ
 	void Add(KeyType key, ValueType value)
@@ -691,4 +697,236 @@ private:
 	typename _mapImpl::iterator m_Iterator;
 };
 //////////////////////////////////////////////////////////////////////////
+// TSList for the cross-thread hand-offs, many producers and one consumer
+// (several consumers take turns on LockType). PushBack is one exchange and
+// never waits, not for other producers and not for the consumer. only the
+// consumer frees nodes, and only one whose successor is linked, so no
+// producer ever touches freed memory. a producer between its exchange and
+// its link hides its element and every one pushed after it until the link
+// is made. Size counts an element once it is linked, but those hidden behind
+// it are counted too: PopFront may fail while Size() > 0.
+template<typename Type, typename LockType = MyLock> 
+class TSQueue
+{
+	struct Node
+	{
+		Node() : pNext(NULL) {}
+		explicit Node(const Type& val) : Value(val), pNext(NULL) {}
+
+		Type					Value;
+		boost::atomic<Node*>	pNext;
+	};
+public:
+	// any thread
+	void PushBack(const Type& val)
+	{
+		Node* pNode = new Node(val);
+		Node* pPrev = m_pTail.exchange(pNode, boost::memory_order_acq_rel);
+		pPrev->pNext.store(pNode, boost::memory_order_release);
+		// after the link: the consumer may pop it first, Size reads one low meanwhile
+		m_Size.fetch_add(1, boost::memory_order_release);
+	}
+
+	// consumer: gives back what PopFront returned, it comes out first again
+	void PushFront(const Type& val)
+	{
+		AutoLock_T lock(m_Lock);
+		m_Front.push_back(val);
+		m_Size.fetch_add(1, boost::memory_order_relaxed);
+	}
+
+	bool PopFront(Type& val)
+	{
+		AutoLock_T lock(m_Lock);
+		return PopFrontLocked(val);
+	}
+
+	void Clear()
+	{
+		AutoLock_T lock(m_Lock);
+		Type val;
+		while( PopFrontLocked(val) );
+	}
+
+	int32_t	SizeUnSafe() { return m_Size.load(boost::memory_order_relaxed); }
+	int32_t	Size() { return m_Size.load(boost::memory_order_acquire); }
+
+	explicit TSQueue() : m_Size(0)
+	{
+		m_pHead = new Node();
+		m_pTail.store(m_pHead);
+	}
+	~TSQueue()
+	{
+		Clear();
+		delete m_pHead;
+	}
+private:
+	bool PopFrontLocked(Type& val)
+	{
+		if( !m_Front.empty() )
+		{
+			val = m_Front.back();
+			m_Front.pop_back();
+			m_Size.fetch_sub(1, boost::memory_order_relaxed);
+			return true;
+		}
+
+		// m_pHead is a consumed node (or the first stub), its successor is the front
+		Node* pNext = m_pHead->pNext.load(boost::memory_order_acquire);
+		if( pNext == NULL )
+			return false;
+		val = pNext->Value;
+		pNext->Value = Type();
+		delete m_pHead;
+		m_pHead = pNext;
+		m_Size.fetch_sub(1, boost::memory_order_relaxed);
+		return true;
+	}
+private:
+	TSQueue(const TSQueue&);
+	TSQueue& operator=(const TSQueue&);
+private:
+	boost::atomic<Node*>	m_pTail;
+	char					m_Pad[64];		// producers' line apart from the consumer's
+	Node*					m_pHead;
+	bstd::vector<Type>		m_Front;
+	boost::atomic<int32_t>	m_Size;
+	LockType				m_Lock;
+};
+//////////////////////////////////////////////////////////////////////////
+// TSMap split into _Stripes hash maps with a lock each: threads working on
+// different keys rarely meet on a lock, and the exports copy one stripe at
+// a time instead of holding the whole map. the order is not a key order.
+template<typename KeyType, typename ValueType, int32_t _Stripes = 16, typename LockType = MyLock> 
+class TSHashMap
+{
+public:
+	typedef boost::unordered_map<KeyType, ValueType> _mapImpl;
+	typedef typename _mapImpl::iterator TMapIterator;
+private:
+	BOOST_STATIC_ASSERT((_Stripes & (_Stripes - 1)) == 0);
+
+	struct Stripe
+	{
+		LockType	Lock;
+		_mapImpl	Map;
+		char		Pad[64];		// the next stripe's lock on another cache line
+	};
+public:
+	void Add(KeyType key, ValueType value)
+	{
+		Stripe& s = GetStripe(key);
+		AutoLock_T lock(s.Lock);
+		if( s.Map.insert(std::pair<KeyType, ValueType>(key, value)).second )
+			m_Size.fetch_add(1, boost::memory_order_relaxed);
+	}
+
+	bool Peek(KeyType key, ValueType& rVal)
+	{
+		Stripe& s = GetStripe(key);
+		AutoLock_T lock(s.Lock);
+		TMapIterator it = s.Map.find(key);
+		if( it != s.Map.end() )
+		{
+			rVal = it->second;
+			return true;
+		}
+		return false;
+	}
+
+	bool ChangeValue(KeyType key, ValueType new_value)
+	{
+		Stripe& s = GetStripe(key);
+		AutoLock_T lock(s.Lock);
+		TMapIterator it = s.Map.find(key);
+		if( it != s.Map.end() )
+		{
+			it->second = new_value;
+			return true;
+		}
+		return false;
+	}
+
+	bool IsExist(KeyType key)
+	{
+		Stripe& s = GetStripe(key);
+		AutoLock_T lock(s.Lock);
+		return s.Map.find(key) != s.Map.end();
+	}
+
+	bool Erase(KeyType key)
+	{
+		Stripe& s = GetStripe(key);
+		AutoLock_T lock(s.Lock);
+		if( s.Map.erase(key) > 0 )
+		{
+			m_Size.fetch_sub(1, boost::memory_order_relaxed);
+			return true;
+		}
+		return false;
+	}
+
+	void Clear()
+	{
+		for( int32_t i = 0; i < _Stripes; i++ )
+		{
+			AutoLock_T lock(m_Stripes[i].Lock);
+			m_Size.fetch_sub((int32_t)m_Stripes[i].Map.size(), boost::memory_order_relaxed);
+			m_Stripes[i].Map.clear();
+		}
+	}
+
+	int32_t	SizeUnSafe() { return m_Size.load(boost::memory_order_relaxed); }
+	int32_t	Size() { return m_Size.load(boost::memory_order_acquire); }
+
+	template<class OutList>
+	int32_t ExportAllKey(OutList& listDest)
+	{
+		int32_t n = 0;
+		for( int32_t i = 0; i < _Stripes; i++ )
+		{
+			AutoLock_T lock(m_Stripes[i].Lock);
+			for( TMapIterator it = m_Stripes[i].Map.begin(); it != m_Stripes[i].Map.end(); ++it, ++n )
+				listDest.push_back(it->first);
+		}
+		return n;
+	}
+
+	template<class OutList>
+	int32_t ExportAllValue(OutList& listDest)
+	{
+		int32_t n = 0;
+		for( int32_t i = 0; i < _Stripes; i++ )
+		{
+			AutoLock_T lock(m_Stripes[i].Lock);
+			for( TMapIterator it = m_Stripes[i].Map.begin(); it != m_Stripes[i].Map.end(); ++it, ++n )
+				listDest.push_back(it->second);
+		}
+		return n;
+	}
+
+	explicit TSHashMap() : m_Size(0) {  }
+	~TSHashMap()	{ }
+private:
+	Stripe& GetStripe(const KeyType& key)
+	{
+		size_t h = boost::hash<KeyType>()(key);
+		// the maps inside use the low bits, the stripe takes mixed ones
+		return m_Stripes[(h ^ (h >> 8) ^ (h >> 16)) & (_Stripes - 1)];
+	}
+private:
+	TSHashMap(const TSHashMap&);
+	TSHashMap& operator=(const TSHashMap&);
+private:
+	Stripe					m_Stripes[_Stripes];
+	boost::atomic<int32_t>	m_Size;
+};
+
+#ifdef CONTAINER_BENCHMARK
+// producers against one consumer on TSList and TSQueue, mixed lookups and
+// updates from all threads on TSMap and TSHashMap.
+void ContainerBenchmark();
+#endif
+//////////////////////////////////////////////////////////////////////////
 #endif
\ No newline at end of file
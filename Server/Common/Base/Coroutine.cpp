@@ -0,0 +1,198 @@
+#include "Coroutine.h"
+#include "Assertx.h"
+#include "FrameArena.h"
+#include "Timer.h"
+#include "GameUtil.h"
+
+//////////////////////////////////////////////////////////////////////////
+static void NoCleanup(void*) {}
+static boost::thread_specific_ptr<Coroutine> s_CurrentCoroutine((void (*)(Coroutine*))&NoCleanup);
+static boost::thread_specific_ptr<CoScheduler> s_CurrentScheduler((void (*)(CoScheduler*))&NoCleanup);
+
+Coroutine::Coroutine(CoScheduler* pOwner, const Body& body)
+: m_pOwner(pOwner), m_pAnchor(pOwner->GetAnchor()), m_Body(body), m_pYield(NULL)
+{
+}
+
+Coroutine::~Coroutine()
+{
+}
+
+// a coroutine outlives the FrameScope of the run that starts or resumes it,
+// so inside it FrameAllocator falls back to the heap.
+bool Coroutine::Start()
+{
+	Coroutine* pPrev = s_CurrentCoroutine.get();
+	s_CurrentCoroutine.reset(this);
+	FrameArena* pArena = FrameArena::Current();
+	FrameArena::SetCurrent(NULL);
+	// no forced unwind: the catch(...) of __ENTER_FUNCTION in service code
+	// would swallow it. a coroutine dropped while suspended just loses its stack
+	m_pCoro.reset(new PullType(boost::bind(&Coroutine::Entry, this, _1),
+		boost::coroutines::attributes(STACK_SIZE, boost::coroutines::no_stack_unwind)));
+	FrameArena::SetCurrent(pArena);
+	s_CurrentCoroutine.reset(pPrev);
+	return (bool)*m_pCoro;
+}
+
+bool Coroutine::Resume()
+{
+	Assert(m_pCoro && *m_pCoro);
+	Coroutine* pPrev = s_CurrentCoroutine.get();
+	s_CurrentCoroutine.reset(this);
+	FrameArena* pArena = FrameArena::Current();
+	FrameArena::SetCurrent(NULL);
+	(*m_pCoro)();
+	FrameArena::SetCurrent(pArena);
+	s_CurrentCoroutine.reset(pPrev);
+	return (bool)*m_pCoro;
+}
+
+void Coroutine::Yield()
+{
+	Assert(m_pYield);
+	// a FrameScope of the coroutine would be rewound by someone else meanwhile
+	AssertEx(FrameArena::Current() == NULL, "FrameScope held across a coroutine wait");
+	(*m_pYield)();
+}
+
+void Coroutine::Wake()
+{
+	AutoLock_T lock(m_pAnchor->m_Lock);
+	if (m_pAnchor->m_pScheduler != NULL)
+	{
+		m_pAnchor->m_pScheduler->Ready(shared_from_this());
+	}
+}
+
+Coroutine* Coroutine::Current()
+{
+	return s_CurrentCoroutine.get();
+}
+
+void Coroutine::Entry(PushType& yield)
+{
+	m_pYield = &yield;
+	_MY_TRY
+	{
+		m_Body();
+	}
+	_MY_CATCH
+	{
+		AssertSpecialEx(false, "coroutine body threw, the coroutine ends here.");
+	}
+	m_pYield = NULL;
+	m_pOwner->OnFinish();
+}
+
+//////////////////////////////////////////////////////////////////////////
+CoScheduler::CoScheduler() : m_pAnchor(new CoAnchor(this)), m_Live(0)
+{
+}
+
+CoScheduler::~CoScheduler()
+{
+	{
+		AutoLock_T lock(m_pAnchor->m_Lock);
+		m_pAnchor->m_pScheduler = NULL;
+	}
+	// without a forced unwind what their stacks own is lost
+	AssertSpecialEx(m_Live.load() == 0, "CoScheduler destroyed with suspended coroutines.");
+}
+
+void CoScheduler::Spawn(const Coroutine::Body& body)
+{
+	__ENTER_FUNCTION
+		m_Live.fetch_add(1);
+	// whoever it waits on holds the pointer while it is suspended
+	CoroutinePtr co(new Coroutine(this, body));
+	co->Start();
+	__LEAVE_FUNCTION
+}
+
+void CoScheduler::Ready(const CoroutinePtr& co)
+{
+	AutoLock_T lock(m_Lock);
+	m_Ready.push_back(co);
+}
+
+int32_t CoScheduler::Poll()
+{
+	__ENTER_FUNCTION
+	{
+		AutoLock_T lock(m_Lock);
+		m_Resume.swap(m_Ready);
+	}
+	int32_t n = (int32_t)m_Resume.size();
+	for (int32_t i = 0; i < n; i++)
+	{
+		m_Resume[i]->Resume();
+	}
+	m_Resume.clear();
+	return n;
+	__LEAVE_FUNCTION
+		return 0;
+}
+
+int32_t CoScheduler::Drain(int32_t timeoutMs)
+{
+	__ENTER_FUNCTION
+		int64_t endUs = TimeUtil::TickMicroseconds() + (int64_t)timeoutMs * 1000;
+	CoScheduler* pPrev = Current();
+	SetCurrent(this);
+	while (true)
+	{
+		Poll();
+		if (Size() == 0 || TimeUtil::TickMicroseconds() >= endUs) break;
+		MySleep(1);
+	}
+	SetCurrent(pPrev);
+	return Size();
+	__LEAVE_FUNCTION
+		return Size();
+}
+
+CoScheduler* CoScheduler::Current()
+{
+	return s_CurrentScheduler.get();
+}
+
+void CoScheduler::SetCurrent(CoScheduler* pScheduler)
+{
+	s_CurrentScheduler.reset(pScheduler);
+}
+
+void CoSpawn(const Coroutine::Body& body)
+{
+	__ENTER_FUNCTION
+		CoScheduler* pScheduler = CoScheduler::Current();
+	AssertEx(pScheduler, "CoSpawn outside of an invoker");
+	pScheduler->Spawn(body);
+	__LEAVE_FUNCTION
+}
+
+//////////////////////////////////////////////////////////////////////////
+void CoEvent::Wait()
+{
+	Coroutine* co = Coroutine::Current();
+	AssertEx(co, "CoEvent::Wait outside of a coroutine");
+	{
+		AutoLock_T lock(m_Lock);
+		if (m_bSignalled) return;
+		m_Waiter = co->shared_from_this();
+	}
+	// a Signal from now on only queues us on the owner, which cannot poll
+	// before this invoker run returns
+	co->Yield();
+}
+
+void CoEvent::Signal()
+{
+	CoroutinePtr waiter;
+	{
+		AutoLock_T lock(m_Lock);
+		m_bSignalled = true;
+		waiter.swap(m_Waiter);
+	}
+	if (waiter) waiter->Wake();
+}
@@ -0,0 +1,142 @@
+#ifndef __COROUTINE_H__
+#define __COROUTINE_H__
+
+#include "Base.h"
+#include "Executor.h"
+#include <boost/atomic.hpp>
+#include <boost/coroutine/all.hpp>
+
+//////////////////////////////////////////////////////////////////////////
+// stackful coroutines owned by an invoker. a coroutine runs on whatever pool
+// thread runs its invoker, suspends in CoEvent::Wait / CoAwait while the io
+// finishes elsewhere, and is resumed by the same invoker's next Invoke, so
+// its code never races with the invoker's Tick. thread locals are not safe
+// across a suspension, the next resume may be on another worker.
+class CoScheduler;
+
+// how a completion reaches a coroutine's scheduler: the scheduler clears it
+// when it goes, a late Signal then drops the coroutine instead of queueing it.
+struct CoAnchor
+{
+	explicit CoAnchor(CoScheduler* pScheduler) : m_pScheduler(pScheduler) {}
+
+	MyLock			m_Lock;
+	CoScheduler*	m_pScheduler;
+};
+typedef boost::shared_ptr<CoAnchor> CoAnchorPtr;
+
+class Coroutine : public boost::noncopyable, public boost::enable_shared_from_this<Coroutine>
+{
+public:
+	typedef boost::function<void ()> Body;
+	typedef boost::coroutines::coroutine<void>::pull_type PullType;
+	typedef boost::coroutines::coroutine<void>::push_type PushType;
+	enum { STACK_SIZE = 64 * 1024 };
+public:
+	Coroutine(CoScheduler* pOwner, const Body& body);
+	~Coroutine();
+public:
+	// owner thread; false once the body has returned.
+	bool				Start();
+	bool				Resume();
+	// inside the coroutine: back to whoever started or resumed it.
+	void				Yield();
+	// any thread: resume at the owner's next Poll, if the owner is still there.
+	void				Wake();
+	CoScheduler*		GetOwner() const	{ return m_pOwner; }
+	// the coroutine running on this thread, NULL outside of one.
+	static Coroutine*	Current();
+private:
+	void				Entry(PushType& yield);
+private:
+	CoScheduler*				m_pOwner;
+	CoAnchorPtr					m_pAnchor;
+	Body						m_Body;
+	PushType*					m_pYield;
+	boost::scoped_ptr<PullType>	m_pCoro;
+};
+typedef boost::shared_ptr<Coroutine> CoroutinePtr;
+
+//////////////////////////////////////////////////////////////////////////
+// the coroutines of one invoker. Invoker::Invoke polls it before Do, so a
+// coroutine woken during the last interval continues at the next run.
+// a suspended coroutine's stack holds what its io writes to, so the
+// scheduler must not go before Size() is 0: see Drain.
+class CoScheduler : public boost::noncopyable
+{
+public:
+	CoScheduler();
+	~CoScheduler();
+public:
+	// owner thread: runs @body until its first suspension.
+	void				Spawn(const Coroutine::Body& body);
+	// any thread: resume @co at the owner's next Poll.
+	void				Ready(const CoroutinePtr& co);
+	// owner thread: resumes everything made ready so far.
+	int32_t				Poll();
+	// the owner has stopped: polls from the calling thread until every
+	// coroutine returned or @timeoutMs passed, at least once; the ones left.
+	int32_t				Drain(int32_t timeoutMs);
+	const CoAnchorPtr&	GetAnchor() const	{ return m_pAnchor; }
+	// spawned and not yet returned.
+	int32_t				Size() const		{ return m_Live.load(); }
+	void				OnFinish()			{ m_Live.fetch_sub(1); }
+public:
+	// set by Invoker::Invoke around Poll and Do.
+	static CoScheduler*	Current();
+	static void			SetCurrent(CoScheduler* pScheduler);
+private:
+	CoAnchorPtr					m_pAnchor;
+	MyLock						m_Lock;
+	bstd::vector<CoroutinePtr>	m_Ready;
+	bstd::vector<CoroutinePtr>	m_Resume;
+	boost::atomic<int32_t>		m_Live;
+};
+
+// spawn on the invoker currently running on this thread.
+void CoSpawn(const Coroutine::Body& body);
+
+//////////////////////////////////////////////////////////////////////////
+// one-shot completion: the coroutine Waits, a callback on any thread Signals.
+// this is how callback-style apis (RpcChannel, asio) are awaited. the waiter
+// is held until the Signal, its stack is where the callback writes.
+class CoEvent : public boost::noncopyable
+{
+public:
+	CoEvent() : m_bSignalled(false) {}
+public:
+	void				Wait();
+	void				Signal();
+private:
+	MyLock				m_Lock;
+	bool				m_bSignalled;
+	CoroutinePtr		m_Waiter;
+};
+
+template<class R>
+void CoRunIo(const boost::function<R ()>& fn, R* pResult, CoEvent* pEvent)
+{
+	_MY_TRY
+	{
+		*pResult = fn();
+	}
+	_MY_CATCH
+	{
+		AssertSpecialEx(false, "CoAwait io threw, the coroutine gets R().");
+	}
+	pEvent->Signal();
+}
+
+// runs the blocking @fn on an io executor and suspends the calling coroutine
+// until it returns; R() if fn throws.
+template<class R>
+R CoAwait(Executor& io, const boost::function<R ()>& fn)
+{
+	R result = R();
+	CoEvent ev;
+	io.Schedule(boost::bind(&CoRunIo<R>, boost::cref(fn), &result, &ev));
+	ev.Wait();
+	return result;
+}
+
+#endif
@@ -0,0 +1,282 @@
+#include "Executor.h"
+#include "Assertx.h"
+#include "Timer.h"
+#include "ThreadRegistry.h"
+
+//////////////////////////////////////////////////////////////////////////
+struct ExecutorSlot
+{
+	const Executor*	Owner;
+	int32_t			Index;
+};
+static boost::thread_specific_ptr<ExecutorSlot> s_ExecutorSlot;
+
+Executor::Executor(int32_t threads, const CHAR* szName, const bstd::vector<int32_t>& cores)
+: m_Cores(cores), m_Next(0), m_Pending(0), m_Active(0), m_Sleepers(0), m_Waiters(0), m_Stop(0)
+{
+	__ENTER_FUNCTION
+		Assert(threads > 0);
+	strncpy(m_szName, szName, sizeof(m_szName) - 1);
+	m_szName[sizeof(m_szName) - 1] = 0;
+	for (int32_t i = 0; i < threads; i++)
+	{
+		m_Workers.push_back(WorkerPtr(new Worker));
+	}
+	for (int32_t i = 0; i < threads; i++)
+	{
+		m_Workers[i]->Thread = boost::thread(boost::bind(&Executor::Run, this, i));
+	}
+	__LEAVE_FUNCTION
+}
+
+Executor::~Executor()
+{
+	{
+		AutoLock_T lock(m_IdleLock);
+		m_Stop.store(1);
+		m_IdleCond.notify_all();
+	}
+	for (int32_t i = 0; i < Size(); i++)
+	{
+		if (m_Workers[i]->Thread.joinable()) m_Workers[i]->Thread.join();
+	}
+}
+
+void Executor::Schedule(const Task& task, int32_t worker, const CHAR* szTask)
+{
+	__ENTER_FUNCTION
+		Item item;
+	item.task = task;
+	item.name = szTask;
+	item.queuedUs = TimeUtil::TickMicroseconds();
+	item.preferred = -1;
+	if (worker >= 0 && worker < Size()) {
+		item.preferred = worker;
+	} else {
+		worker = (int32_t)((uint32_t)m_Next.fetch_add(1, boost::memory_order_relaxed) % (uint32_t)Size());
+	}
+
+	// counted first: a worker that sees m_Pending > 0 does not go to sleep
+	m_Pending.fetch_add(1);
+	{
+		Worker& w = *m_Workers[worker];
+		AutoLock_T lock(w.Lock);
+		w.Queue.push_back(item);
+	}
+	if (m_Sleepers.load() > 0)
+	{
+		AutoLock_T lock(m_IdleLock);
+		m_IdleCond.notify_one();
+	}
+	__LEAVE_FUNCTION
+}
+
+bool Executor::Wait(int32_t milliseconds)
+{
+	__ENTER_FUNCTION
+		boost::system_time deadline = boost::get_system_time() + boost::posix_time::milliseconds(milliseconds);
+	AutoLock_T lock(m_IdleLock);
+	m_Waiters.fetch_add(1);
+	bool done = true;
+	while (m_Pending.load() > 0 || m_Active.load() > 0)
+	{
+		if (!m_DoneCond.timed_wait(lock, deadline))
+		{
+			done = (m_Pending.load() == 0 && m_Active.load() == 0);
+			break;
+		}
+	}
+	m_Waiters.fetch_sub(1);
+	return done;
+	__LEAVE_FUNCTION
+		return false;
+}
+
+int32_t Executor::CurrentWorker() const
+{
+	ExecutorSlot* slot = s_ExecutorSlot.get();
+	return (slot != NULL && slot->Owner == this) ? slot->Index : -1;
+}
+
+void Executor::GetStats(ExecutorStats& out) const
+{
+	for (int32_t i = 0; i < Size(); i++)
+	{
+		const Worker& w = *m_Workers[i];
+		out.Tasks += w.Tasks.load(boost::memory_order_relaxed);
+		out.Steals += w.Steals.load(boost::memory_order_relaxed);
+		out.AffinityHits += w.AffinityHits.load(boost::memory_order_relaxed);
+		out.AffinityTasks += w.AffinityTasks.load(boost::memory_order_relaxed);
+		out.QueueWaitUs += w.QueueWaitUs.load(boost::memory_order_relaxed);
+		out.QueueWaitMaxUs = _MAX(out.QueueWaitMaxUs, w.QueueWaitMaxUs.load(boost::memory_order_relaxed));
+	}
+}
+
+void Executor::Run(int32_t index)
+{
+	ExecutorSlot* slot = new ExecutorSlot;
+	slot->Owner = this;
+	slot->Index = index;
+	s_ExecutorSlot.reset(slot);
+
+	CHAR szThreadName[32];
+	tsnprintf(szThreadName, sizeof(szThreadName), "%s-%d", m_szName, index);
+	g_ThreadRegistry.Add(szThreadName, m_Cores.empty() ? -1 : m_Cores[index % m_Cores.size()]);
+
+	Item item;
+	while (true)
+	{
+		if (PopLocal(index, item)) {
+			Execute(index, item, false);
+			continue;
+		}
+		if (Steal(index, item)) {
+			Execute(index, item, true);
+			continue;
+		}
+
+		// queues are drained before m_Stop is honoured
+		AutoLock_T lock(m_IdleLock);
+		if (m_Stop.load()) break;
+		m_Sleepers.fetch_add(1);
+		if (m_Pending.load() == 0)
+		{
+			m_IdleCond.wait(lock);
+		}
+		m_Sleepers.fetch_sub(1);
+	}
+	g_ThreadRegistry.Remove();
+}
+
+bool Executor::PopLocal(int32_t index, Item& item)
+{
+	Worker& w = *m_Workers[index];
+	AutoLock_T lock(w.Lock);
+	if (w.Queue.empty()) return false;
+	item = w.Queue.front();
+	w.Queue.pop_front();
+	return true;
+}
+
+// victims in order after @index, from the back of their deques; a busy
+// deque is skipped rather than waited on.
+bool Executor::Steal(int32_t index, Item& item)
+{
+	int32_t n = Size();
+	for (int32_t i = 1; i < n; i++)
+	{
+		Worker& victim = *m_Workers[(index + i) % n];
+		AutoLock_T lock(victim.Lock, boost::try_to_lock);
+		if (!lock.owns_lock() || victim.Queue.empty()) continue;
+		item = victim.Queue.back();
+		victim.Queue.pop_back();
+		return true;
+	}
+	return false;
+}
+
+void Executor::Execute(int32_t index, Item& item, bool stolen)
+{
+	m_Active.fetch_add(1);
+	m_Pending.fetch_sub(1);
+
+	Worker& w = *m_Workers[index];
+	int64_t waitUs = TimeUtil::TickMicroseconds() - item.queuedUs;
+	w.Tasks.fetch_add(1, boost::memory_order_relaxed);
+	w.QueueWaitUs.fetch_add(waitUs, boost::memory_order_relaxed);
+	if (waitUs > w.QueueWaitMaxUs.load(boost::memory_order_relaxed))
+		w.QueueWaitMaxUs.store(waitUs, boost::memory_order_relaxed);
+	if (stolen)
+		w.Steals.fetch_add(1, boost::memory_order_relaxed);
+	if (item.preferred >= 0)
+	{
+		w.AffinityTasks.fetch_add(1, boost::memory_order_relaxed);
+		if (item.preferred == index)
+			w.AffinityHits.fetch_add(1, boost::memory_order_relaxed);
+	}
+
+	_MY_TRY
+	{
+		item.task();
+	}
+	_MY_CATCH
+	{
+		// the worker goes on, the assert log tells whose task it lost
+		CHAR szMsg[256];
+		tsnprintf(szMsg, sizeof(szMsg), "%s-%d task(%s) threw, dropped.", m_szName, index,
+			item.name != NULL ? item.name : "unnamed");
+		AssertSpecialEx(false, szMsg);
+	}
+	item.task.clear();
+
+	if (m_Active.fetch_sub(1) == 1 && m_Pending.load() == 0 && m_Waiters.load() > 0)
+	{
+		AutoLock_T lock(m_IdleLock);
+		m_DoneCond.notify_all();
+	}
+}
+
+//////////////////////////////////////////////////////////////////////////
+#ifdef EXECUTOR_BENCHMARK
+/* the ServiceMgr pattern: every round the main thread schedules all invokers,
+** each preferring the worker that ran it last, and waits for the round.
+** an invoker touches its own 1KB of state, which stays warm only if it comes
+** back to the same core. */
+#define BENCH_INVOKERS	(10000)
+#define BENCH_ROUNDS	(200)
+#define BENCH_THREADS	(8)
+
+struct BenchInvoker
+{
+	int32_t		State[256];
+	int32_t		LastWorker;
+};
+
+static void BenchWork(BenchInvoker* inv)
+{
+	for (int32_t i = 0; i < 256; i++) inv->State[i] += i;
+}
+
+static void BenchExecutorInvoke(Executor* exec, BenchInvoker* inv)
+{
+	inv->LastWorker = exec->CurrentWorker();
+	BenchWork(inv);
+}
+
+void ExecutorBenchmark()
+{
+	bstd::vector<BenchInvoker> invokers(BENCH_INVOKERS);
+	for (int32_t i = 0; i < BENCH_INVOKERS; i++) invokers[i].LastWorker = -1;
+
+	// csv: impl,threads,invokers,rounds,seconds,invokes/s,avg_wait_us,max_wait_us,steal%,affinity_hit%
+	{
+		boost::threadpool::fifo_pool pool(BENCH_THREADS);
+		int64_t start = TimeUtil::TickMicroseconds();
+		for (int32_t r = 0; r < BENCH_ROUNDS; r++)
+		{
+			for (int32_t i = 0; i < BENCH_INVOKERS; i++)
+				pool.schedule(boost::bind(&BenchWork, &invokers[i]));
+			pool.wait();
+		}
+		double seconds = (TimeUtil::TickMicroseconds() - start) / 1000000.0;
+		printf("fifo_pool,%d,%d,%d,%0.3f,%0.0f,,,,\n", BENCH_THREADS, BENCH_INVOKERS, BENCH_ROUNDS,
+			seconds, BENCH_INVOKERS * (double)BENCH_ROUNDS / seconds);
+	}
+	{
+		Executor exec(BENCH_THREADS);
+		int64_t start = TimeUtil::TickMicroseconds();
+		for (int32_t r = 0; r < BENCH_ROUNDS; r++)
+		{
+			for (int32_t i = 0; i < BENCH_INVOKERS; i++)
+				exec.Schedule(boost::bind(&BenchExecutorInvoke, &exec, &invokers[i]), invokers[i].LastWorker);
+			exec.Wait(60 * 1000);
+		}
+		double seconds = (TimeUtil::TickMicroseconds() - start) / 1000000.0;
+		ExecutorStats stats;
+		exec.GetStats(stats);
+		printf("executor,%d,%d,%d,%0.3f,%0.0f,%lld,%lld,%0.2f,%0.2f\n", BENCH_THREADS, BENCH_INVOKERS, BENCH_ROUNDS,
+			seconds, stats.Tasks / seconds, stats.QueueWaitUs / _MAX(stats.Tasks, 1), stats.QueueWaitMaxUs,
+			stats.Steals * 100.0 / _MAX(stats.Tasks, 1), stats.AffinityHits * 100.0 / _MAX(stats.AffinityTasks, 1));
+	}
+}
+#endif
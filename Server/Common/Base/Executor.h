@@ -0,0 +1,98 @@
+#ifndef __EXECUTOR_H__
+#define __EXECUTOR_H__
+
+#include "Base.h"
+#include <boost/atomic.hpp>
+#include <boost/container/deque.hpp>
+
+//#define EXECUTOR_BENCHMARK
+
+//////////////////////////////////////////////////////////////////////////
+struct ExecutorStats
+{
+	ExecutorStats() { memset(this, 0, sizeof(*this)); }
+
+	int64_t		Tasks;
+	int64_t		Steals;			// tasks run by a worker other than the one queued to
+	int64_t		AffinityHits;	// tasks with a preferred worker that ran there
+	int64_t		AffinityTasks;	// tasks with a preferred worker
+	int64_t		QueueWaitUs;	// Schedule -> start, summed
+	int64_t		QueueWaitMaxUs;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// work-stealing executor: every worker owns a deque, Schedule pushes to the
+// preferred worker (round robin without one), the owner pops from the front
+// and an idle worker steals from the back of the others. each deque has its
+// own lock, so workers only meet on a lock while stealing.
+class Executor : public boost::noncopyable
+{
+public:
+	typedef boost::function<void ()> Task;
+public:
+	// worker i is named "<szName>-i" in g_ThreadRegistry and pinned to
+	// cores[i % cores.size()], no cores: not pinned.
+	explicit Executor(int32_t threads, const CHAR* szName = "Executor", const bstd::vector<int32_t>& cores = bstd::vector<int32_t>());
+	~Executor();
+public:
+	// worker outside [0, Size()) means no preference. szTask names the task
+	// in the assert log if it throws, it has to outlive the task.
+	void		Schedule(const Task& task, int32_t worker = -1, const CHAR* szTask = NULL);
+	// true once nothing is queued or running, false on timeout.
+	bool		Wait(int32_t milliseconds);
+	int32_t		Size() const { return (int32_t)m_Workers.size(); }
+	int32_t		Pending() const { return m_Pending.load(); }
+	// worker index of the calling thread, -1 if it is not one of ours.
+	int32_t		CurrentWorker() const;
+	void		GetStats(ExecutorStats& out) const;
+private:
+	struct Item
+	{
+		Task		task;
+		const CHAR*	name;
+		int64_t		queuedUs;
+		int32_t		preferred;
+	};
+
+	struct Worker
+	{
+		Worker() : Tasks(0), Steals(0), AffinityHits(0), AffinityTasks(0), QueueWaitUs(0), QueueWaitMaxUs(0) {}
+
+		MyLock					Lock;
+		bstd::deque<Item>		Queue;
+		boost::thread			Thread;
+		boost::atomic<int64_t>	Tasks;
+		boost::atomic<int64_t>	Steals;
+		boost::atomic<int64_t>	AffinityHits;
+		boost::atomic<int64_t>	AffinityTasks;
+		boost::atomic<int64_t>	QueueWaitUs;
+		boost::atomic<int64_t>	QueueWaitMaxUs;
+	};
+	typedef boost::shared_ptr<Worker> WorkerPtr;
+
+	void		Run(int32_t index);
+	bool		PopLocal(int32_t index, Item& item);
+	bool		Steal(int32_t index, Item& item);
+	void		Execute(int32_t index, Item& item, bool stolen);
+private:
+	bstd::vector<WorkerPtr>	m_Workers;
+	CHAR					m_szName[16];
+	bstd::vector<int32_t>	m_Cores;
+	boost::atomic<int32_t>	m_Next;
+	boost::atomic<int32_t>	m_Pending;		// queued, not started
+	boost::atomic<int32_t>	m_Active;		// running
+	boost::atomic<int32_t>	m_Sleepers;
+	boost::atomic<int32_t>	m_Waiters;
+	boost::atomic<int32_t>	m_Stop;
+	MyLock					m_IdleLock;
+	boost::condition_variable_any m_IdleCond;
+	boost::condition_variable_any m_DoneCond;
+};
+typedef boost::shared_ptr<Executor> ExecutorPtr;
+
+#ifdef EXECUTOR_BENCHMARK
+// 10k short invokers rescheduled on themselves, Executor against fifo_pool.
+void ExecutorBenchmark();
+#endif
+
+#endif
@@ -0,0 +1,194 @@
+#include "FrameArena.h"
+#include "Assertx.h"
+#include "Timer.h"
+
+//////////////////////////////////////////////////////////////////////////
+static void NoCleanup(void*) {}
+static boost::thread_specific_ptr<FrameArena> s_LocalArena;
+static boost::thread_specific_ptr<FrameArena> s_CurrentArena((void (*)(FrameArena*))&NoCleanup);
+
+FrameArena* FrameArena::Local()
+{
+	FrameArena* pArena = s_LocalArena.get();
+	if (pArena == NULL)
+	{
+		pArena = new FrameArena();
+		s_LocalArena.reset(pArena);
+	}
+	return pArena;
+}
+
+FrameArena* FrameArena::Current()
+{
+	return s_CurrentArena.get();
+}
+
+void FrameArena::SetCurrent(FrameArena* pArena)
+{
+	s_CurrentArena.reset(pArena);
+}
+
+//////////////////////////////////////////////////////////////////////////
+FrameArena::FrameArena(size_t blockSize)
+: m_Bytes(0), m_FramePeak(0), m_FrameAllocs(0), m_FrameOverflows(0), m_Depth(0)
+, m_BlockSize(blockSize), m_Allocs(0), m_Overflows(0), m_PeakBytes(0)
+{
+	m_pFirst = NewBlock(blockSize, NULL);
+	m_pBlock = m_pFirst;
+	m_pPos = m_pFirst->Begin();
+	PoolRegistry::Instance().Register(this);
+}
+
+FrameArena::~FrameArena()
+{
+	PoolRegistry::Instance().Unregister(this);
+	// logged only, a throw out of a destructor ends the process; the loop
+	// below frees overflow blocks of an open frame too.
+	AssertSpecialEx(m_Depth == 0 && m_pBlock == m_pFirst, "FrameArena destroyed inside a frame.");
+	while (m_pBlock != NULL)
+	{
+		Block* pPrev = m_pBlock->pPrev;
+		free(m_pBlock);
+		m_pBlock = pPrev;
+	}
+}
+
+FrameArena::Block* FrameArena::NewBlock(size_t size, Block* pPrev)
+{
+	Block* pBlock = (Block*)malloc(sizeof(Block) + size);
+	if (pBlock == NULL) throw std::bad_alloc();
+	pBlock->pPrev = pPrev;
+	pBlock->Size = size;
+	return pBlock;
+}
+
+void* FrameArena::AllocSlow(size_t size, size_t align)
+{
+	m_pBlock = NewBlock(_MAX(size + align, (size_t)m_BlockSize.load(boost::memory_order_relaxed)), m_pBlock);
+	m_pPos = m_pBlock->Begin();
+	m_FrameOverflows++;
+	return Alloc(size, align);
+}
+
+FrameArena::Mark FrameArena::Enter()
+{
+	m_Depth++;
+	Mark mark = { m_pBlock, m_pPos, m_Bytes };
+	return mark;
+}
+
+void FrameArena::Leave(const Mark& mark)
+{
+	Assert(m_Depth > 0);
+	m_Depth--;
+	m_FramePeak = _MAX(m_FramePeak, m_Bytes);
+	while (m_pBlock != mark.pBlock)
+	{
+		Block* pPrev = m_pBlock->pPrev;
+		free(m_pBlock);
+		m_pBlock = pPrev;
+	}
+	m_pPos = mark.pPos;
+	m_Bytes = mark.Bytes;
+
+	if (m_Depth == 0) EndFrame();
+}
+
+void FrameArena::EndFrame()
+{
+	m_Allocs.fetch_add(m_FrameAllocs, boost::memory_order_relaxed);
+	if ((int64_t)m_FramePeak > m_PeakBytes.load(boost::memory_order_relaxed))
+		m_PeakBytes.store(m_FramePeak, boost::memory_order_relaxed);
+
+	if (m_FrameOverflows > 0)
+	{
+		m_Overflows.fetch_add(m_FrameOverflows, boost::memory_order_relaxed);
+
+		// room for this frame next time, the overflow blocks are gone by now
+		size_t blockSize = m_pFirst->Size;
+		while (blockSize < m_FramePeak && blockSize < MAX_BLOCK_SIZE) blockSize *= 2;
+		if (blockSize > m_pFirst->Size)
+		{
+			free(m_pFirst);
+			m_pFirst = NewBlock(blockSize, NULL);
+			m_pBlock = m_pFirst;
+			m_pPos = m_pFirst->Begin();
+			m_BlockSize.store(blockSize, boost::memory_order_relaxed);
+		}
+	}
+
+	m_FramePeak = 0;
+	m_FrameAllocs = 0;
+	m_FrameOverflows = 0;
+}
+
+// sizes are bytes; everything is free between frames, so nothing is in use.
+void FrameArena::GetStats(PoolStats& out) const
+{
+	out.Name = "FrameArena";
+	out.ObjectSize = 0;
+	out.Capacity = m_BlockSize.load(boost::memory_order_relaxed);
+	out.FreeCached = out.Capacity;
+	out.Peak = m_PeakBytes.load(boost::memory_order_relaxed);
+	out.Allocs = m_Allocs.load(boost::memory_order_relaxed);
+	out.Frees = out.Allocs;
+	out.Misses = m_Overflows.load(boost::memory_order_relaxed);
+}
+
+//////////////////////////////////////////////////////////////////////////
+#ifdef FRAMEARENA_BENCHMARK
+/* what a packet handler does: a few strings and a vector per packet, all
+** dropped before the tick ends. 8 threads, so the heap's locks show. */
+#define BENCH_THREADS	(8)
+#define BENCH_FRAMES	(2000)
+#define BENCH_PACKETS	(200)
+
+typedef std::basic_string<CHAR> HeapString;
+
+template<class String, class Vector>
+static void BenchPacket(int32_t n)
+{
+	String name("player_");
+	name += "name_of_some_length_";
+	Vector ids;
+	for (int32_t i = 0; i < 16 + n % 16; i++) ids.push_back(i);
+	String msg(name);
+	msg.append(64, 'x');
+}
+
+static void BenchHeapThread()
+{
+	for (int32_t f = 0; f < BENCH_FRAMES; f++)
+		for (int32_t p = 0; p < BENCH_PACKETS; p++)
+			BenchPacket<HeapString, bstd::vector<int32_t> >(p);
+}
+
+static void BenchArenaThread()
+{
+	for (int32_t f = 0; f < BENCH_FRAMES; f++)
+	{
+		FrameScope frame;
+		for (int32_t p = 0; p < BENCH_PACKETS; p++)
+			BenchPacket<FrameString, bstd::vector<int32_t, FrameAllocator<int32_t> > >(p);
+	}
+}
+
+static double BenchRun(void (*fn)())
+{
+	int64_t start = TimeUtil::TickMicroseconds();
+	boost::thread_group threads;
+	for (int32_t i = 0; i < BENCH_THREADS; i++) threads.create_thread(fn);
+	threads.join_all();
+	return (TimeUtil::TickMicroseconds() - start) / 1000000.0;
+}
+
+void FrameArenaBenchmark()
+{
+	// csv: impl,threads,packets,seconds,ns/packet
+	double packets = (double)BENCH_THREADS * BENCH_FRAMES * BENCH_PACKETS;
+	double heap = BenchRun(&BenchHeapThread);
+	printf("heap,%d,%0.0f,%0.3f,%0.1f\n", BENCH_THREADS, packets, heap, heap * 1e9 / packets * BENCH_THREADS);
+	double arena = BenchRun(&BenchArenaThread);
+	printf("arena,%d,%0.0f,%0.3f,%0.1f\n", BENCH_THREADS, packets, arena, arena * 1e9 / packets * BENCH_THREADS);
+}
+#endif
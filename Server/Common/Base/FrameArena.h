@@ -0,0 +1,169 @@
+#ifndef __FRAME_ARENA_H__
+#define __FRAME_ARENA_H__
+
+#include "Base.h"
+#include "PoolRegistry.h"
+#include <boost/atomic.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+
+//#define FRAMEARENA_BENCHMARK
+
+//////////////////////////////////////////////////////////////////////////
+// bump allocator for memory that dies with the current frame, an
+// Invoker::Invoke. one arena per thread: a FrameScope binds it, allocations
+// bump a pointer in its block and the scope's end rewinds the pointer, no
+// matter how much was allocated. what does not fit goes to an overflow block
+// from the heap, freed at the rewind; a frame that overflowed grows the block
+// for the next frames, up to MAX_BLOCK_SIZE.
+// nothing is destroyed at the rewind: only trivially destructible data or
+// containers that are gone before the scope ends may live here, and never
+// across a coroutine's wait.
+class FrameArena : public IPool
+{
+	struct Block
+	{
+		Block*		pPrev;
+		size_t		Size;
+
+		char*		Begin()		{ return (char*)(this + 1); }
+		char*		End()		{ return Begin() + Size; }
+	};
+public:
+	enum
+	{
+		DEFAULT_BLOCK_SIZE	= 64 * 1024,
+		MAX_BLOCK_SIZE		= 4 * 1024 * 1024,
+	};
+
+	struct Mark
+	{
+		Block*		pBlock;
+		char*		pPos;
+		size_t		Bytes;
+	};
+public:
+	explicit FrameArena(size_t blockSize = DEFAULT_BLOCK_SIZE);
+	~FrameArena();
+public:
+	// the calling thread's arena, created on first use.
+	static FrameArena*	Local();
+	// the arena of the innermost FrameScope on this thread, NULL outside any.
+	static FrameArena*	Current();
+	static void			SetCurrent(FrameArena* pArena);
+public:
+	void*		Alloc(size_t size, size_t align = sizeof(void*))
+	{
+		char* p = (char*)(((size_t)m_pPos + align - 1) & ~(align - 1));
+		if (p + size > m_pBlock->End()) return AllocSlow(size, align);
+		m_pPos = p + size;
+		m_Bytes += size;
+		m_FrameAllocs++;
+		return p;
+	}
+
+	// Leave frees everything allocated since the matching Enter; the frame
+	// ends when the outermost one leaves.
+	Mark		Enter();
+	void		Leave(const Mark& mark);
+
+	virtual void GetStats(PoolStats& out) const;
+private:
+	void*		AllocSlow(size_t size, size_t align);
+	void		EndFrame();
+	static Block* NewBlock(size_t size, Block* pPrev);
+private:
+	Block*		m_pFirst;			// kept between frames
+	Block*		m_pBlock;			// m_pFirst or the newest overflow block
+	char*		m_pPos;
+	size_t		m_Bytes;			// handed out in the current frame
+	size_t		m_FramePeak;
+	int64_t		m_FrameAllocs;
+	int64_t		m_FrameOverflows;
+	int32_t		m_Depth;
+
+	boost::atomic<int64_t>	m_BlockSize;
+	boost::atomic<int64_t>	m_Allocs;
+	boost::atomic<int64_t>	m_Overflows;		// allocations that took an overflow block
+	boost::atomic<int64_t>	m_PeakBytes;		// most bytes one frame used
+};
+
+//////////////////////////////////////////////////////////////////////////
+// binds the thread's arena for its lifetime and rewinds it at the end, so
+// scopes nest: an inner one only frees its own allocations.
+class FrameScope
+{
+public:
+	FrameScope() : m_pArena(FrameArena::Local()), m_pPrev(FrameArena::Current())
+	{
+		m_Mark = m_pArena->Enter();
+		FrameArena::SetCurrent(m_pArena);
+	}
+	~FrameScope()
+	{
+		m_pArena->Leave(m_Mark);
+		FrameArena::SetCurrent(m_pPrev);
+	}
+private:
+	FrameScope(const FrameScope&);
+	FrameScope& operator=(const FrameScope&);
+private:
+	FrameArena*			m_pArena;
+	FrameArena*			m_pPrev;
+	FrameArena::Mark	m_Mark;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// std allocator on the current frame arena, taken when the allocator is
+// constructed. outside a FrameScope it falls back to the heap, so the same
+// container type works everywhere. deallocate of arena memory is a no-op.
+template<class T>
+class FrameAllocator
+{
+public:
+	typedef T			value_type;
+	typedef T*			pointer;
+	typedef const T*	const_pointer;
+	typedef T&			reference;
+	typedef const T&	const_reference;
+	typedef size_t		size_type;
+	typedef ptrdiff_t	difference_type;
+
+	template<class U> struct rebind { typedef FrameAllocator<U> other; };
+public:
+	FrameAllocator() : m_pArena(FrameArena::Current()) {}
+	template<class U> FrameAllocator(const FrameAllocator<U>& other) : m_pArena(other.GetArena()) {}
+public:
+	pointer			address(reference r) const			{ return &r; }
+	const_pointer	address(const_reference r) const	{ return &r; }
+	size_type		max_size() const					{ return size_type(-1) / sizeof(T); }
+	void			construct(pointer p, const T& val)	{ new(p) T(val); }
+	void			destroy(pointer p)					{ p->~T(); }
+
+	pointer allocate(size_type n, const void* = 0)
+	{
+		if (m_pArena == NULL) return (pointer)::operator new(n * sizeof(T));
+		return (pointer)m_pArena->Alloc(n * sizeof(T), boost::alignment_of<T>::value);
+	}
+	void deallocate(pointer p, size_type)
+	{
+		if (m_pArena == NULL) ::operator delete(p);
+	}
+
+	FrameArena*		GetArena() const					{ return m_pArena; }
+private:
+	FrameArena*		m_pArena;
+};
+
+template<class T, class U>
+bool operator==(const FrameAllocator<T>& l, const FrameAllocator<U>& r) { return l.GetArena() == r.GetArena(); }
+template<class T, class U>
+bool operator!=(const FrameAllocator<T>& l, const FrameAllocator<U>& r) { return l.GetArena() != r.GetArena(); }
+
+typedef std::basic_string<CHAR, std::char_traits<CHAR>, FrameAllocator<CHAR> > FrameString;
+
+#ifdef FRAMEARENA_BENCHMARK
+// short lived strings and vectors per frame, heap against the frame arena.
+void FrameArenaBenchmark();
+#endif
+
+#endif
@@ -0,0 +1,108 @@
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+#include "Base.h"
+#include <boost/atomic.hpp>
+
+//////////////////////////////////////////////////////////////////////////
+// log-linear histogram: values below SUB_COUNT are exact, above that every
+// power of two is split into SUB_COUNT buckets (<= 12.5% error).
+// Record is a relaxed atomic add, any thread may Snapshot while another records.
+class Histogram : public boost::noncopyable
+{
+public:
+	enum
+	{
+		SUB_BITS = 3,
+		SUB_COUNT = 1 << SUB_BITS,
+		MAX_BITS = 32,
+		BUCKET_SIZE = SUB_COUNT + (MAX_BITS - SUB_BITS) * SUB_COUNT,
+	};
+
+	struct Snapshot
+	{
+		Snapshot() { Reset(); }
+
+		void Reset()
+		{
+			memset(Counts, 0, sizeof(Counts));
+			Count = 0; Sum = 0; Max = 0;
+		}
+		void Merge(const Snapshot& other)
+		{
+			for (int32_t i = 0; i < BUCKET_SIZE; i++) Counts[i] += other.Counts[i];
+			Count += other.Count;
+			Sum += other.Sum;
+			Max = _MAX(Max, other.Max);
+		}
+		// lower bound of the bucket holding the p-th value, p in [0, 1]
+		int64_t Percentile(double p) const
+		{
+			if (Count <= 0) return 0;
+			int64_t rank = (int64_t)(p * (Count - 1)) + 1, seen = 0;
+			for (int32_t i = 0; i < BUCKET_SIZE; i++)
+			{
+				seen += Counts[i];
+				if (seen >= rank) return LowerBound(i);
+			}
+			return Max;
+		}
+		int64_t Mean() const { return Count > 0 ? Sum / Count : 0; }
+
+		int64_t Counts[BUCKET_SIZE];
+		int64_t Count;
+		int64_t Sum;
+		int64_t Max;
+	};
+public:
+	Histogram() : m_Sum(0), m_Max(0)
+	{
+		for (int32_t i = 0; i < BUCKET_SIZE; i++) m_Counts[i] = 0;
+	}
+public:
+	void Record(int64_t value)
+	{
+		if (value < 0) value = 0;
+		m_Counts[Index(value)].fetch_add(1, boost::memory_order_relaxed);
+		m_Sum.fetch_add(value, boost::memory_order_relaxed);
+		int64_t old = m_Max.load(boost::memory_order_relaxed);
+		while (value > old && !m_Max.compare_exchange_weak(old, value, boost::memory_order_relaxed));
+	}
+
+	// adds into @out, so several histograms can be folded into one snapshot.
+	void GetSnapshot(Snapshot& out) const
+	{
+		Snapshot s;
+		for (int32_t i = 0; i < BUCKET_SIZE; i++)
+		{
+			s.Counts[i] = m_Counts[i].load(boost::memory_order_relaxed);
+			s.Count += s.Counts[i];
+		}
+		s.Sum = m_Sum.load(boost::memory_order_relaxed);
+		s.Max = m_Max.load(boost::memory_order_relaxed);
+		out.Merge(s);
+	}
+
+	static int32_t Index(int64_t value)
+	{
+		if (value < SUB_COUNT) return (int32_t)value;
+		if (value >= ((int64_t)1 << MAX_BITS)) return BUCKET_SIZE - 1;
+		int32_t msb = 0;
+		for (int64_t v = value; v >>= 1;) ++msb;
+		int32_t shift = msb - SUB_BITS;
+		return SUB_COUNT + shift * SUB_COUNT + (int32_t)((value >> shift) - SUB_COUNT);
+	}
+
+	static int64_t LowerBound(int32_t idx)
+	{
+		if (idx < SUB_COUNT) return idx;
+		int32_t shift = (idx - SUB_COUNT) / SUB_COUNT;
+		return (int64_t)(SUB_COUNT + (idx - SUB_COUNT) % SUB_COUNT) << shift;
+	}
+private:
+	boost::atomic<int32_t>	m_Counts[BUCKET_SIZE];
+	boost::atomic<int64_t>	m_Sum;
+	boost::atomic<int64_t>	m_Max;
+};
+
+#endif
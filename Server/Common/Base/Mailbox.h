@@ -0,0 +1,49 @@
+#ifndef __MAILBOX_H__
+#define __MAILBOX_H__
+
+#include "Base.h"
+#include <boost/atomic.hpp>
+
+//////////////////////////////////////////////////////////////////////////
+// lock-free intrusive multi-producer single-consumer queue. T links through
+// its own m_pNext__, so pushing never allocates. producers CAS onto a stack,
+// the consumer takes the whole stack with one exchange and reverses it, so
+// a node is never popped alone and the stack cannot suffer ABA.
+template<class T>
+class Mailbox : public boost::noncopyable
+{
+public:
+	Mailbox() : m_pHead(NULL) {}
+public:
+	// any thread. true if the box was empty before.
+	bool Push(T* pNode)
+	{
+		T* pHead = m_pHead.load(boost::memory_order_relaxed);
+		do
+		{
+			pNode->m_pNext__ = pHead;
+		} while (!m_pHead.compare_exchange_weak(pHead, pNode, boost::memory_order_release, boost::memory_order_relaxed));
+		return pHead == NULL;
+	}
+
+	// consumer only: everything pushed so far, oldest first, linked by m_pNext__.
+	T* PopAll()
+	{
+		T* pNode = m_pHead.exchange(NULL, boost::memory_order_acquire);
+		T* pFirst = NULL;
+		while (pNode != NULL)
+		{
+			T* pNext = pNode->m_pNext__;
+			pNode->m_pNext__ = pFirst;
+			pFirst = pNode;
+			pNode = pNext;
+		}
+		return pFirst;
+	}
+
+	bool Empty() const { return m_pHead.load(boost::memory_order_relaxed) == NULL; }
+private:
+	boost::atomic<T*>	m_pHead;
+};
+
+#endif
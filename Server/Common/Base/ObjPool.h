@@ -6,20 +6,62 @@
 #define __OBJPOOL_H__
 
 #include "Base.h"
-
-template<class T>
-class ObjPool
+#include "PoolRegistry.h"
+#include <boost/atomic.hpp>
+
+// slot index in the low bits, slot generation in the high bits; 0 is never
+// handed out. a handle whose object was deleted stops resolving, even after
+// the slot is reused (until its generation wraps, every 2048 reuses).
+typedef uint32_t PoolHandle_t;
+#define INVALID_POOL_HANDLE		((PoolHandle_t)0)
+
+//////////////////////////////////////////////////////////////////////////
+// fixed capacity pool of T in chunks of _ChunkSize contiguous objects. a
+// chunk is allocated, and its objects constructed, only when the free list
+// runs dry, so an idle server holds one chunk instead of nMaxCount objects.
+// objects are constructed once and reused, the caller cleans them up.
+// T keeps its handle through SetPoolID/GetPoolID. NewObj/DeleteObj pop and
+// push a lock-free free list, only growing takes m_GrowLock.
+template<class T, int32_t _ChunkSize = 256>
+class ObjPool : public IPool
 {
+	enum
+	{
+		INDEX_BITS = 20,
+		INDEX_MASK = (1 << INDEX_BITS) - 1,
+		GEN_MASK = (1 << (32 - INDEX_BITS)) - 1,
+	};
+	BOOST_STATIC_ASSERT((_ChunkSize & (_ChunkSize - 1)) == 0);
+
+	struct Slot
+	{
+		Slot() : Gen(0), Next(0) {}
+
+		boost::atomic<uint32_t>	Gen;		// odd while the object is in use
+		boost::atomic<uint32_t>	Next;		// free list, index + 1, 0 ends it
+	};
+
+	struct Chunk
+	{
+		T		Objs[_ChunkSize];
+		Slot	Slots[_ChunkSize];
+	};
 public:
-	ObjPool( void )
+	explicit ObjPool( const CHAR* szName = "ObjPool" )
 	{
 	__ENTER_FUNCTION
 
-		m_papObj	= NULL;
+		m_szName		= szName;
+		m_pChunks		= NULL;
 		m_nMaxCount		= -1;
-		m_nPosition		= -1;
+		m_nChunks		= 0;
+		m_FreeHead		= 0;
+		m_nCount		= 0;
+		m_nPeak			= 0;
+		m_Allocs		= 0;
+
+		PoolRegistry::Instance().Register(this);
 
-		//m_Lock;
 	__LEAVE_FUNCTION
 	}
 
@@ -27,9 +69,10 @@ public:
 	{
 	__ENTER_FUNCTION
 
+		PoolRegistry::Instance().Unregister(this);
 		Term() ;
 
-		Assert( m_papObj == NULL );
+		Assert( m_pChunks == NULL );
 
 	__LEAVE_FUNCTION
 	}
@@ -38,23 +81,16 @@ public:
 	{
 	__ENTER_FUNCTION
 
-		Assert( nMaxCount > 0 );
-		if ( nMaxCount <= 0 )
+		Assert( nMaxCount > 0 && nMaxCount <= INDEX_MASK );
+		if ( nMaxCount <= 0 || nMaxCount > INDEX_MASK )
 			return false;
 
 		m_nMaxCount		= nMaxCount;
-		m_nPosition		= 0;
-		m_papObj	= new T* [m_nMaxCount];
-
-		int32_t i;
-		for( i = 0; i < m_nMaxCount; i++ )
+		int32_t nChunks = (nMaxCount + _ChunkSize - 1) / _ChunkSize;
+		m_pChunks		= new boost::atomic<Chunk*>[nChunks];
+		for ( int32_t i = 0; i < nChunks; i++ )
 		{
-			m_papObj[i] = new T;
-			if ( m_papObj[i] == NULL )
-			{
-				Assert( m_papObj[i] != NULL );
-				return false;
-			}
+			m_pChunks[i] = NULL;
 		}
 		return true;
 
@@ -67,20 +103,23 @@ public:
 	{
 	__ENTER_FUNCTION
 
-		if ( m_papObj != NULL )
+		if ( m_pChunks != NULL )
 		{
-			int32_t i;
-			for ( i = 0; i < m_nMaxCount; i++ )
+			for ( int32_t i = 0; i < m_nChunks.load(boost::memory_order_relaxed); i++ )
 			{
-				SAFE_DELETE( m_papObj[i] );
+				delete m_pChunks[i].load();
 			}
 
-			delete [] m_papObj;
-			m_papObj = NULL;
+			delete [] m_pChunks;
+			m_pChunks = NULL;
 		}
 
 		m_nMaxCount		= -1;
-		m_nPosition		= -1;
+		m_nChunks		= 0;
+		m_FreeHead		= 0;
+		m_nCount		= 0;
+		m_nPeak			= 0;
+		m_Allocs		= 0;
 
 	__LEAVE_FUNCTION
 	}
@@ -89,24 +128,31 @@ public:
 	{
 	__ENTER_FUNCTION
 
-		m_Lock.Lock();
-		Assert( m_nPosition < m_nMaxCount );
-		if ( m_nPosition >= m_nMaxCount )
+		int32_t nIndex = PopFree();
+		while ( nIndex < 0 )
 		{
-			m_Lock.Unlock();
-			return NULL;
+			if ( !Grow() )
+			{
+				Assert( m_nCount.load() < m_nMaxCount );
+				return NULL;
+			}
+			nIndex = PopFree();
 		}
 
-		T *pObj = m_papObj[m_nPosition];
-		pObj->SetPoolID( (uint32_t)m_nPosition );
-		m_nPosition++;
+		Slot& rSlot = GetSlot(nIndex);
+		uint32_t uGen = rSlot.Gen.load(boost::memory_order_relaxed) + 1;
+		rSlot.Gen.store(uGen, boost::memory_order_release);
+		int32_t nCount = m_nCount.fetch_add(1, boost::memory_order_relaxed) + 1;
+		int32_t nPeak = m_nPeak.load(boost::memory_order_relaxed);
+		while ( nCount > nPeak && !m_nPeak.compare_exchange_weak(nPeak, nCount, boost::memory_order_relaxed) );
+		m_Allocs.fetch_add(1, boost::memory_order_relaxed);
 
-		m_Lock.Unlock();
+		T *pObj = &GetObj(nIndex);
+		pObj->SetPoolID( MakeHandle(nIndex, uGen) );
 		return pObj;
 
 	__LEAVE_FUNCTION
 
-		m_Lock.Unlock();
 		return NULL;
 	}
 
@@ -114,64 +160,164 @@ public:
 	{
 	__ENTER_FUNCTION
 
-		m_Lock.Lock();
-		Assert( pObj != NULL );	
+		Assert( pObj != NULL );
 		if ( pObj == NULL )
-		{
-			m_Lock.Unlock();
 			return ;
-		}
 
-		Assert( m_nPosition > 0 );	
-		if ( m_nPosition <= 0 )
-		{
-			m_Lock.Unlock();
+		PoolHandle_t uHandle = pObj->GetPoolID();
+		int32_t nIndex = (int32_t)(uHandle & INDEX_MASK);
+		Assert( Get(uHandle) == pObj );
+		if ( Get(uHandle) != pObj )
 			return ;
-		}
 
-		uint32_t uDelIndex = pObj->GetPoolID();
-		Assert(uDelIndex < (uint32_t)m_nPosition );
-		if (uDelIndex >= (uint32_t)m_nPosition )
+		// odd -> even once, a second DeleteObj of the same handle fails here
+		Slot& rSlot = GetSlot(nIndex);
+		uint32_t uGen = rSlot.Gen.load(boost::memory_order_relaxed);
+		if ( (uGen & 1) == 0 || !rSlot.Gen.compare_exchange_strong(uGen, uGen + 1, boost::memory_order_acq_rel) )
 		{
-			m_Lock.Unlock();
+			Assert( false );
 			return ;
 		}
 
+		pObj->SetPoolID( INVALID_POOL_HANDLE );
+		m_nCount.fetch_sub(1, boost::memory_order_relaxed);
+		PushFree(nIndex);
 
-		m_nPosition--;
-		T *pDelObj			= m_papObj[uDelIndex];
-		m_papObj[uDelIndex]	= m_papObj[m_nPosition];
-		m_papObj[m_nPosition]	= pDelObj;
+	__LEAVE_FUNCTION
+	}
 
-		m_papObj[uDelIndex]->SetPoolID(uDelIndex );
-		m_papObj[m_nPosition]->SetPoolID( INVALID_ID );
+	// the live object of a handle, NULL once it was deleted; no pointer is
+	// followed besides the chunk table.
+	T* Get( PoolHandle_t uHandle ) const
+	{
+		uint32_t uIndex = uHandle & INDEX_MASK;
+		if ( uHandle == INVALID_POOL_HANDLE || uIndex >= (uint32_t)m_nMaxCount )
+			return NULL;
 
-		m_Lock.Unlock();
-		return;
+		Chunk* pChunk = m_pChunks[uIndex / _ChunkSize].load(boost::memory_order_acquire);
+		if ( pChunk == NULL )
+			return NULL;
 
-	__LEAVE_FUNCTION
+		uint32_t uGen = pChunk->Slots[uIndex % _ChunkSize].Gen.load(boost::memory_order_acquire);
+		if ( (uGen & 1) == 0 || (uGen & GEN_MASK) != (uHandle >> INDEX_BITS) )
+			return NULL;
+
+		return &pChunk->Objs[uIndex % _ChunkSize];
+	}
 
-		m_Lock.Unlock();
-		return;
+	bool IsValid( PoolHandle_t uHandle ) const { return Get(uHandle) != NULL; }
+
+	// live objects chunk by chunk, in memory order. the caller keeps them
+	// from being deleted meanwhile.
+	template<class Func>
+	void ForEach( Func func )
+	{
+		int32_t nChunks = m_nChunks.load(boost::memory_order_acquire);
+		for ( int32_t c = 0; c < nChunks; c++ )
+		{
+			Chunk* pChunk = m_pChunks[c].load(boost::memory_order_acquire);
+			if ( pChunk == NULL )
+				continue;
+			for ( int32_t i = 0; i < _ChunkSize; i++ )
+			{
+				if ( pChunk->Slots[i].Gen.load(boost::memory_order_acquire) & 1 )
+					func( pChunk->Objs[i] );
+			}
+		}
 	}
 
 	int32_t GetCount( void )const
 	{
-	__ENTER_FUNCTION
+		return m_nCount.load(boost::memory_order_relaxed);
+	}
 
-		return m_nPosition;
+	int32_t GetMaxCount( void )const		{ return m_nMaxCount; }
+	int32_t GetChunkCount( void )const		{ return m_nChunks.load(boost::memory_order_acquire); }
+	int32_t GetChunkSize( void )const		{ return _ChunkSize; }
 
-	__LEAVE_FUNCTION
+	// a miss is a NewObj that allocated a chunk.
+	void GetStats( PoolStats& out )const
+	{
+		out.Name		= m_szName;
+		out.ObjectSize	= (int32_t)sizeof(T);
+		out.Capacity	= m_nMaxCount;
+		int32_t nChunks	= GetChunkCount();
+		out.InUse		= GetCount();
+		out.FreeCached	= _MIN(nChunks * _ChunkSize, m_nMaxCount) - out.InUse;
+		out.Peak		= m_nPeak.load(boost::memory_order_relaxed);
+		out.Allocs		= m_Allocs.load(boost::memory_order_relaxed);
+		out.Frees		= out.Allocs - out.InUse;
+		out.Misses		= nChunks;
+	}
 
+private:
+	static PoolHandle_t MakeHandle( int32_t nIndex, uint32_t uGen )
+	{
+		return ((uGen & GEN_MASK) << INDEX_BITS) | (uint32_t)nIndex;
+	}
+
+	Slot& GetSlot( int32_t nIndex ) { return m_pChunks[nIndex / _ChunkSize].load(boost::memory_order_relaxed)->Slots[nIndex % _ChunkSize]; }
+	T& GetObj( int32_t nIndex ) { return m_pChunks[nIndex / _ChunkSize].load(boost::memory_order_relaxed)->Objs[nIndex % _ChunkSize]; }
+
+	// head: tag in the high 32 bits against ABA, index + 1 in the low ones
+	int32_t PopFree()
+	{
+		uint64_t uHead = m_FreeHead.load(boost::memory_order_acquire);
+		while ( (uint32_t)uHead != 0 )
+		{
+			int32_t nIndex = (int32_t)(uint32_t)uHead - 1;
+			uint64_t uNext = ((uHead >> 32) + 1) << 32 | GetSlot(nIndex).Next.load(boost::memory_order_relaxed);
+			if ( m_FreeHead.compare_exchange_weak(uHead, uNext, boost::memory_order_acquire, boost::memory_order_acquire) )
+				return nIndex;
+		}
 		return -1;
 	}
 
-private:
-	T				**m_papObj;
-	int32_t				m_nMaxCount;
-	int32_t				m_nPosition;
+	void PushFree( int32_t nIndex )
+	{
+		Slot& rSlot = GetSlot(nIndex);
+		uint64_t uHead = m_FreeHead.load(boost::memory_order_relaxed);
+		uint64_t uNew;
+		do
+		{
+			rSlot.Next.store((uint32_t)uHead, boost::memory_order_relaxed);
+			uNew = ((uHead >> 32) + 1) << 32 | (uint32_t)(nIndex + 1);
+		} while ( !m_FreeHead.compare_exchange_weak(uHead, uNew, boost::memory_order_release, boost::memory_order_relaxed) );
+	}
+
+	// one more chunk on the free list; false when the pool is at capacity.
+	bool Grow()
+	{
+		AutoLock_T lock(m_GrowLock);
+		// another thread may have grown while we waited for the lock
+		if ( (uint32_t)m_FreeHead.load(boost::memory_order_acquire) != 0 )
+			return true;
+		int32_t c = m_nChunks.load(boost::memory_order_relaxed);
+		if ( c * _ChunkSize >= m_nMaxCount )
+			return false;
 
-	MyLock			m_Lock;
+		m_pChunks[c].store(new Chunk(), boost::memory_order_release);
+		m_nChunks.store(c + 1, boost::memory_order_release);
+
+		int32_t nLast = _MIN((c + 1) * _ChunkSize, m_nMaxCount);
+		for ( int32_t nIndex = nLast - 1; nIndex >= c * _ChunkSize; nIndex-- )
+		{
+			PushFree(nIndex);
+		}
+		return true;
+	}
+
+private:
+	const CHAR*					m_szName;
+	boost::atomic<Chunk*>		*m_pChunks;
+	int32_t						m_nMaxCount;
+	boost::atomic<int32_t>		m_nChunks;		// grows under m_GrowLock, read without it
+	boost::atomic<uint64_t>		m_FreeHead;
+	boost::atomic<int32_t>		m_nCount;
+	boost::atomic<int32_t>		m_nPeak;
+	boost::atomic<int64_t>		m_Allocs;
+
+	MyLock						m_GrowLock;
 };
 
 #endif
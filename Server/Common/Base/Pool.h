@@ -2,13 +2,18 @@
 #define __POOL_H__
 
 #include "BaseType.h"
-
-class IPool
-{
-public:
-	virtual void ActiveRecyle( ) = 0;
-};
-
+#include "ThreadCache.h"
+#include "PoolRegistry.h"
+
+//////////////////////////////////////////////////////////////////////////
+// NewObj constructs in a block from the calling thread's ThreadCache and
+// hands out a shared_ptr whose deleter destroys the object and gives the
+// block back when the last reference drops; the control block comes from
+// the thread caches too. both ways are O(1), no scan and no pool lock.
+// blocks are shared with every pool of the same object size, so the cached
+// and missed counts in GetStats are per size, not per pool.
+// _RecyleInterval, _AllocGranularity and _PoolMaxSize are kept so existing
+// declarations compile, the caches size themselves.
 template
 <
 	typename ObjectType,
@@ -20,123 +25,83 @@ class ObjectPool : public IPool
 {
 public:
 	typedef boost::shared_ptr<ObjectType> ObjectPtr;
-	typedef std::pair<ObjectPtr, bool> PtrElem;
-	typedef TVector<PtrElem> _ElemCont;
-	typedef TList<int32_t> _ElemRef;
+	typedef ThreadCache<sizeof(ObjectType)> _BlockCache;
 private:
-	MyLock m_Lock;
-	int32_t m_LastRecyleIndex;
-	_ElemRef m_FreeList;
-	_ElemCont m_ObjectPtrs;
-public:
-	explicit ObjectPool<ObjectType, _RecyleInterval, _AllocGranularity, _PoolMaxSize>()
+	struct Deleter
 	{
+		void operator()(ObjectType* pObj) const { pPool->Release(pObj); }
 
+		ObjectPool*	pPool;
+	};
+private:
+	const CHAR* m_szName;
+	boost::atomic<int64_t> m_Allocs;
+	boost::atomic<int64_t> m_Frees;
+	boost::atomic<int64_t> m_Peak;
+public:
+	explicit ObjectPool<ObjectType, _RecyleInterval, _AllocGranularity, _PoolMaxSize>(const CHAR* szName = "ObjectPool")
+	: m_szName(szName), m_Allocs(0), m_Frees(0), m_Peak(0)
+	{
+		PoolRegistry::Instance().Register(this);
+	}
+	~ObjectPool<ObjectType, _RecyleInterval, _AllocGranularity, _PoolMaxSize>()
+	{
+		PoolRegistry::Instance().Unregister(this);
 	}
 public:
 	ObjectPtr NewObj()
 	{
 		__ENTER_FUNCTION_EX
 
-			AutoLock_T Lock(m_Lock);
-		if( m_FreeList.Empty() )
+			void* pBlock = _BlockCache::Alloc();
+		ObjectType* pObj = NULL;
+		try
 		{
-			Recyle();
+			pObj = new(pBlock) ObjectType();
 		}
-
-		if( m_FreeList.Empty() )
+		catch(...)
 		{
-			Allocate();
+			_BlockCache::Free(pBlock);
+			throw;
 		}
 
-		Assert(!m_FreeList.Empty());
+		int64_t inUse = m_Allocs.fetch_add(1, boost::memory_order_relaxed) + 1 - m_Frees.load(boost::memory_order_relaxed);
+		int64_t peak = m_Peak.load(boost::memory_order_relaxed);
+		while (inUse > peak && !m_Peak.compare_exchange_weak(peak, inUse, boost::memory_order_relaxed));
 
-		int32_t freeIdx = -1;
-		m_FreeList.PopFront(freeIdx);
+		Deleter deleter = { this };
+		return ObjectPtr(pObj, deleter, ThreadCacheAllocator<ObjectType>());
 
-		Assert((freeIdx >=0 && freeIdx < (int32_t)m_ObjectPtrs.size()));
-		Assert(m_ObjectPtrs[freeIdx].first.unique());
-		Assert(m_ObjectPtrs[freeIdx].second);
-
-		m_ObjectPtrs[freeIdx].second = false;
-		ObjectPtr ptr = m_ObjectPtrs[freeIdx].first;
-		return ptr;
-		
 		__LEAVE_FUNCTION_EX
 
 		ObjectPtr ptr(new ObjectType());
 		return ptr;
 	}
 
+	// objects come back by themselves when their last ObjectPtr drops.
 	void ActiveRecyle()
 	{
-		__ENTER_FUNCTION_EX
-
-			AutoLock_T Lock(m_Lock);
-
-			const int32_t ObjectSize = (int32_t)m_ObjectPtrs.size();
-			for( int32_t i = 0; i < ObjectSize; i++)
-			{
-				if(!m_ObjectPtrs[i].second)
-				{
-					if(m_ObjectPtrs[i].first.unique())
-					{
-						m_ObjectPtrs[i].first->ObjectType::~ObjectType();
-						new(m_ObjectPtrs[i].first.get()) ObjectType();
-
-						m_ObjectPtrs[i].second = true;
-						m_FreeList.PushBack(i);
-					}
-				}
-			}
-		__LEAVE_FUNCTION_EX
 	}
 
-private:
-	void Recyle( )
+	void GetStats(PoolStats& out) const
 	{
-		__ENTER_FUNCTION
-
-			const int32_t ObjectSize = (int32_t)m_ObjectPtrs.size();
-		for( int32_t idx = 0; idx < ObjectSize; idx++)
-		{
-			Assert( m_LastRecyleIndex>=0 && m_LastRecyleIndex < (int32_t)m_ObjectPtrs.size() );
-			if( m_ObjectPtrs[m_LastRecyleIndex].first.unique())
-			{
-				m_ObjectPtrs[m_LastRecyleIndex].first->ObjectType::~ObjectType();
-				new(m_ObjectPtrs[m_LastRecyleIndex].first.get()) ObjectType();
-
-				m_ObjectPtrs[m_LastRecyleIndex].second = true;
-				m_FreeList.PushBack(m_LastRecyleIndex);
-
-				m_LastRecyleIndex = (m_LastRecyleIndex+1) % ObjectSize;
-
-				if( m_FreeList.Size() > _RecyleInterval)
-				{
-					break;
-				}
-			}
-			else
-			{
-				m_LastRecyleIndex = (m_LastRecyleIndex+1) % ObjectSize;
-			}
-		}
-
-
-		__LEAVE_FUNCTION
+		out.Name = m_szName;
+		out.ObjectSize = (int32_t)sizeof(ObjectType);
+		out.Capacity = -1;		// grows with demand
+		out.Allocs = m_Allocs.load(boost::memory_order_relaxed);
+		out.Frees = m_Frees.load(boost::memory_order_relaxed);
+		out.InUse = out.Allocs - out.Frees;
+		out.Peak = m_Peak.load(boost::memory_order_relaxed);
+		out.FreeCached = _BlockCache::DepotBlocks();
+		out.Misses = _BlockCache::HeapBlocks();
 	}
 
-	void Allocate()
+private:
+	void Release(ObjectType* pObj)
 	{
-		__ENTER_FUNCTION
-			for(int32_t i  = 0; i < _AllocGranularity; i++)
-			{
-				ObjectPtr ptr(new ObjectType());
-				m_ObjectPtrs.push_back(std::make_pair(ptr, true));
-				m_FreeList.PushBack((int32_t)m_ObjectPtrs.size() - 1);
-			}
-
-		__LEAVE_FUNCTION
+		pObj->~ObjectType();
+		_BlockCache::Free(pObj);
+		m_Frees.fetch_add(1, boost::memory_order_relaxed);
 	}
 };
 
@@ -147,9 +112,9 @@ private:
 	typedef ObjectPool<OBJECTTYPE>::ObjectPtr OBJECTTYPE##Ptr
 
 #define POOL_IMPL(OBJECTTYPE)\
-	ObjectPool<OBJECTTYPE> __POOL_INST(OBJECTTYPE)
+	ObjectPool<OBJECTTYPE> __POOL_INST(OBJECTTYPE)(#OBJECTTYPE)
 
 #define POOL_NEW(OBJECTTYPE)\
 	__POOL_INST(OBJECTTYPE).NewObj()
 
-#endif
\ No newline at end of file
+#endif
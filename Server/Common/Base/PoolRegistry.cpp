@@ -0,0 +1,60 @@
+#include "PoolRegistry.h"
+#include "Assertx.h"
+#include "Timer.h"
+
+PoolRegistry& PoolRegistry::Instance()
+{
+	// a global pool of another translation unit may register before any
+	// global of this one is constructed, and unregister after it is gone
+	static PoolRegistry* s_pInstance = new PoolRegistry();
+	return *s_pInstance;
+}
+
+PoolRegistry::PoolRegistry() : m_LastSnapshotUs(0)
+{
+}
+
+void PoolRegistry::Register(IPool* pPool)
+{
+	__ENTER_FUNCTION
+		Assert(pPool);
+	Entry entry = { pPool, 0 };
+	AutoLock_T lock(m_Lock);
+	m_Entries.push_back(entry);
+	__LEAVE_FUNCTION
+}
+
+void PoolRegistry::Unregister(IPool* pPool)
+{
+	__ENTER_FUNCTION
+		AutoLock_T lock(m_Lock);
+	for (int32_t i = 0; i < (int32_t)m_Entries.size(); i++)
+	{
+		if (m_Entries[i].pPool != pPool) continue;
+		m_Entries[i] = m_Entries.back();
+		m_Entries.pop_back();
+		break;
+	}
+	__LEAVE_FUNCTION
+}
+
+void PoolRegistry::Snapshot(bstd::vector<PoolStats>& out, bool bRebase)
+{
+	__ENTER_FUNCTION
+		out.clear();
+	AutoLock_T lock(m_Lock);
+	int64_t nowUs = TimeUtil::TickMicroseconds();
+	double seconds = m_LastSnapshotUs > 0 ? _MAX(nowUs - m_LastSnapshotUs, (int64_t)1) / 1000000.0 : 0.0;
+	if (bRebase) m_LastSnapshotUs = nowUs;
+
+	out.resize(m_Entries.size());
+	for (int32_t i = 0; i < (int32_t)m_Entries.size(); i++)
+	{
+		Entry& entry = m_Entries[i];
+		PoolStats& stat = out[i];
+		entry.pPool->GetStats(stat);
+		stat.AllocRate = seconds > 0.0 ? (float)((stat.Allocs - entry.LastAllocs) / seconds) : 0.0f;
+		if (bRebase) entry.LastAllocs = stat.Allocs;
+	}
+	__LEAVE_FUNCTION
+}
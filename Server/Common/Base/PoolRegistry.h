@@ -0,0 +1,59 @@
+#ifndef __POOL_REGISTRY_H__
+#define __POOL_REGISTRY_H__
+
+#include "Base.h"
+
+struct PoolStats
+{
+	PoolStats() { memset(this, 0, sizeof(*this)); }
+
+	const CHAR*	Name;
+	int32_t		ObjectSize;
+	int64_t		Capacity;		// most objects the pool hands out, -1 unbounded
+	int64_t		InUse;
+	int64_t		FreeCached;		// constructed or allocated, ready for the next NewObj
+	int64_t		Peak;			// high-water mark of InUse
+	int64_t		Allocs;
+	int64_t		Frees;
+	int64_t		Misses;			// NewObj that had to go to the heap
+	float		AllocRate;		// per second since the last rebasing Snapshot, filled by PoolRegistry
+};
+
+class IPool
+{
+public:
+	virtual ~IPool() {}
+public:
+	virtual void ActiveRecyle( ) {}
+	virtual void GetStats(PoolStats& out) const = 0;
+};
+
+//////////////////////////////////////////////////////////////////////////
+// every live pool of the process. pools add themselves when constructed and
+// remove themselves when destroyed, global pools do so during static init,
+// so the registry is created on first use and never freed.
+class PoolRegistry
+{
+public:
+	static PoolRegistry& Instance();
+public:
+	void		Register(IPool* pPool);
+	void		Unregister(IPool* pPool);
+	// bRebase: the periodic logger, AllocRate of later snapshots is measured
+	// from this one. an on-demand snapshot leaves the baseline alone.
+	void		Snapshot(bstd::vector<PoolStats>& out, bool bRebase = false);
+private:
+	PoolRegistry();
+private:
+	struct Entry
+	{
+		IPool*		pPool;
+		int64_t		LastAllocs;
+	};
+private:
+	MyLock				m_Lock;
+	bstd::vector<Entry>	m_Entries;
+	int64_t				m_LastSnapshotUs;
+};
+
+#endif
@@ -353,6 +353,8 @@ __ENTER_FUNCTION
 
 	m_TID		= 0 ;
 	m_Status	= Thread::READY ;
+	m_Cpu		= -1 ;
+	strncpy( m_szName, "Thread", sizeof(m_szName) ) ;
 
 #if defined(__WINDOWS__)
 	m_hThread = NULL ;
@@ -400,6 +402,17 @@ __LEAVE_FUNCTION
 }
 
 
+////////////////////////////////////////////////////////////////////////////////
+//
+//
+////////////////////////////////////////////////////////////////////////////////
+void Thread::setName ( const CHAR* szName )
+{
+	strncpy( m_szName, szName, sizeof(m_szName) - 1 ) ;
+	m_szName[sizeof(m_szName) - 1] = 0 ;
+}
+
+
 ////////////////////////////////////////////////////////////////////////////////
 //
 //
@@ -449,12 +462,14 @@ __ENTER_FUNCTION
 	
 	// set thread's status to "RUNNING"
 	thread->setStatus(Thread::RUNNING);
+	g_ThreadRegistry.Add(thread->getName(), thread->getCpu());
 
 	// here - polymorphism used. (derived::run() called.)
 	thread->run();
 	
 	// set thread's status to "EXIT"
 	thread->setStatus(Thread::EXIT);
+	g_ThreadRegistry.Remove();
 	
 	//INT ret = 0;
 	//thread->exit(&ret);
@@ -481,12 +496,14 @@ unsigned int WINAPI MyThreadProcess(  void* derivedThread )
 		
 		// set thread's status to "RUNNING"
 		thread->setStatus(Thread::RUNNING);
+		g_ThreadRegistry.Add(thread->getName(), thread->getCpu());
 
 		// here - polymorphism used. (derived::run() called.)
 		thread->run();
 		
 		// set thread's status to "EXIT"
 		thread->setStatus(Thread::EXIT);
+		g_ThreadRegistry.Remove();
 
 		thread->exit(NULL);
 
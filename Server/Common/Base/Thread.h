@@ -14,6 +14,7 @@
 // include files
 //////////////////////////////////////////////////
 #include "Base.h"
+#include "ThreadRegistry.h"
 
 
 
@@ -84,6 +85,12 @@ public :
 	// get/set thread's status
 	ThreadStatus getStatus () { return m_Status; }
 	void setStatus ( ThreadStatus status ) { m_Status = status; }
+
+	// applied by the thread itself when it starts, so call before start()
+	const CHAR* getName () const { return m_szName; }
+	void setName ( const CHAR* szName ) ;
+	int32_t getCpu () const { return m_Cpu; }
+	void setCpu ( int32_t cpu ) { m_Cpu = cpu; }
 	
 
 //////////////////////////////////////////////////
@@ -98,6 +105,12 @@ private :
 	// thread status
 	ThreadStatus m_Status;
 
+	// name in g_ThreadRegistry and top -H
+	CHAR m_szName[32];
+
+	// pinned cpu, -1: not pinned
+	int32_t m_Cpu;
+
 #if defined(__WINDOWS__)
 	HANDLE m_hThread ;
 #endif
@@ -0,0 +1,164 @@
+#ifndef __THREAD_CACHE_H__
+#define __THREAD_CACHE_H__
+
+#include "Base.h"
+#include <boost/atomic.hpp>
+
+//////////////////////////////////////////////////////////////////////////
+// per-thread freelist of _BlockSize byte blocks. Free puts the block on the
+// freeing thread's list, so a block allocated by a sender and released by a
+// receiver changes threads. a list longer than _CacheSize gives half to a
+// shared depot and an empty list takes up to half from it, so the lock is
+// taken once per batch, not once per block.
+template<size_t _BlockSize, int32_t _CacheSize = 256>
+class ThreadCache
+{
+	struct Block
+	{
+		Block*		pNext;
+	};
+
+	struct List
+	{
+		List() : pHead(NULL), Count(0) {}
+		// the thread is exiting, its blocks stay usable for the others
+		~List() { Spill(this, Count); }
+
+		Block*		pHead;
+		int32_t		Count;
+	};
+
+	// never freed: a thread may exit, and spill, after static destruction
+	struct Depot
+	{
+		Depot() : HeapBlocks(0) {}
+
+		MyLock					Lock;
+		bstd::vector<Block*>	Blocks;
+		boost::atomic<int64_t>	HeapBlocks;
+	};
+
+	enum { BLOCK_SIZE = _BlockSize > sizeof(Block) ? _BlockSize : sizeof(Block) };
+public:
+	static void* Alloc()
+	{
+		List* pList = Local();
+		if (pList->pHead == NULL) Refill(pList);
+		if (pList->pHead == NULL)
+		{
+			s_pDepot->HeapBlocks.fetch_add(1, boost::memory_order_relaxed);
+			return ::operator new(BLOCK_SIZE);
+		}
+
+		Block* pBlock = pList->pHead;
+		pList->pHead = pBlock->pNext;
+		pList->Count--;
+		return pBlock;
+	}
+
+	static void Free(void* p)
+	{
+		if (p == NULL) return;
+		List* pList = Local();
+		Block* pBlock = (Block*)p;
+		pBlock->pNext = pList->pHead;
+		pList->pHead = pBlock;
+		if (++pList->Count > _CacheSize) Spill(pList, _CacheSize / 2);
+	}
+	// blocks of this size taken from the heap so far, none is ever given back.
+	static int64_t HeapBlocks() { return s_pDepot->HeapBlocks.load(boost::memory_order_relaxed); }
+	// free blocks parked in the depot, the per-thread lists are not counted.
+	static int64_t DepotBlocks()
+	{
+		AutoLock_T lock(s_pDepot->Lock);
+		return (int64_t)s_pDepot->Blocks.size();
+	}
+private:
+	static List* Local()
+	{
+		List* pList = s_Local.get();
+		if (pList == NULL)
+		{
+			pList = new List();
+			s_Local.reset(pList);
+		}
+		return pList;
+	}
+
+	static void Refill(List* pList)
+	{
+		AutoLock_T lock(s_pDepot->Lock);
+		for (int32_t i = 0; i < _CacheSize / 2 && !s_pDepot->Blocks.empty(); i++)
+		{
+			Block* pBlock = s_pDepot->Blocks.back();
+			s_pDepot->Blocks.pop_back();
+			pBlock->pNext = pList->pHead;
+			pList->pHead = pBlock;
+			pList->Count++;
+		}
+	}
+
+	static void Spill(List* pList, int32_t count)
+	{
+		AutoLock_T lock(s_pDepot->Lock);
+		for (int32_t i = 0; i < count && pList->pHead != NULL; i++)
+		{
+			Block* pBlock = pList->pHead;
+			pList->pHead = pBlock->pNext;
+			pList->Count--;
+			s_pDepot->Blocks.push_back(pBlock);
+		}
+	}
+private:
+	static boost::thread_specific_ptr<List>	s_Local;
+	static Depot*							s_pDepot;
+};
+
+template<size_t _BlockSize, int32_t _CacheSize>
+boost::thread_specific_ptr<typename ThreadCache<_BlockSize, _CacheSize>::List> ThreadCache<_BlockSize, _CacheSize>::s_Local;
+template<size_t _BlockSize, int32_t _CacheSize>
+typename ThreadCache<_BlockSize, _CacheSize>::Depot* ThreadCache<_BlockSize, _CacheSize>::s_pDepot = new typename ThreadCache<_BlockSize, _CacheSize>::Depot();
+
+//////////////////////////////////////////////////////////////////////////
+// std allocator on top of ThreadCache, for the shared_ptr control blocks of
+// pooled objects and node based containers. arrays go to the heap.
+template<class T>
+class ThreadCacheAllocator
+{
+public:
+	typedef T			value_type;
+	typedef T*			pointer;
+	typedef const T*	const_pointer;
+	typedef T&			reference;
+	typedef const T&	const_reference;
+	typedef size_t		size_type;
+	typedef ptrdiff_t	difference_type;
+
+	template<class U> struct rebind { typedef ThreadCacheAllocator<U> other; };
+public:
+	ThreadCacheAllocator() {}
+	template<class U> ThreadCacheAllocator(const ThreadCacheAllocator<U>&) {}
+public:
+	pointer			address(reference r) const			{ return &r; }
+	const_pointer	address(const_reference r) const	{ return &r; }
+	size_type		max_size() const					{ return size_type(-1) / sizeof(T); }
+	void			construct(pointer p, const T& val)	{ new(p) T(val); }
+	void			destroy(pointer p)					{ p->~T(); }
+
+	pointer allocate(size_type n, const void* = 0)
+	{
+		return n == 1 ? (pointer)ThreadCache<sizeof(T)>::Alloc() : (pointer)::operator new(n * sizeof(T));
+	}
+	void deallocate(pointer p, size_type n)
+	{
+		if (n == 1) ThreadCache<sizeof(T)>::Free(p);
+		else ::operator delete(p);
+	}
+};
+
+template<class T, class U>
+bool operator==(const ThreadCacheAllocator<T>&, const ThreadCacheAllocator<U>&) { return true; }
+template<class T, class U>
+bool operator!=(const ThreadCacheAllocator<T>&, const ThreadCacheAllocator<U>&) { return false; }
+
+#endif
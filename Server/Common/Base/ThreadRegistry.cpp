@@ -0,0 +1,141 @@
+#include "ThreadRegistry.h"
+#include "Assertx.h"
+#include "Timer.h"
+
+#if defined(__LINUX__)
+#include <unistd.h>
+#endif
+
+// the helpers are shared with ServerDep, which builds the same ThreadUtil.cpp
+#include "../../../ServerDep/base/ThreadUtil.h"
+
+ThreadRegistry g_ThreadRegistry;
+
+//////////////////////////////////////////////////////////////////////////
+void SetCurrentThreadName(const CHAR* szName)
+{
+	base::setThreadName(szName);
+}
+
+bool PinCurrentThread(int32_t cpu)
+{
+	return base::pinThread(cpu);
+}
+
+void ParseCpuList(const CHAR* szList, bstd::vector<int32_t>& out)
+{
+	base::parseCpuList(szList, out);
+}
+
+//////////////////////////////////////////////////////////////////////////
+ThreadRegistry::ThreadRegistry()
+{
+}
+
+ThreadRegistry::~ThreadRegistry()
+{
+#if defined(__WINDOWS__)
+	for (int32_t i = 0; i < (int32_t)m_Entries.size(); i++)
+	{
+		::CloseHandle(m_Entries[i].Handle);
+	}
+#endif
+}
+
+void ThreadRegistry::Add(const CHAR* szName, int32_t cpu)
+{
+	__ENTER_FUNCTION
+		SetCurrentThreadName(szName);
+	bool bPinned = PinCurrentThread(cpu);
+
+	Entry entry;
+	memset(&entry.Info, 0, sizeof(entry.Info));
+	strncpy(entry.Info.Name, szName, sizeof(entry.Info.Name) - 1);
+	entry.Info.Tid = base::currentKernelTid();
+	entry.Info.Cpu = bPinned ? cpu : -1;
+#if defined(__WINDOWS__)
+	entry.Handle = ::OpenThread(THREAD_QUERY_INFORMATION, FALSE, (DWORD)entry.Info.Tid);
+#endif
+	entry.LastCpuUs = 0;
+	entry.LastSampleUs = TimeUtil::TickMicroseconds();
+	ReadCpuUs(entry, entry.LastCpuUs);
+
+	AutoLock_T lock(m_Lock);
+	m_Entries.push_back(entry);
+	__LEAVE_FUNCTION
+}
+
+void ThreadRegistry::Remove()
+{
+	__ENTER_FUNCTION
+		int32_t tid = base::currentKernelTid();
+	AutoLock_T lock(m_Lock);
+	for (int32_t i = 0; i < (int32_t)m_Entries.size(); i++)
+	{
+		if (m_Entries[i].Info.Tid != tid) continue;
+#if defined(__WINDOWS__)
+		::CloseHandle(m_Entries[i].Handle);
+#endif
+		m_Entries[i] = m_Entries.back();
+		m_Entries.pop_back();
+		break;
+	}
+	__LEAVE_FUNCTION
+}
+
+void ThreadRegistry::Sample(bstd::vector<ThreadSample>& out)
+{
+	__ENTER_FUNCTION
+		out.clear();
+	int64_t nowUs = TimeUtil::TickMicroseconds();
+	AutoLock_T lock(m_Lock);
+	for (int32_t i = 0; i < (int32_t)m_Entries.size(); i++)
+	{
+		Entry& entry = m_Entries[i];
+		int64_t cpuUs = 0;
+		if (!ReadCpuUs(entry, cpuUs)) continue;
+
+		int64_t wallUs = nowUs - entry.LastSampleUs;
+		entry.Info.CpuMs = cpuUs / 1000;
+		entry.Info.CpuRate = wallUs > 0 ? (float)((cpuUs - entry.LastCpuUs) * 100.0 / wallUs) : 0.0f;
+		entry.LastCpuUs = cpuUs;
+		entry.LastSampleUs = nowUs;
+		out.push_back(entry.Info);
+	}
+	__LEAVE_FUNCTION
+}
+
+bool ThreadRegistry::ReadCpuUs(const Entry& entry, int64_t& cpuUs)
+{
+#if defined(__LINUX__)
+	CHAR szPath[64];
+	tsnprintf(szPath, sizeof(szPath), "/proc/self/task/%d/stat", entry.Info.Tid);
+	FILE* fp = fopen(szPath, "r");
+	if (fp == NULL) return false;
+	CHAR szLine[512] = { 0 };
+	size_t n = fread(szLine, 1, sizeof(szLine) - 1, fp);
+	fclose(fp);
+	szLine[n] = 0;
+
+	// the name in (...) may hold spaces, fields are counted after the last ')'
+	const CHAR* p = strrchr(szLine, ')');
+	if (p == NULL) return false;
+	unsigned long long utime = 0, stime = 0;
+	if (sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2)
+		return false;
+	static const int64_t s_ClkTck = sysconf(_SC_CLK_TCK);
+	cpuUs = (int64_t)(utime + stime) * 1000000 / s_ClkTck;
+	return true;
+#elif defined(__WINDOWS__)
+	FILETIME create, exit, kernel, user;
+	if (entry.Handle == NULL || !::GetThreadTimes(entry.Handle, &create, &exit, &kernel, &user))
+		return false;
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernel.dwLowDateTime; k.HighPart = kernel.dwHighDateTime;
+	u.LowPart = user.dwLowDateTime; u.HighPart = user.dwHighDateTime;
+	cpuUs = (int64_t)((k.QuadPart + u.QuadPart) / 10);
+	return true;
+#else
+	return false;
+#endif
+}
@@ -0,0 +1,55 @@
+#ifndef __THREAD_REGISTRY_H__
+#define __THREAD_REGISTRY_H__
+
+#include "Base.h"
+
+//////////////////////////////////////////////////////////////////////////
+// name shown by top -H, perf and the debugger; linux keeps the first 15 chars.
+void	SetCurrentThreadName(const CHAR* szName);
+// pin the calling thread to one cpu, cpu < 0 leaves it to the scheduler.
+bool	PinCurrentThread(int32_t cpu);
+// "0,2,4-7" -> 0 2 4 5 6 7, for the core map in GameConfig.ini.
+void	ParseCpuList(const CHAR* szList, bstd::vector<int32_t>& out);
+
+struct ThreadSample
+{
+	CHAR		Name[32];
+	int32_t		Tid;			// kernel thread id, as in /proc/self/task
+	int32_t		Cpu;			// pinned cpu, -1 if not pinned
+	int64_t		CpuMs;			// user + sys since the thread started
+	float		CpuRate;		// percent of one core since the previous Sample
+};
+
+//////////////////////////////////////////////////////////////////////////
+// every named thread of the process. a thread adds itself when it starts and
+// removes itself before it exits; Sample reads the per-thread cpu time from
+// /proc/self/task/<tid>/stat (GetThreadTimes on windows).
+class ThreadRegistry
+{
+public:
+	ThreadRegistry();
+	~ThreadRegistry();
+public:
+	// calling thread: name it, pin it and make it visible to Sample.
+	void		Add(const CHAR* szName, int32_t cpu = -1);
+	void		Remove();
+	void		Sample(bstd::vector<ThreadSample>& out);
+private:
+	struct Entry
+	{
+		ThreadSample	Info;
+		int64_t			LastCpuUs;
+		int64_t			LastSampleUs;
+#if defined(__WINDOWS__)
+		HANDLE			Handle;
+#endif
+	};
+	bool		ReadCpuUs(const Entry& entry, int64_t& cpuUs);
+private:
+	MyLock				m_Lock;
+	bstd::vector<Entry>	m_Entries;
+};
+
+extern ThreadRegistry g_ThreadRegistry;
+
+#endif
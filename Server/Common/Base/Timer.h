@@ -36,6 +36,7 @@ class TimeUtil
 {
 public:
 static uint32_t		TickCount( );
+static int64_t		TickMicroseconds( );	// monotonic
 static int64_t		UtcMilliseconds( );
 static void			UtcTime(int32_t *seconds, int32_t *milliseconds);
 static void			AddMillisecondsToNow(int32_t milliseconds, int32_t *sec, int32_t *ms);
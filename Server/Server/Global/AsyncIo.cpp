@@ -0,0 +1,41 @@
+#include "AsyncIo.h"
+
+ExecutorPtr AsyncIo::s_DBPtr;
+ExecutorPtr AsyncIo::s_CachePtr;
+MyLock AsyncIo::s_DBLocks[AsyncIo::DB_LOCKS];
+MyLock AsyncIo::s_CacheLocks[AsyncIo::CACHE_LOCKS];
+
+bool AsyncIo::Init(int32 dbThreads, int32 cacheThreads)
+{
+	__ENTER_FUNCTION
+		s_DBPtr = ExecutorPtr(new Executor(_MAX(dbThreads, 1), "dbio"));
+	s_CachePtr = ExecutorPtr(new Executor(_MAX(cacheThreads, 1), "cacheio"));
+	return true;
+	__LEAVE_FUNCTION
+		return false;
+}
+
+void AsyncIo::Exit()
+{
+	__ENTER_FUNCTION
+		// queued io gets a few seconds to finish; the coroutines waiting on it
+		// are not resumed once their invokers are gone
+		if (s_DBPtr) s_DBPtr->Wait(5000);
+	if (s_CachePtr) s_CachePtr->Wait(5000);
+	s_DBPtr.reset();
+	s_CachePtr.reset();
+	__LEAVE_FUNCTION
+}
+
+// striped by address; two instances on one stripe just take turns
+MyLock& AsyncIo::DBLock(const void* pInstance)
+{
+	size_t h = (size_t)pInstance;
+	return s_DBLocks[(h ^ (h >> 7)) % DB_LOCKS];
+}
+
+MyLock& AsyncIo::CacheLock(const void* pInstance)
+{
+	size_t h = (size_t)pInstance;
+	return s_CacheLocks[(h ^ (h >> 7)) % CACHE_LOCKS];
+}
@@ -0,0 +1,101 @@
+#ifndef __ASYNC_IO_H__
+#define __ASYNC_IO_H__
+
+#include "BaseLib.h"
+#include "Coroutine.h"
+
+//////////////////////////////////////////////////////////////////////////
+// dedicated threads for blocking db and memcached calls, so a coroutine that
+// waits on them gives its pool thread back to the other invokers.
+class AsyncIo
+{
+public:
+	static bool			Init(int32 dbThreads, int32 cacheThreads);
+	static void			Exit();
+	static Executor&	DB()	{ return *s_DBPtr; }
+	static Executor&	Cache()	{ return *s_CachePtr; }
+	// held by the dbio thread around every call on @pInstance.
+	static MyLock&		DBLock(const void* pInstance);
+	// held by the cacheio thread around every call on @pInstance.
+	static MyLock&		CacheLock(const void* pInstance);
+private:
+	enum { DB_LOCKS = 16, CACHE_LOCKS = 16 };
+	static ExecutorPtr	s_DBPtr;
+	static ExecutorPtr	s_CachePtr;
+	static MyLock		s_DBLocks[DB_LOCKS];
+	static MyLock		s_CacheLocks[CACHE_LOCKS];
+};
+
+//////////////////////////////////////////////////////////////////////////
+// coroutine side of DataBase (ServerDep base/db) and LibMemInterface. only
+// valid inside a coroutine started by CoSpawn; the arguments stay on the
+// suspended coroutine stack until the io thread is done with them.
+// neither a MYSQL connection nor a memcached_st is thread safe, so the calls
+// on one DB or Mem run one at a time whichever io thread takes them; give
+// each concurrent user its own DB or Mem (memcached_clone) to use more than
+// one io thread at once.
+class QueryResult;
+
+template<class DB>
+QueryResult* CoQueryOn(DB* pDB, const CHAR* szSql)
+{
+	AutoLock_T lock(AsyncIo::DBLock(pDB));
+	return pDB->query(szSql);
+}
+template<class DB>
+bool CoExecuteOn(DB* pDB, const CHAR* szSql)
+{
+	AutoLock_T lock(AsyncIo::DBLock(pDB));
+	return pDB->execute(szSql) ? true : false;
+}
+
+template<class DB>
+QueryResult* CoQuery(DB& db, const CHAR* szSql)
+{
+	return CoAwait<QueryResult*>(AsyncIo::DB(), boost::bind(&CoQueryOn<DB>, &db, szSql));
+}
+
+template<class DB>
+bool CoExecute(DB& db, const CHAR* szSql)
+{
+	return CoAwait<bool>(AsyncIo::DB(), boost::bind(&CoExecuteOn<DB>, &db, szSql));
+}
+
+template<class Mem>
+CHAR* CoMemGetOn(Mem* pMem, const CHAR* key, uint32_t keyLen, size_t* pValueLen)
+{
+	AutoLock_T lock(AsyncIo::CacheLock(pMem));
+	return pMem->Get(key, keyLen, pValueLen);
+}
+template<class Mem>
+bool CoMemSetOn(Mem* pMem, const CHAR* key, uint32_t keyLen, const CHAR* value, uint32_t valueLen, time_t expiration)
+{
+	AutoLock_T lock(AsyncIo::CacheLock(pMem));
+	return pMem->Set(key, keyLen, value, valueLen, expiration);
+}
+template<class Mem>
+bool CoMemDelOn(Mem* pMem, const CHAR* key, uint32_t keyLen, time_t expiration)
+{
+	AutoLock_T lock(AsyncIo::CacheLock(pMem));
+	return pMem->Del(key, keyLen, expiration);
+}
+
+template<class Mem>
+CHAR* CoMemGet(Mem& mem, const CHAR* key, uint32_t keyLen, size_t* pValueLen)
+{
+	return CoAwait<CHAR*>(AsyncIo::Cache(), boost::bind(&CoMemGetOn<Mem>, &mem, key, keyLen, pValueLen));
+}
+
+template<class Mem>
+bool CoMemSet(Mem& mem, const CHAR* key, uint32_t keyLen, const CHAR* value, uint32_t valueLen, time_t expiration)
+{
+	return CoAwait<bool>(AsyncIo::Cache(), boost::bind(&CoMemSetOn<Mem>, &mem, key, keyLen, value, valueLen, expiration));
+}
+
+template<class Mem>
+bool CoMemDel(Mem& mem, const CHAR* key, uint32_t keyLen, time_t expiration)
+{
+	return CoAwait<bool>(AsyncIo::Cache(), boost::bind(&CoMemDelOn<Mem>, &mem, key, keyLen, expiration));
+}
+
+#endif
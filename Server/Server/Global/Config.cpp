@@ -3,6 +3,8 @@
 /************************************************************************/
 
 #include "Config.h"
+#include "Ini.h"
+#include "ThreadRegistry.h"
 
 Config g_Config ;
 
@@ -27,6 +29,7 @@ bool Config::Init(const CHAR* argv0)
 __ENTER_FUNCTION_EX
 
 	LoadLogConfig(argv0) ;
+	LoadThreadConfig( ) ;
 
 	return true ;
 
@@ -68,4 +71,24 @@ __ENTER_FUNCTION
 __LEAVE_FUNCTION
 }
 
+void Config::LoadThreadConfig( )
+{
+__ENTER_FUNCTION
+
+	Ini ini("GameConfig.ini");
+	CHAR szCores[128] = {0};
+	if( ini.ReadTextIfExist((CHAR*)"Thread", (CHAR*)"ServiceMgrCores", szCores, sizeof(szCores) - 1) )
+		ParseCpuList(szCores, m_ThreadConfig.m_ServiceMgrCores);
+
+	memset(szCores, 0, sizeof(szCores));
+	if( ini.ReadTextIfExist((CHAR*)"Thread", (CHAR*)"ConnectManagerCores", szCores, sizeof(szCores) - 1) )
+		ParseCpuList(szCores, m_ThreadConfig.m_ConnectManagerCores);
+	// ConnectManager is a single thread, a list would only lose all but one cpu
+	AssertEx(m_ThreadConfig.m_ConnectManagerCores.size() <= 1, "GameConfig.ini [Thread] ConnectManagerCores takes one cpu.");
 
+	ini.ReadIntIfExist((CHAR*)"Thread", (CHAR*)"DBIoThreads", m_ThreadConfig.m_DBIoThreads);
+	ini.ReadIntIfExist((CHAR*)"Thread", (CHAR*)"CacheIoThreads", m_ThreadConfig.m_CacheIoThreads);
+	ini.ReadIntIfExist((CHAR*)"Thread", (CHAR*)"PhaseTimeoutSec", m_ThreadConfig.m_PhaseTimeoutSec);
+
+__LEAVE_FUNCTION
+}
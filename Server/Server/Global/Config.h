@@ -22,6 +22,20 @@ struct LOG_CONFIG
 	}
 };
 
+// core map, GameConfig.ini [Thread]: ServiceMgrCores=2-7, ConnectManagerCores=1
+// empty list: threads are not pinned. ConnectManagerCores holds at most one cpu.
+// DBIoThreads / CacheIoThreads size the blocking io pools behind CoQuery and CoMemGet.
+// PhaseTimeoutSec: a service still in Init/Start/Load/... after that fails the phase.
+struct THREAD_CONFIG
+{
+	THREAD_CONFIG() : m_DBIoThreads(4), m_CacheIoThreads(2), m_PhaseTimeoutSec(300) {}
+
+	bstd::vector<int32_t>	m_ServiceMgrCores;
+	bstd::vector<int32_t>	m_ConnectManagerCores;
+	int32_t					m_DBIoThreads;
+	int32_t					m_CacheIoThreads;
+	int32_t					m_PhaseTimeoutSec;
+};
 
 
 class Config
@@ -33,9 +47,11 @@ public:
 	bool Init(const CHAR* argv0) ;
 	void ReLoad( ) ;
 	void LoadLogConfig(const CHAR* argv0) ;
+	void LoadThreadConfig( ) ;
 	
 public :
 	LOG_CONFIG			m_LogConfig ;
+	THREAD_CONFIG		m_ThreadConfig ;
 
 };
 
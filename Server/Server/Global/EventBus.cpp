@@ -0,0 +1,259 @@
+#include "EventBus.h"
+
+EventBus g_EventBus;
+
+//////////////////////////////////////////////////////////////////////////
+// filled by EVENTMSG_IMPL during static init, plain arrays so the order
+// against other translation units does not matter.
+#define MAX_EVENT_TOPIC	(256)
+static const CHAR*	s_TopicNames[MAX_EVENT_TOPIC];
+static int32_t		s_TopicCount;
+
+int32_t EventTopicRegister(const CHAR* szName)
+{
+	Assert(s_TopicCount < MAX_EVENT_TOPIC);
+	s_TopicNames[s_TopicCount] = szName;
+	return s_TopicCount++;
+}
+
+//////////////////////////////////////////////////////////////////////////
+void EventBatchMsg::Excute(EventMgr& rEvtMgr)
+{
+	int64_t latencyUs = TimeUtil::TickMicroseconds() - m_PublishUs;
+	for (int32_t i = -1; i < (int32_t)m_More.size(); i++)
+	{
+		Delivery& d = (i < 0) ? m_First : m_More[i];
+		if (!d.Ptr) continue;
+		g_EventBus.OnDelivered(d.Ptr->Topic(), latencyUs);
+		__ENTER_FUNCTION_EX
+			d.Ptr->Excute(*d.pTarget);
+		__LEAVE_FUNCTION_EX
+	}
+}
+
+void EventBatchMsg::Forget(EventMgr* pTarget)
+{
+	for (int32_t i = -1; i < (int32_t)m_More.size(); i++)
+	{
+		Delivery& d = (i < 0) ? m_First : m_More[i];
+		if (d.pTarget != pTarget) continue;
+		d.pTarget = NULL;
+		d.Ptr.reset();
+	}
+}
+
+void EventBatchMsg::Add(EventMgr* pTarget, const EventMsgPtr& Ptr)
+{
+	if (!m_First.Ptr && m_More.empty())
+	{
+		m_First.pTarget = pTarget;
+		m_First.Ptr = Ptr;
+		return;
+	}
+	Delivery d;
+	d.pTarget = pTarget;
+	d.Ptr = Ptr;
+	m_More.push_back(d);
+}
+
+//////////////////////////////////////////////////////////////////////////
+EventBus::EventBus() : m_LastStatUs(0)
+{
+}
+
+EventBus::~EventBus()
+{
+	for (int32_t i = 0; i < (int32_t)m_Topics.size(); i++)
+	{
+		SAFE_DELETE(m_Topics[i]);
+	}
+	m_Topics.clear();
+}
+
+bool EventBus::Init()
+{
+	__ENTER_FUNCTION
+		Assert(m_Topics.empty());
+	for (int32_t i = 0; i < s_TopicCount; i++)
+	{
+		m_Topics.push_back(new Topic());
+	}
+	m_LastStatUs = TimeUtil::TickMicroseconds();
+	return true;
+	__LEAVE_FUNCTION
+		return false;
+}
+
+EventBus::Topic* EventBus::GetTopic(int32_t topic)
+{
+	if (topic < 0 || topic >= (int32_t)m_Topics.size()) return NULL;
+	return m_Topics[topic];
+}
+
+EventBus::SubscriberListPtr EventBus::GetSubscribers(Topic* pTopic)
+{
+	AutoLock_T lock(pTopic->Lock);
+	return pTopic->Subscribers;
+}
+
+void EventBus::Subscribe(int32_t topic, EventMgr* pMgr)
+{
+	__ENTER_FUNCTION
+		Topic* pTopic = GetTopic(topic);
+	Assert(pTopic && pMgr);
+
+	AutoLock_T lock(pTopic->Lock);
+	boost::shared_ptr<bstd::vector<EventMgr*> > subs(pTopic->Subscribers
+		? new bstd::vector<EventMgr*>(*pTopic->Subscribers) : new bstd::vector<EventMgr*>());
+	if (std::find(subs->begin(), subs->end(), pMgr) != subs->end()) return;
+	subs->push_back(pMgr);
+	pTopic->Subscribers = subs;
+	__LEAVE_FUNCTION
+}
+
+void EventBus::Unsubscribe(int32_t topic, EventMgr* pMgr)
+{
+	__ENTER_FUNCTION
+		Topic* pTopic = GetTopic(topic);
+	if (pTopic == NULL) return;
+
+	SubscriberListPtr old;
+	{
+		AutoLock_T lock(pTopic->Lock);
+		old = pTopic->Subscribers;
+		if (!old || std::find(old->begin(), old->end(), pMgr) == old->end()) return;
+		boost::shared_ptr<bstd::vector<EventMgr*> > subs(new bstd::vector<EventMgr*>(*old));
+		subs->erase(std::remove(subs->begin(), subs->end(), pMgr), subs->end());
+		pTopic->Subscribers = subs;
+	}
+	// a Publish keeps the list it copied until its last push, so pMgr may
+	// still get events until nobody else holds the old one
+	while (!old.unique())
+	{
+		boost::this_thread::yield();
+	}
+	__LEAVE_FUNCTION
+}
+
+void EventBus::UnsubscribeAll(EventMgr* pMgr)
+{
+	for (int32_t i = 0; i < (int32_t)m_Topics.size(); i++)
+	{
+		Unsubscribe(i, pMgr);
+	}
+}
+
+int32_t EventBus::Publish(GUID_t sender, const EventMsgPtr& Ptr)
+{
+	__ENTER_FUNCTION
+		Assert(Ptr);
+	Topic* pTopic = GetTopic(Ptr->Topic());
+	AssertEx(pTopic, Ptr->Name());
+	Assert(!Ptr->m_bPosted__);
+	Ptr->m_bPosted__ = true;
+	Ptr->m_Sender__ = sender;
+	pTopic->Published.fetch_add(1, boost::memory_order_relaxed);
+
+	SubscriberListPtr subs = GetSubscribers(pTopic);
+	if (!subs) return 0;
+	int64_t nowUs = TimeUtil::TickMicroseconds();
+	int32_t n = (int32_t)subs->size();
+	for (int32_t i = 0; i < n; i++)
+	{
+		// a host is served with its first subscriber, the list is short
+		EventMgr* pHost = (*subs)[i]->GetBusHost();
+		int32_t j = 0;
+		while (j < i && (*subs)[j]->GetBusHost() != pHost) j++;
+		if (j < i) continue;
+
+		EventBatchMsgPtr batchPtr(new EventBatchMsg());
+		batchPtr->m_PublishUs = nowUs;
+		for (j = i; j < n; j++)
+		{
+			if ((*subs)[j]->GetBusHost() == pHost) batchPtr->Add((*subs)[j], Ptr);
+		}
+		pHost->AddEvent(sender, batchPtr);
+	}
+	return n;
+	__LEAVE_FUNCTION
+		return 0;
+}
+
+void EventBus::Publish(GUID_t sender, const bstd::vector<EventMsgPtr>& events)
+{
+	__ENTER_FUNCTION
+		int64_t nowUs = TimeUtil::TickMicroseconds();
+	// hosts are few, a linear search beats a map here
+	bstd::vector<std::pair<EventMgr*, EventBatchMsgPtr> > batches;
+	// held until the pushes are done, see Unsubscribe
+	bstd::vector<SubscriberListPtr> held;
+	for (int32_t i = 0; i < (int32_t)events.size(); i++)
+	{
+		const EventMsgPtr& Ptr = events[i];
+		Assert(Ptr);
+		Topic* pTopic = GetTopic(Ptr->Topic());
+		AssertEx(pTopic, Ptr->Name());
+		Assert(!Ptr->m_bPosted__);
+		Ptr->m_bPosted__ = true;
+		Ptr->m_Sender__ = sender;
+		pTopic->Published.fetch_add(1, boost::memory_order_relaxed);
+
+		SubscriberListPtr subs = GetSubscribers(pTopic);
+		if (!subs) continue;
+		held.push_back(subs);
+		for (int32_t s = 0; s < (int32_t)subs->size(); s++)
+		{
+			EventMgr* pMgr = (*subs)[s];
+			EventMgr* pHost = pMgr->GetBusHost();
+			int32_t b = 0;
+			while (b < (int32_t)batches.size() && batches[b].first != pHost) b++;
+			if (b == (int32_t)batches.size())
+			{
+				EventBatchMsgPtr batchPtr(new EventBatchMsg());
+				batchPtr->m_PublishUs = nowUs;
+				batches.push_back(std::make_pair(pHost, batchPtr));
+			}
+			batches[b].second->Add(pMgr, Ptr);
+		}
+	}
+
+	for (int32_t b = 0; b < (int32_t)batches.size(); b++)
+	{
+		batches[b].first->AddEvent(sender, batches[b].second);
+	}
+	__LEAVE_FUNCTION
+}
+
+void EventBus::OnDelivered(int32_t topic, int64_t latencyUs)
+{
+	Topic* pTopic = GetTopic(topic);
+	if (pTopic == NULL) return;
+	pTopic->Delivered.fetch_add(1, boost::memory_order_relaxed);
+	pTopic->LatencyUs.Record(latencyUs);
+}
+
+void EventBus::GetTopicStats(bstd::vector<EventTopicStat>& out)
+{
+	__ENTER_FUNCTION
+		out.clear();
+	AutoLock_T lock(m_StatLock);
+	int64_t nowUs = TimeUtil::TickMicroseconds();
+	double seconds = _MAX(nowUs - m_LastStatUs, (int64_t)1) / 1000000.0;
+	m_LastStatUs = nowUs;
+
+	out.resize(m_Topics.size());
+	for (int32_t i = 0; i < (int32_t)m_Topics.size(); i++)
+	{
+		Topic* pTopic = m_Topics[i];
+		EventTopicStat& stat = out[i];
+		SubscriberListPtr subs = GetSubscribers(pTopic);
+		stat.Name = s_TopicNames[i];
+		stat.Subscribers = subs ? (int32_t)subs->size() : 0;
+		stat.Published = pTopic->Published.load(boost::memory_order_relaxed);
+		stat.Delivered = pTopic->Delivered.load(boost::memory_order_relaxed);
+		stat.PublishRate = (float)((stat.Published - pTopic->LastPublished) / seconds);
+		pTopic->LastPublished = stat.Published;
+		pTopic->LatencyUs.GetSnapshot(stat.LatencyUs);
+	}
+	__LEAVE_FUNCTION
+}
@@ -0,0 +1,108 @@
+/************************************************************************/
+/*                                                                      */
+/************************************************************************/
+
+#ifndef __EVENT_BUS_H__
+#define __EVENT_BUS_H__
+
+#include "EventMgr.h"
+#include "Histogram.h"
+
+//////////////////////////////////////////////////////////////////////////
+// what a bus host finds in its mailbox: the events of one Publish for it
+// and its guests (see EventMgr::SetBusHost). an event is shared with every
+// other subscriber of its topic, so handlers must treat it as read-only.
+class EventBatchMsg : public EventMsg
+{
+public:
+	struct Delivery
+	{
+		EventMgr*		pTarget;
+		EventMsgPtr		Ptr;
+	};
+public:
+	EventBatchMsg() : m_PublishUs(0) { m_First.pTarget = NULL; }
+public:
+	virtual void Excute(EventMgr& rEvtMgr);
+	virtual const CHAR* Name() { return "EventBatchMsg"; }
+	virtual void Forget(EventMgr* pTarget);
+	// the first delivery is kept inline, a single one allocates nothing more.
+	void Add(EventMgr* pTarget, const EventMsgPtr& Ptr);
+	static void* operator new(size_t size)
+	{ return size == sizeof(EventBatchMsg) ? ThreadCache<sizeof(EventBatchMsg)>::Alloc() : ::operator new(size); }
+	static void operator delete(void* p, size_t size)
+	{ if (size == sizeof(EventBatchMsg)) ThreadCache<sizeof(EventBatchMsg)>::Free(p); else ::operator delete(p); }
+public:
+	int64_t						m_PublishUs;
+private:
+	Delivery					m_First;
+	bstd::vector<Delivery>		m_More;
+};
+typedef boost::intrusive_ptr<EventBatchMsg> EventBatchMsgPtr;
+
+struct EventTopicStat
+{
+	const CHAR*			Name;
+	int32_t				Subscribers;
+	int64_t				Published;		// events published on the topic
+	int64_t				Delivered;		// events handed to a subscriber's handler
+	float				PublishRate;	// per second since the previous GetTopicStats
+	Histogram::Snapshot	LatencyUs;		// Publish -> subscriber's Update
+};
+
+//////////////////////////////////////////////////////////////////////////
+// fan-out delivery by event type. an event class is a topic (EVENTMSG_IMPL
+// registers it), an EventMgr subscribes to the topics it handles and a
+// publisher posts once for all of them, one mailbox push per bus host.
+// subscriber lists are copied on write, so Publish only takes the topic
+// lock to copy one pointer. an EventMgr has to Unsubscribe before it is
+// destroyed; Unsubscribe returns once no Publish can still push to it.
+class EventBus
+{
+	typedef boost::shared_ptr<const bstd::vector<EventMgr*> > SubscriberListPtr;
+
+	struct Topic
+	{
+		Topic() : Published(0), Delivered(0), LastPublished(0) {}
+
+		MyLock					Lock;
+		SubscriberListPtr		Subscribers;
+		boost::atomic<int64_t>	Published;
+		boost::atomic<int64_t>	Delivered;
+		Histogram				LatencyUs;
+		int64_t					LastPublished;
+	};
+public:
+	EventBus();
+	~EventBus();
+public:
+	// after static init, every EVENTMSG_IMPL topic is known by then.
+	bool		Init();
+
+	template<class EventImpl>
+	void		Subscribe(EventMgr* pMgr)		{ Subscribe(EventImpl::s_Topic__, pMgr); }
+	template<class EventImpl>
+	void		Unsubscribe(EventMgr* pMgr)		{ Unsubscribe(EventImpl::s_Topic__, pMgr); }
+	void		Subscribe(int32_t topic, EventMgr* pMgr);
+	void		Unsubscribe(int32_t topic, EventMgr* pMgr);
+	void		UnsubscribeAll(EventMgr* pMgr);
+
+	// the event goes to every subscriber of its topic, returns how many.
+	int32_t		Publish(GUID_t sender, const EventMsgPtr& Ptr);
+	// each bus host gets all of its subscribers' events in one mailbox push.
+	void		Publish(GUID_t sender, const bstd::vector<EventMsgPtr>& events);
+
+	void		OnDelivered(int32_t topic, int64_t latencyUs);
+	void		GetTopicStats(bstd::vector<EventTopicStat>& out);
+private:
+	Topic*		GetTopic(int32_t topic);
+	SubscriberListPtr GetSubscribers(Topic* pTopic);
+private:
+	bstd::vector<Topic*>	m_Topics;
+	MyLock					m_StatLock;
+	int64_t					m_LastStatUs;
+};
+
+extern EventBus g_EventBus;
+
+#endif // __EVENT_BUS_H__
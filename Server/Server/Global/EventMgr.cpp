@@ -1,14 +1,38 @@
 #include "EventMgr.h"
 #include "LogDefine.h"
 
-EventMgr::EventMgr()
+EventMgr::EventMgr() : m_pDeferred(NULL), m_pRunning(NULL), m_pBusHost(this), m_Guests(0)
 {
 
 }
 
 EventMgr::~EventMgr()
 {
+	if (m_pBusHost != this)
+	{
+		m_pBusHost->Forget(this);
+		m_pBusHost->m_Guests--;
+	}
+	AssertSpecialEx(m_Guests == 0, "EventMgr destroyed before its bus guests");
 
+	Release(m_pDeferred);
+	m_pDeferred = NULL;
+	EventMsg* pMsg = NULL;
+	while ((pMsg = m_Mailbox.PopAll()) != NULL)
+	{
+		Release(pMsg);
+	}
+}
+
+// drops the references AddEvent left on a popped chain
+void EventMgr::Release(EventMsg* pMsg)
+{
+	while (pMsg != NULL)
+	{
+		EventMsg* pNext = pMsg->m_pNext__;
+		intrusive_ptr_release(pMsg);
+		pMsg = pNext;
+	}
 }
 
 bool EventMgr::Init()
@@ -19,10 +43,59 @@ bool EventMgr::Init()
 
 void EventMgr::Update(const TimeInfo& rTimeInfo)
 {
-	EventMsgPtr Ptr;
-	while ( m_listEventMsg.PopFront(Ptr))
+	// what Forget popped is older than anything still in the mailbox
+	EventMsg* pMsg = m_pDeferred;
+	m_pDeferred = NULL;
+	Run(pMsg);
+	Run(m_Mailbox.PopAll());
+}
+
+// the batch stays reachable in m_pRunning, a guest destroyed by a handler
+// is forgotten in the rest of it too.
+void EventMgr::Run(EventMsg* pMsg)
+{
+	m_pRunning = pMsg;
+	while (m_pRunning != NULL)
+	{
+		// takes over the reference AddEvent left in the mailbox
+		EventMsgPtr Ptr(m_pRunning, false);
+		m_pRunning = m_pRunning->m_pNext__;
+		Ptr->m_pNext__ = NULL;
+
+		__ENTER_FUNCTION_EX
+			Ptr->Excute(*this);
+		__LEAVE_FUNCTION_EX
+	}
+}
+
+void EventMgr::SetBusHost(EventMgr* pHost)
+{
+	__ENTER_FUNCTION
+		if (pHost == NULL) pHost = this;
+	Assert(m_pBusHost == this && m_Guests == 0);
+	Assert(pHost->m_pBusHost == pHost);
+	m_pBusHost = pHost;
+	if (pHost != this) pHost->m_Guests++;
+	__LEAVE_FUNCTION
+}
+
+// host side, on the invoker that updates both: the guest has unsubscribed,
+// so what is still addressed to it can only be in this mailbox by now.
+void EventMgr::Forget(EventMgr* pGuest)
+{
+	EventMsg* pTail = m_pDeferred;
+	while (pTail != NULL && pTail->m_pNext__ != NULL) pTail = pTail->m_pNext__;
+	EventMsg* pMsg = m_Mailbox.PopAll();
+	if (pTail != NULL) pTail->m_pNext__ = pMsg;
+	else m_pDeferred = pMsg;
+
+	for (pMsg = m_pDeferred; pMsg != NULL; pMsg = pMsg->m_pNext__)
+	{
+		pMsg->Forget(pGuest);
+	}
+	for (pMsg = m_pRunning; pMsg != NULL; pMsg = pMsg->m_pNext__)
 	{
-		Ptr->Excute(*this);
+		pMsg->Forget(pGuest);
 	}
 }
 
@@ -31,11 +104,12 @@ void EventMgr::AddEvent(GUID_t sender, EventMsgPtr Ptr)
 	__ENTER_FUNCTION
 
 	Assert(Ptr);
-	Assert(Ptr->m_refCounter__ == 0);
-	Ptr->m_refCounter__++;
+	Assert(!Ptr->m_bPosted__);
+	Ptr->m_bPosted__ = true;
 	Ptr->m_Sender__ = sender;
 
-	m_listEventMsg.PushBack(Ptr);
+	intrusive_ptr_add_ref(Ptr.get());
+	m_Mailbox.Push(Ptr.get());
 
 	__LEAVE_FUNCTION
 }
@@ -43,4 +117,86 @@ void EventMgr::AddEvent(GUID_t sender, EventMsgPtr Ptr)
 void EventMgr::Handle(EventMsg& rMsg)
 {
 	LOG_ERROR(ServerError, "[EventMsg]unhandled eventmsg:%s", rMsg.Name() );
-}
\ No newline at end of file
+}
+
+#ifdef EVENTMGR_BENCHMARK
+/* BENCH_PRODUCERS services post BENCH_EVENTS events each to one service,
+** which drains its inbox in a loop like its invoker would. "before" is the
+** old path: shared_ptr events from an ObjectPool and a TSList (one list lock
+** per push and per pop). "after" is EventMgr itself. */
+#define BENCH_PRODUCERS	(4)
+#define BENCH_EVENTS	(500000)
+
+struct BenchOldMsg
+{
+	GUID_t	m_Sender;
+	int32_t	m_Coin;
+	CHAR	m_Message[32];
+};
+
+static ObjectPool<BenchOldMsg, 32, 256> s_BenchOldPool;
+static TSList<boost::shared_ptr<BenchOldMsg> > s_BenchOldList;
+
+static void BenchOldProducer(GUID_t sender)
+{
+	for (int32_t i = 0; i < BENCH_EVENTS; i++)
+	{
+		boost::shared_ptr<BenchOldMsg> Ptr = s_BenchOldPool.NewObj();
+		Ptr->m_Sender = sender;
+		Ptr->m_Coin = i;
+		s_BenchOldList.PushBack(Ptr);
+	}
+}
+
+class BenchEventMgr : public EventMgr
+{
+public:
+	BenchEventMgr() : m_Handled(0) {}
+	virtual void Handle(JoinWolrd& rMsg) { m_Handled += rMsg.m_Coin >= 0 ? 1 : 0; }
+	int64_t m_Handled;
+};
+
+static void BenchNewProducer(BenchEventMgr* pMgr, GUID_t sender)
+{
+	for (int32_t i = 0; i < BENCH_EVENTS; i++)
+	{
+		JoinWolrdPtr Ptr = EVENTMSG_NEW(JoinWolrd);
+		Ptr->m_Coin = i;
+		pMgr->AddEvent(sender, Ptr);
+	}
+}
+
+void EventMgrBenchmark()
+{
+	const int64_t total = (int64_t)BENCH_PRODUCERS * BENCH_EVENTS;
+	// csv: impl,producers,events,seconds,events/s
+	{
+		int64_t start = TimeUtil::TickMicroseconds();
+		boost::thread_group producers;
+		for (int32_t i = 0; i < BENCH_PRODUCERS; i++)
+			producers.create_thread(boost::bind(&BenchOldProducer, (GUID_t)i));
+		int64_t handled = 0;
+		boost::shared_ptr<BenchOldMsg> Ptr;
+		while (handled < total)
+		{
+			while (s_BenchOldList.PopFront(Ptr)) handled += Ptr->m_Coin >= 0 ? 1 : 0;
+			Ptr.reset();
+		}
+		producers.join_all();
+		double seconds = (TimeUtil::TickMicroseconds() - start) / 1000000.0;
+		printf("objectpool+tslist,%d,%lld,%0.3f,%0.0f\n", BENCH_PRODUCERS, total, seconds, total / seconds);
+	}
+	{
+		BenchEventMgr mgr;
+		TimeInfo timeInfo;
+		int64_t start = TimeUtil::TickMicroseconds();
+		boost::thread_group producers;
+		for (int32_t i = 0; i < BENCH_PRODUCERS; i++)
+			producers.create_thread(boost::bind(&BenchNewProducer, &mgr, (GUID_t)i));
+		while (mgr.m_Handled < total) mgr.Update(timeInfo);
+		producers.join_all();
+		double seconds = (TimeUtil::TickMicroseconds() - start) / 1000000.0;
+		printf("mailbox+threadcache,%d,%lld,%0.3f,%0.0f\n", BENCH_PRODUCERS, total, seconds, total / seconds);
+	}
+}
+#endif
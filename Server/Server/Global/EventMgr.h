@@ -8,6 +8,8 @@
 
 #include "EventMsg.h"
 #include "EventMsg_Test.h"
+
+//#define EVENTMGR_BENCHMARK
 //////////////////////////////////////////////////////////////////////////
 // ĳԱ̵ֻ߳ãAddEvent⣩
 
@@ -21,13 +23,34 @@ public:
 	virtual ~EventMgr();
 public:
 	bool Init();
+	// handles what was posted before the call, events posted from a handler
+	// wait for the next Update.
 	virtual void Update(const TimeInfo& rTimeInfo);		
 	void AddEvent(GUID_t sender, EventMsgPtr Ptr);
 	virtual void Handle(EventMsg& rMsg);
+	// EventMgrs updated by one invoker share a host, one of them: EventBus
+	// makes a single push to the host's mailbox for all of them and the
+	// host's Update hands each event to its EventMgr. set before Subscribe;
+	// the host outlives its guests, a guest is destroyed on that invoker.
+	void SetBusHost(EventMgr* pHost);
+	EventMgr* GetBusHost() const { return m_pBusHost; }
+private:
+	void Forget(EventMgr* pGuest);
+	void Run(EventMsg* pMsg);
+	static void Release(EventMsg* pMsg);
 private:
-	TSList<EventMsgPtr>				m_listEventMsg;	
+	Mailbox<EventMsg>				m_Mailbox;	
+	EventMsg*						m_pDeferred;	// popped by Forget, first in the next Update
+	EventMsg*						m_pRunning;		// rest of the batch Update is on
+	EventMgr*						m_pBusHost;
+	int32_t							m_Guests;
 public:
 	VIRTULE_HANDLE(JoinWolrd);
 };
 
+#ifdef EVENTMGR_BENCHMARK
+// producers post to one EventMgr, old ObjectPool + TSList path against the mailbox.
+void EventMgrBenchmark();
+#endif
+
 #endif // __EVENT_MGR_H__
\ No newline at end of file
@@ -5,24 +5,54 @@
 #ifndef __EVENT_MSG_H__
 #define __EVENT_MSG_H__
 #include "BaseLib.h"
+#include "Mailbox.h"
+#include "ThreadCache.h"
+#include <boost/atomic.hpp>
+#include <boost/intrusive_ptr.hpp>
 
 class EventMgr;
 
-class EventMsg
+class EventMsg : public boost::noncopyable
 {
 public:
 	GUID_t	m_Sender__;
-	int32_t	m_refCounter__;
+	boost::atomic<int32_t>	m_refCounter__;
+	EventMsg*	m_pNext__;		// EventMgr mailbox link
+	bool	m_bPosted__;		// an event is handed to one EventMgr, once
 public:
-	EventMsg():m_Sender__(INVALID_GUID), m_refCounter__(0){}
+	EventMsg():m_Sender__(INVALID_GUID), m_refCounter__(0), m_pNext__(NULL), m_bPosted__(false){}
 	virtual ~EventMsg(){}
 public:
 	virtual void Excute(EventMgr& rEvtMgr) = 0;
 	virtual const CHAR* Name() { return "EventMsg"; }
+	// EventBus topic, -1 for events that are only sent directly
+	virtual int32_t Topic() const { return -1; }
+	// drop whatever this holds for @pTarget, which is going away.
+	virtual void Forget(EventMgr* pTarget) {}
 };
 
+// EVENTMSG_IMPL gives every event class a topic id at static init.
+int32_t EventTopicRegister(const CHAR* szName);
+
+inline void intrusive_ptr_add_ref(EventMsg* pMsg)
+{
+	pMsg->m_refCounter__.fetch_add(1, boost::memory_order_relaxed);
+}
+
+inline void intrusive_ptr_release(EventMsg* pMsg)
+{
+	if (pMsg->m_refCounter__.fetch_sub(1, boost::memory_order_release) == 1)
+	{
+		boost::atomic_thread_fence(boost::memory_order_acquire);
+		delete pMsg;
+	}
+}
+
 //////////////////////////////////////////////////////////////////////////
-typedef boost::shared_ptr<EventMsg> EventMsgPtr;
+// the count lives in the event, so a pointer is one word and no control
+// block is allocated. the memory comes from a per-thread ThreadCache of the
+// event's size, sender threads allocate and the receiving thread frees.
+typedef boost::intrusive_ptr<EventMsg> EventMsgPtr;
 
 #define EVENTMSG_DECL_START(EVMSG_IMPL)\
 class EVMSG_IMPL : public EventMsg\
@@ -30,14 +60,23 @@ class EVMSG_IMPL : public EventMsg\
 public:\
 	virtual void Excute(EventMgr& rEvtMgr);\
 	virtual const CHAR* Name() { return #EVMSG_IMPL; }\
+	virtual int32_t Topic() const { return s_Topic__; }\
+	static int32_t s_Topic__;\
+	static void* operator new(size_t size)\
+	{ return size == sizeof(EVMSG_IMPL) ? ThreadCache<sizeof(EVMSG_IMPL)>::Alloc() : ::operator new(size); }\
+	static void operator delete(void* p, size_t size)\
+	{ if (size == sizeof(EVMSG_IMPL)) ThreadCache<sizeof(EVMSG_IMPL)>::Free(p); else ::operator delete(p); }\
 public:\
 
 #define EVENTMSG_DECL_END(EVMSG_IMPL) };\
-	POOL_DECL(EVMSG_IMPL);
+	typedef boost::intrusive_ptr<EVMSG_IMPL> EVMSG_IMPL##Ptr;
 
 #define EVENTMSG_IMPL(EVMSG_IMPL)\
-	void EVMSG_IMPL:: Excute(EventMgr& rEvtMgr) { rEvtMgr.Handle(*this); }\
-	POOL_IMPL(EVMSG_IMPL);
+	int32_t EVMSG_IMPL::s_Topic__ = EventTopicRegister(#EVMSG_IMPL);\
+	void EVMSG_IMPL:: Excute(EventMgr& rEvtMgr) { rEvtMgr.Handle(*this); }
+
+#define EVENTMSG_NEW(EVMSG_IMPL)\
+	EVMSG_IMPL##Ptr(new EVMSG_IMPL())
 
 
 #endif
@@ -2,6 +2,7 @@
 
  
 #include "ConnectManager.h"
+#include "Config.h"
 
 ConnectManager* g_pConnectManager = NULL ;
 
@@ -15,6 +16,9 @@ __ENTER_FUNCTION
 		Assert( g_pLoginPlayerManager ) ;
 	}
 	m_Active = false ;
+	setName( "ConnectManager" ) ;
+	if( !g_Config.m_ThreadConfig.m_ConnectManagerCores.empty() )
+		setCpu( g_Config.m_ThreadConfig.m_ConnectManagerCores[0] ) ;
 
 __LEAVE_FUNCTION
 }
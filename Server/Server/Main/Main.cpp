@@ -4,12 +4,34 @@
 #include "Main.h"
 #include "Server.h"
 #include "CpuMemStat.h"
+#include "Executor.h"
+#include "FrameArena.h"
+#include "Container.h"
 //////////////////////////////////////////////////////////////////////////
 
 int32_t main(int32_t argc, CHAR* argv[])
 {	
 	__ENTER_FUNCTION
 
+#ifdef EXECUTOR_BENCHMARK
+	ExecutorBenchmark();
+	return 0;
+#endif
+
+#ifdef EVENTMGR_BENCHMARK
+	EventMgrBenchmark();
+	return 0;
+#endif
+
+#ifdef FRAMEARENA_BENCHMARK
+	FrameArenaBenchmark();
+	return 0;
+#endif
+
+#ifdef CONTAINER_BENCHMARK
+	ContainerBenchmark();
+	return 0;
+#endif
 
 	_MY_TRY
 	{
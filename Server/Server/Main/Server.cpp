@@ -1,5 +1,7 @@
 #include "Server.h"
 #include "LoginService.h"
+#include "AsyncIo.h"
+#include "EventBus.h"
 
 //////////////////////////////////////////////////////////////////////////
 Server g_Server;
@@ -32,7 +34,13 @@ void Server::Init_AllTask()
 
 
 	//////////////////////////////////////////////////////////////////////////
-	bool bRet = m_MainServiceManager.Init(ServiceDefine::MAX, g_Config.m_LogConfig.m_ThreadNum);
+	bool bRet = g_EventBus.Init();
+	Assert(bRet);
+
+	bRet = AsyncIo::Init(g_Config.m_ThreadConfig.m_DBIoThreads, g_Config.m_ThreadConfig.m_CacheIoThreads);
+	Assert(bRet);
+
+	bRet = m_MainServiceManager.Init(ServiceDefine::MAX, g_Config.m_LogConfig.m_ThreadNum);
 	Assert(bRet);
 
 	m_MainServiceManager.Register(ServicePtr(new LoginService));
@@ -51,5 +59,6 @@ void Server::Exit()
 {
 	__ENTER_FUNCTION
 		m_MainServiceManager.Exit();
+	AsyncIo::Exit();
 	__LEAVE_FUNCTION
 }
@@ -23,6 +23,7 @@ public:
 	bool Init();
 	void Loop();
 	void Exit();
+	ServiceMgr& GetServiceMgr() { return m_MainServiceManager; }
 private:
 	void Init_AllTask();
 private:
@@ -3,8 +3,8 @@
 
 #include "Packet.h"
 
-Packet::Packet(PBMessage& msg, const CHAR* name)
-: m_rMsg(msg), m_PacketId(MyCRC(name))
+Packet::Packet(PBMessage& msg, PacketID_t id)
+: m_rMsg(msg), m_PacketId(id)
 {
 
 
@@ -39,7 +39,7 @@ class Packet
 public:
 	#define ref_msg GetRefMsg()
 public :
-	Packet(PBMessage& msg, const CHAR* name);
+	Packet(PBMessage& msg, PacketID_t id);
 	virtual ~Packet( );
 public:
 	PBMessage&			GetRefMsg()				{ return m_rMsg; }
@@ -58,7 +58,7 @@ template<class MsgType>
 class PacketWrapper : public Packet
 {
 public: 
-	PacketWrapper<MsgType>(const CHAR* name) : Packet(m_Msg, name){}
+	PacketWrapper<MsgType>(PacketID_t id) : Packet(m_Msg, id){}
 
 public:
 	MsgType& GetMsg() { return m_Msg; }
@@ -70,11 +70,12 @@ private:
 	MsgType m_Msg;
 };
 
+// the packet id of MSGTYPE is its PACKET_DEFINE entry, PACKET_##MSGTYPE
 #define PACKET_DECL(MSGTYPE)\
 class MSGTYPE##_PAK : public PacketWrapper<MSGTYPE>\
 {\
 public:\
-	explicit MSGTYPE##_PAK(): PacketWrapper<MSGTYPE>(#MSGTYPE){}\
+	explicit MSGTYPE##_PAK(): PacketWrapper<MSGTYPE>(Packets::PACKET_##MSGTYPE){}\
 	Packet* Clone() { return new MSGTYPE##_PAK(); }\
 };
 
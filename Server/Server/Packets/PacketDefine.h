@@ -12,6 +12,7 @@ namespace Packets
 	enum PACKET_DEFINE
 	{
 		PACKET_CL_ASKCHARLIST = 450,									//ͻLogin¼
+		PACKET_CG_LOGIN,												//client login, CG_LOGIN
 		PACKET_MAX													//Ϣ͵ֵ
 	};
 };
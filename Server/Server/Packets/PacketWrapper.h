@@ -6,6 +6,7 @@
 
 #include "PBMessage.pb.h"
 #include "Packet.h"
+#include "PacketDefine.h"
 
 namespace Packets
 {
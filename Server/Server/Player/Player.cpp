@@ -9,6 +9,7 @@ Player::Player( bool bIsServer )
 //:m_Role(*this)
 : m_SocketInputStream(m_Socket) 
 ,m_SocketOutputStream(m_Socket)
+,m_nManagerIndex(-1)
 {
 __ENTER_FUNCTION
 
@@ -40,6 +40,11 @@ public :
 
 	//ǰݺͻ
 	virtual	void			CleanUp( ) ;
+
+	// slot in the PlayerManager holding this player, -1 when in none.
+	// only the manager sets it.
+	int32_t			GetManagerIndex( ) const{ return m_nManagerIndex ; }
+	void			SetManagerIndex( int32_t nIndex ){ m_nManagerIndex = nIndex ; }
 protected :
 	//Role					m_Role;
 	//Ӿ
@@ -48,6 +53,8 @@ protected :
 	//ݻ
 	SocketInputStream		m_SocketInputStream ;
 	SocketOutputStream		m_SocketOutputStream ;
+
+	int32_t					m_nManagerIndex ;
 public:
 	virtual uint32_t HandlePacket(const PBMessage& rMsg) { return 0; };
 	virtual uint32_t HandlePacket(const CG_LOGIN& rMsg);
@@ -7,9 +7,6 @@ PlayerManager::PlayerManager( )
 {
 __ENTER_FUNCTION
 
-	m_nPlayers = 0 ;
-	m_PlayerPtrList.Clear();
-
 __LEAVE_FUNCTION
 }
 
@@ -26,8 +23,12 @@ void PlayerManager::CleanUp( )
 {
 __ENTER_FUNCTION
 
-	m_nPlayers = 0 ;
-	m_PlayerPtrList.Clear();
+	for( int32_t i = 0; i < (int32_t)m_Players.size(); i++ )
+	{
+		m_Players[i]->SetManagerIndex( -1 ) ;
+	}
+	m_Players.clear();
+	m_Visit.clear();
 
 __LEAVE_FUNCTION
 }
@@ -37,8 +38,11 @@ bool PlayerManager::AddPlayer( PlayerPtr Ptr )
 __ENTER_FUNCTION
 
 	Assert( Ptr ) ;
+	Assert( Ptr->GetManagerIndex() < 0 ) ;
+	if( Ptr->GetManagerIndex() >= 0 ) return false ;
 
-	m_PlayerPtrList.PushBack(Ptr);
+	Ptr->SetManagerIndex( (int32_t)m_Players.size() ) ;
+	m_Players.push_back(Ptr);
 	OnAddPlayer(Ptr, 0);
 	return true ;
 	
@@ -53,17 +57,33 @@ void PlayerManager::RemovePlayer( PlayerPtr Ptr, int32_t reason )
 __ENTER_FUNCTION
 
 	Assert( Ptr ) ;
-	PlayerPtrList::TListIterator iter = std::remove(m_PlayerPtrList.Begin(), m_PlayerPtrList.End(), Ptr);
-	if( iter != m_PlayerPtrList.End()) OnRemovePlayer(Ptr, reason);
+	int32_t nIndex = Ptr->GetManagerIndex() ;
+	if( !IsManaged( Ptr ) ) return ;
+
+	// the last player takes the hole
+	if( nIndex != (int32_t)m_Players.size() - 1 )
+	{
+		m_Players[nIndex] = m_Players.back() ;
+		m_Players[nIndex]->SetManagerIndex( nIndex ) ;
+	}
+	m_Players.pop_back() ;
+	Ptr->SetManagerIndex( -1 ) ;
+	OnRemovePlayer(Ptr, reason);
 	
 __LEAVE_FUNCTION
 }
 
+bool PlayerManager::IsManaged( const PlayerPtr& Ptr ) const
+{
+	int32_t nIndex = Ptr->GetManagerIndex() ;
+	return nIndex >= 0 && nIndex < (int32_t)m_Players.size() && m_Players[nIndex] == Ptr ;
+}
+
 bool PlayerManager::Select( )
 {
 	__ENTER_FUNCTION
 
-	if( m_PlayerPtrList.Empty()) return true;
+	if( m_Players.empty()) return true;
 
 	FD_ZERO(&m_ReadFDs);
 	FD_ZERO(&m_WriteFDs);
@@ -71,10 +91,9 @@ bool PlayerManager::Select( )
 
 	int32_t		maxFD = INVALID_SOCKET;
 
-	PlayerPtr Ptr;
-	m_PlayerPtrList.ResetIterator();
-	while (m_PlayerPtrList.PeekNext(Ptr))
+	for( int32_t i = (int32_t)m_Players.size() - 1; i >= 0; i-- )
 	{
+		PlayerPtr& Ptr = m_Players[i];
 		Assert(Ptr);
 		SOCKET sock = Ptr->GetSocket().getSOCKET();
 		Assert(sock != INVALID_SOCKET);
@@ -109,13 +128,14 @@ bool PlayerManager::ProcessInputs( )
 {
 	__ENTER_FUNCTION
 
-	if( m_PlayerPtrList.Empty()) return true;
+	if( m_Players.empty()) return true;
 
-	PlayerPtr Ptr;
-	m_PlayerPtrList.ResetIterator();
-	while (m_PlayerPtrList.PeekNext(Ptr))
+	m_Visit = m_Players;
+	for( int32_t i = 0; i < (int32_t)m_Visit.size(); i++ )
 	{
-		Assert(Ptr);
+		PlayerPtr Ptr = m_Visit[i];
+		// removed by a handler earlier in this loop
+		if( !IsManaged( Ptr ) ) continue;
 		SOCKET sock = Ptr->GetSocket().getSOCKET();
 		Assert(sock != INVALID_SOCKET);
 
@@ -141,6 +161,7 @@ bool PlayerManager::ProcessInputs( )
 			}
 		}
 	}
+	m_Visit.clear();
 
 	return true ;
 
@@ -153,13 +174,14 @@ bool PlayerManager::ProcessOutputs( )
 {
 	__ENTER_FUNCTION
 
-	if( m_PlayerPtrList.Empty()) return true;
+	if( m_Players.empty()) return true;
 
-	PlayerPtr Ptr;
-	m_PlayerPtrList.ResetIterator();
-	while (m_PlayerPtrList.PeekNext(Ptr))
+	m_Visit = m_Players;
+	for( int32_t i = 0; i < (int32_t)m_Visit.size(); i++ )
 	{
-		Assert(Ptr);
+		PlayerPtr Ptr = m_Visit[i];
+		// removed by a handler earlier in this loop
+		if( !IsManaged( Ptr ) ) continue;
 		SOCKET sock = Ptr->GetSocket().getSOCKET();
 		Assert(sock != INVALID_SOCKET);
 
@@ -185,6 +207,7 @@ bool PlayerManager::ProcessOutputs( )
 			}
 		}
 	}
+	m_Visit.clear();
 
 	return true ;
 
@@ -198,13 +221,14 @@ bool PlayerManager::ProcessExceptions( )
 	__ENTER_FUNCTION
 
 
-	if( m_PlayerPtrList.Empty()) return true;
+	if( m_Players.empty()) return true;
 
-	PlayerPtr Ptr;
-	m_PlayerPtrList.ResetIterator();
-	while (m_PlayerPtrList.PeekNext(Ptr))
+	m_Visit = m_Players;
+	for( int32_t i = 0; i < (int32_t)m_Visit.size(); i++ )
 	{
-		Assert(Ptr);
+		PlayerPtr Ptr = m_Visit[i];
+		// removed by a handler earlier in this loop
+		if( !IsManaged( Ptr ) ) continue;
 		SOCKET sock = Ptr->GetSocket().getSOCKET();
 		Assert(sock != INVALID_SOCKET);
 
@@ -213,6 +237,7 @@ bool PlayerManager::ProcessExceptions( )
 			RemovePlayer( Ptr ) ;
 		}
 	}
+	m_Visit.clear();
 
 	return true ;
 
@@ -225,13 +250,14 @@ bool PlayerManager::ProcessCommands( )
 {
 	__ENTER_FUNCTION
 
-	if( m_PlayerPtrList.Empty()) return true;
+	if( m_Players.empty()) return true;
 
-	PlayerPtr Ptr;
-	m_PlayerPtrList.ResetIterator();
-	while (m_PlayerPtrList.PeekNext(Ptr))
+	m_Visit = m_Players;
+	for( int32_t i = 0; i < (int32_t)m_Visit.size(); i++ )
 	{
-		Assert(Ptr);
+		PlayerPtr Ptr = m_Visit[i];
+		// removed by a handler earlier in this loop
+		if( !IsManaged( Ptr ) ) continue;
 		SOCKET sock = Ptr->GetSocket().getSOCKET();
 		Assert(sock != INVALID_SOCKET);
 
@@ -254,6 +280,7 @@ bool PlayerManager::ProcessCommands( )
 			}
 		}
 	}
+	m_Visit.clear();
 
 	return true ;
 
@@ -38,17 +38,22 @@ public :
 	void				RemovePlayer( PlayerPtr Ptr, int32_t reason = -1 ) ;
 	virtual void		OnRemovePlayer(PlayerPtr ptr, int32_t reason) {}
 public:
-	uint32_t			GetPlayerNumber( ){ return m_nPlayers ; } ;
-	bool				HasPlayer( ){ return m_nPlayers > 0 ; } ;
+	uint32_t			GetPlayerNumber( ){ return (uint32_t)m_Players.size() ; } ;
+	bool				HasPlayer( ){ return !m_Players.empty() ; } ;
 protected :
+	// the players in slots 0..size-1, no holes. a player knows its slot
+	// (Player::GetManagerIndex), RemovePlayer moves the last one into it.
+	// the Process* loops walk m_Visit, a copy taken before the loop, so a
+	// handler removing any player moves nobody in the walk; the removed
+	// ones are skipped and players added meanwhile wait for the next tick.
+	bool		IsManaged( const PlayerPtr& Ptr ) const ;
 
 	fd_set		m_ReadFDs;
 	fd_set		m_WriteFDs;
 	fd_set		m_ExceptFDs;
 
-	//
-	PlayerPtrList	m_PlayerPtrList;
-	uint32_t		m_nPlayers ;
+	bstd::vector<PlayerPtr>	m_Players;
+	bstd::vector<PlayerPtr>	m_Visit;
 };
 
 
@@ -1,15 +1,20 @@
 
 
 #include "PlayerPacketMgr.h"
+#include "LogDefine.h"
+#include "Timer.h"
+
+boost::atomic<int64_t> PlayerNetCmdMgr::s_NextGeneration(0);
 
 
 //-----------------------------------------------------------------------------
 // construct
 //-----------------------------------------------------------------------------
 PlayerNetCmdMgr::PlayerNetCmdMgr()
+: m_Generation(s_NextGeneration.fetch_add(1, boost::memory_order_relaxed) + 1)
 {
-	m_mapRecvProc.Clear();
-	m_mapSendProc.Clear();
+	memset(m_RecvProc, 0, sizeof(m_RecvProc));
+	memset(m_SendProc, 0, sizeof(m_SendProc));
 }
 
 //-----------------------------------------------------------------------------
@@ -18,6 +23,13 @@ PlayerNetCmdMgr::PlayerNetCmdMgr()
 PlayerNetCmdMgr::~PlayerNetCmdMgr()
 {
 	Destroy();
+
+	// other threads may still point at theirs until now
+	for( int32_t i = 0; i < (int32_t)m_ThreadStats.size(); i++ )
+	{
+		SAFE_DELETE(m_ThreadStats[i]);
+	}
+	m_ThreadStats.clear();
 }
 
 //-----------------------------------------------------------------------------
@@ -25,6 +37,7 @@ PlayerNetCmdMgr::~PlayerNetCmdMgr()
 //-----------------------------------------------------------------------------
 void PlayerNetCmdMgr::Destroy()
 {
+	UnRegisterAll();
 }
 
 //-----------------------------------------------------------------------------
@@ -32,60 +45,52 @@ void PlayerNetCmdMgr::Destroy()
 //-----------------------------------------------------------------------------
 void PlayerNetCmdMgr::LogAllMsg()
 {
-	tagPlayerCmd* pCmd = NULL;
-
-/*	
-	m_pLog->Write(_T("\r\n\r\n"));
+	PlayerCmdStat stat;
 
-	// ȴӡеĿͻϢ
-	m_pLog->Write(_T("Client Msg Statistics:\r\n"));
-
-	m_mapRecvProc.ResetIterator();
-	while( m_mapRecvProc.PeekNext(pCmd) )
+	// csv: dir,cmd,times,bytes,us
+	for( uint32_t i = 0; i < Packets::PACKET_MAX; i++ )
 	{
-		m_pLog->Write(_T("%s\t\t%u\r\n"), m_pUtil->Unicode8ToUnicode(pCmd->strCmd.c_str()), pCmd->nTimes);
+		if( !m_RecvProc[i] ) continue;
+		GetRecvCmdStat(i, stat);
+		LOG_DEBUG(ServerDebug, "recv,%s,%lld,%lld,%lld", m_RecvProc[i]->strCmd.c_str(),
+			stat.nTimes, stat.nBytes, stat.nTimeUs);
 	}
-	m_pLog->Write(_T("\r\n\r\n"));
-
-	// ٴӡ˵Ϣ
-	m_pLog->Write(_T("Server Msg Statistics:\r\n"));
 
-	m_mapSendProc.ResetIterator();
-	while( m_mapSendProc.PeekNext(pCmd) )
+	for( uint32_t i = 0; i < Packets::PACKET_MAX; i++ )
 	{
-		m_pLog->Write(_T("%s\t\t%u\r\n"), m_pUtil->Unicode8ToUnicode(pCmd->strCmd.c_str()), pCmd->nTimes);
+		if( !m_SendProc[i] ) continue;
+		GetSendCmdStat(i, stat);
+		LOG_DEBUG(ServerDebug, "send,%s,%lld,%lld,0", m_SendProc[i]->strCmd.c_str(),
+			stat.nTimes, stat.nBytes);
 	}
-	m_pLog->Write(_T("\r\n\r\n"));
-*/
 }
 
 //-----------------------------------------------------------------------------
 // עϢ
 //-----------------------------------------------------------------------------
-bool PlayerNetCmdMgr::RegisterRecvProc(const CHAR* szCmd, NETMSGHANDLER fp, const CHAR* szDesc, uint32_t dwSize)
+bool PlayerNetCmdMgr::RegisterRecvProc(uint32_t dwID, const CHAR* szCmd, NETMSGHANDLER fp, const CHAR* szDesc, uint32_t dwSize)
 {
-	uint32_t dwID = MyCRC(szCmd);
+	Assert(dwID < Packets::PACKET_MAX);
+	if( dwID >= Packets::PACKET_MAX ) return false;
 
-	tagPlayerCmd* pCmd = NULL;
-	m_mapRecvProc.Peek(dwID, pCmd);
+	tagPlayerCmd* pCmd = m_RecvProc[dwID];
 
 	if( pCmd )
 	{
 		if( pCmd->strCmd != szCmd )
 		{
-			Assert(0);	// ӵͬCRC
+			Assert(0);	// ӵͬID
 			return false;
 		}
 	}
 	else
 	{
 		pCmd = new tagPlayerCmd;
-		pCmd->nTimes = 0;
 		pCmd->dwSize = dwSize;
 		pCmd->handler = fp;
 		pCmd->strCmd = szCmd;
 		pCmd->strDesc = szDesc;
-		m_mapRecvProc.Add(dwID, pCmd);
+		m_RecvProc[dwID] = pCmd;
 	}
 
 	return true;
@@ -94,13 +99,12 @@ bool PlayerNetCmdMgr::RegisterRecvProc(const CHAR* szCmd, NETMSGHANDLER fp, cons
 //------------------------------------------------------------------------------
 // עᷢϢ
 //------------------------------------------------------------------------------
-bool PlayerNetCmdMgr::RegisterSendProc(LPCSTR szCmd)
+bool PlayerNetCmdMgr::RegisterSendProc(uint32_t dwID, LPCSTR szCmd)
 {
-	uint32_t dwID = MyCRC(szCmd);
+	Assert(dwID < Packets::PACKET_MAX);
+	if( dwID >= Packets::PACKET_MAX ) return false;
 
-	tagPlayerCmd* pCmd = NULL;
-	
-	m_mapSendProc.Peek(dwID, pCmd);
+	tagPlayerCmd* pCmd = m_SendProc[dwID];
 
 	if( pCmd )
 	{
@@ -113,11 +117,10 @@ bool PlayerNetCmdMgr::RegisterSendProc(LPCSTR szCmd)
 	else
 	{
 		pCmd = new tagPlayerCmd;
-		pCmd->nTimes = 0;
 		pCmd->dwSize = 0;
 		pCmd->handler = NULL;
 		pCmd->strCmd = szCmd;
-		m_mapSendProc.Add(dwID, pCmd);
+		m_SendProc[dwID] = pCmd;
 	}
 
 	return true;
@@ -128,21 +131,11 @@ bool PlayerNetCmdMgr::RegisterSendProc(LPCSTR szCmd)
 //------------------------------------------------------------------------------
 void PlayerNetCmdMgr::UnRegisterAll()
 {
-	tagPlayerCmd* pCmd = NULL;
-
-	m_mapRecvProc.ResetIterator();
-	while( m_mapRecvProc.PeekNext(pCmd) )
-	{
-		SAFE_DELETE(pCmd);
-	}
-	m_mapRecvProc.Clear();
-
-	m_mapSendProc.ResetIterator();
-	while( m_mapSendProc.PeekNext(pCmd) )
+	for( uint32_t i = 0; i < Packets::PACKET_MAX; i++ )
 	{
-		SAFE_DELETE(pCmd);
+		SAFE_DELETE(m_RecvProc[i]);
+		SAFE_DELETE(m_SendProc[i]);
 	}
-	m_mapSendProc.Clear();
 }
 
 //------------------------------------------------------------------------------
@@ -150,9 +143,8 @@ void PlayerNetCmdMgr::UnRegisterAll()
 //------------------------------------------------------------------------------
 NETMSGHANDLER PlayerNetCmdMgr::GetHandler(Packet* pMsg, uint32_t nMsgSize)
 {
-	tagPlayerCmd* pCmd = NULL;
-	
-	m_mapRecvProc.Peek(pMsg->GetPacketID(), pCmd);
+	uint32_t dwID = pMsg->GetPacketID();
+	tagPlayerCmd* pCmd = dwID < Packets::PACKET_MAX ? m_RecvProc[dwID] : NULL;
 	if( !pCmd )
 	{
 		//IMSG(_T("Unknow player command recved[<cmdid>%u <size>%d]\r\n"), pMsg->dwID, nMsgSize);
@@ -166,8 +158,6 @@ NETMSGHANDLER PlayerNetCmdMgr::GetHandler(Packet* pMsg, uint32_t nMsgSize)
 	}
 */
 
-	InterlockedExchangeAdd((LPLONG)&pCmd->nTimes, 1);
-
 	return pCmd->handler;
 }
 
@@ -180,7 +170,11 @@ bool PlayerNetCmdMgr::HandleCmd(Packet* pMsg, uint32_t nMsgSize)
 	NETMSGHANDLER fp = GetHandler(pMsg, nMsgSize);
 	if( NULL == fp ) return false;
 
+	// the handler may release or reuse the packet
+	uint32_t dwID = pMsg->GetPacketID();
+	int64_t nStartUs = TimeUtil::TickMicroseconds();
 	fp(pMsg);
+	Count(LocalStat().Recv[dwID], nMsgSize, TimeUtil::TickMicroseconds() - nStartUs);
 
 	return true;
 }
@@ -188,14 +182,11 @@ bool PlayerNetCmdMgr::HandleCmd(Packet* pMsg, uint32_t nMsgSize)
 //-------------------------------------------------------------------------------------------
 // ˵ķ
 //-------------------------------------------------------------------------------------------
-void PlayerNetCmdMgr::CountServerMsg(uint32_t dwMsgID)
+void PlayerNetCmdMgr::CountServerMsg(uint32_t dwMsgID, uint32_t nMsgSize)
 {
-	tagPlayerCmd* pCmd = NULL;
-	m_mapSendProc.Peek(dwMsgID, pCmd);
-
-	if( pCmd )
+	if( dwMsgID < Packets::PACKET_MAX && m_SendProc[dwMsgID] )
 	{
-		InterlockedExchangeAdd((LPLONG)&pCmd->nTimes, 1);
+		Count(LocalStat().Send[dwMsgID], nMsgSize, 0);
 	}
 }
 
@@ -204,13 +195,71 @@ void PlayerNetCmdMgr::CountServerMsg(uint32_t dwMsgID)
 //-------------------------------------------------------------------------------------------
 uint32_t PlayerNetCmdMgr::GetRecvCmdRunTimes( uint32_t dwMsgID )
 {
-	tagPlayerCmd* pCmd = NULL;
-	m_mapSendProc.Peek(dwMsgID, pCmd);
+	PlayerCmdStat stat;
+	GetRecvCmdStat(dwMsgID, stat);
+	return (uint32_t)stat.nTimes;
+}
+
+//-------------------------------------------------------------------------------------------
+// the counters of one cmd over all threads; a thread's counts may be a
+// cmd behind, the sum is not a snapshot.
+//-------------------------------------------------------------------------------------------
+void PlayerNetCmdMgr::GetRecvCmdStat(uint32_t dwMsgID, PlayerCmdStat& out)
+{
+	out = PlayerCmdStat();
+	if( dwMsgID >= Packets::PACKET_MAX ) return;
 
-	if (pCmd)
+	AutoLock_T lock(m_StatLock);
+	for( int32_t i = 0; i < (int32_t)m_ThreadStats.size(); i++ )
 	{
-		return pCmd->nTimes;
+		Merge(m_ThreadStats[i]->Recv[dwMsgID], out);
 	}
+}
+
+void PlayerNetCmdMgr::GetSendCmdStat(uint32_t dwMsgID, PlayerCmdStat& out)
+{
+	out = PlayerCmdStat();
+	if( dwMsgID >= Packets::PACKET_MAX ) return;
+
+	AutoLock_T lock(m_StatLock);
+	for( int32_t i = 0; i < (int32_t)m_ThreadStats.size(); i++ )
+	{
+		Merge(m_ThreadStats[i]->Send[dwMsgID], out);
+	}
+}
+
+//-------------------------------------------------------------------------------------------
+// the calling thread's counters, created on its first cmd
+//-------------------------------------------------------------------------------------------
+PlayerNetCmdMgr::ThreadStat& PlayerNetCmdMgr::LocalStat()
+{
+	StatBinding* pBinding = m_LocalStat.get();
+	if( pBinding == NULL || pBinding->nGeneration != m_Generation )
+	{
+		ThreadStat* pStat = new ThreadStat;
+		{
+			AutoLock_T lock(m_StatLock);
+			m_ThreadStats.push_back(pStat);
+		}
+		pBinding = new StatBinding;
+		pBinding->nGeneration = m_Generation;
+		pBinding->pStat = pStat;
+		m_LocalStat.reset(pBinding);
+	}
+	return *pBinding->pStat;
+}
 
-	return 0;
+// a load and a store, no locked add: no other thread writes this counter
+void PlayerNetCmdMgr::Count(Counter& c, uint32_t nBytes, int64_t nTimeUs)
+{
+	c.nTimes.store(c.nTimes.load(boost::memory_order_relaxed) + 1, boost::memory_order_relaxed);
+	c.nBytes.store(c.nBytes.load(boost::memory_order_relaxed) + nBytes, boost::memory_order_relaxed);
+	c.nTimeUs.store(c.nTimeUs.load(boost::memory_order_relaxed) + nTimeUs, boost::memory_order_relaxed);
+}
+
+void PlayerNetCmdMgr::Merge(const Counter& c, PlayerCmdStat& out)
+{
+	out.nTimes += c.nTimes.load(boost::memory_order_relaxed);
+	out.nBytes += c.nBytes.load(boost::memory_order_relaxed);
+	out.nTimeUs += c.nTimeUs.load(boost::memory_order_relaxed);
 }
@@ -3,9 +3,35 @@
 
 #include "BaseLib.h"
 #include "Packet.h"
+#include "PacketDefine.h"
+#include <boost/atomic.hpp>
+#include <boost/thread/tss.hpp>
 
 typedef fastdelegate::FastDelegate1<Packet*, uint32_t> NETMSGHANDLER;
 
+// PACKET_DEFINE id of a packet name, a name without a PACKET_XX_YYYY entry
+// does not compile.
+template<uint32_t ID>
+struct PlayerCmdID
+{
+	BOOST_STATIC_ASSERT(ID < Packets::PACKET_MAX);
+	enum { value = ID };
+};
+
+#define REGISTER_PLAYER_RECV(mgr, NAME, fp, desc, size)\
+	(mgr).RegisterRecvProc(PlayerCmdID<Packets::PACKET_##NAME>::value, #NAME, fp, desc, size)
+#define REGISTER_PLAYER_SEND(mgr, NAME)\
+	(mgr).RegisterSendProc(PlayerCmdID<Packets::PACKET_##NAME>::value, #NAME)
+
+struct PlayerCmdStat
+{
+	PlayerCmdStat() : nTimes(0), nBytes(0), nTimeUs(0) {}
+
+	int64_t		nTimes;
+	int64_t		nBytes;
+	int64_t		nTimeUs;		// in the handler, recv only
+};
+
 //-----------------------------------------------------------------------------
 // ͻ
 //-----------------------------------------------------------------------------
@@ -19,17 +45,20 @@ public:
 	void Destroy();
 	void LogAllMsg();
 
-	bool RegisterRecvProc(const CHAR* szCmd, NETMSGHANDLER fp, const CHAR* szDesc, uint32_t dwSize);
-	bool RegisterSendProc(LPCSTR szCmd);
+	bool RegisterRecvProc(uint32_t dwID, const CHAR* szCmd, NETMSGHANDLER fp, const CHAR* szDesc, uint32_t dwSize);
+	bool RegisterSendProc(uint32_t dwID, LPCSTR szCmd);
 	void UnRegisterAll();
 
 	NETMSGHANDLER GetHandler(Packet* pMsg, uint32_t nMsgSize);
-	void CountServerMsg(uint32_t dwMsgID);
+	void CountServerMsg(uint32_t dwMsgID, uint32_t nMsgSize = 0);
 
 	bool HandleCmd(Packet* pMsg, uint32_t nMsgSize);
 
 	// ȡϢִд
 	uint32_t GetRecvCmdRunTimes(uint32_t dwMsgID);
+	// the counters of every thread added up
+	void GetRecvCmdStat(uint32_t dwMsgID, PlayerCmdStat& out);
+	void GetSendCmdStat(uint32_t dwMsgID, PlayerCmdStat& out);
 protected:
 	typedef struct tagPlayerCmd
 	{
@@ -37,11 +66,47 @@ protected:
 		bstd::string			strDesc;		// 
 		uint32_t				dwSize;			// ϢС
 		NETMSGHANDLER			handler;		// ָ
-		volatile uint32_t		nTimes;			// Ĵ
 	} tagPlayerCmd;
 
-	TMap<uint32_t, tagPlayerCmd*>	m_mapRecvProc;	// ϢĴͳ
-	TMap<uint32_t, tagPlayerCmd*>	m_mapSendProc;	// ϢĴͳ
+	// one thread's counters: only that thread writes them, with plain
+	// stores, readers add up all threads. kept until the manager goes, a
+	// thread that exits still counts.
+	struct Counter
+	{
+		Counter() : nTimes(0), nBytes(0), nTimeUs(0) {}
+
+		boost::atomic<int64_t>	nTimes;
+		boost::atomic<int64_t>	nBytes;
+		boost::atomic<int64_t>	nTimeUs;
+	};
+	struct ThreadStat
+	{
+		Counter		Recv[Packets::PACKET_MAX];
+		Counter		Send[Packets::PACKET_MAX];
+	};
+	// the tss slot outlives the manager on other threads, and a later manager
+	// may reuse its address(and so the slot): a binding counts only when its
+	// generation is this manager's, a stale one is replaced and its stat left
+	// alone.
+	struct StatBinding
+	{
+		int64_t		nGeneration;
+		ThreadStat*	pStat;
+	};
+
+	ThreadStat& LocalStat();
+	static void Count(Counter& c, uint32_t nBytes, int64_t nTimeUs);
+	static void Merge(const Counter& c, PlayerCmdStat& out);
+
+	tagPlayerCmd*	m_RecvProc[Packets::PACKET_MAX];	// ϢĴͳ
+	tagPlayerCmd*	m_SendProc[Packets::PACKET_MAX];	// ϢĴͳ
+
+	const int64_t							m_Generation;
+	boost::thread_specific_ptr<StatBinding>	m_LocalStat;
+	bstd::vector<ThreadStat*>				m_ThreadStats;
+	MyLock									m_StatLock;
+
+	static boost::atomic<int64_t>			s_NextGeneration;
 };
 
 #endif
@@ -2,6 +2,10 @@
 #include "Config.h"
 #include "Service.h"
 #include "CpuMemStat.h"
+#include "ThreadRegistry.h"
+#include "PoolRegistry.h"
+#include "FrameArena.h"
+#include "EventBus.h"
 
 
 //////////////////////////////////////////////////////////////////////////
@@ -9,7 +13,8 @@ LOG_IMPL(ServiceMgrLog)
 //////////////////////////////////////////////////////////////////////////
 Invoker::Invoker(uint32 interval, uint32 lifeTime, int32 type, int32 initState)
 : m_Interval(interval), m_LifeTime(lifeTime), m_LifeTimeLeft(lifeTime), m_State(initState), m_Type(type)
-, m_InvokeTimeLeft(0), m_SchuduleTime(0), m_ExcuteTime(0), m_IdleTime(0)
+, m_DueUs(0), m_SchuduleUs(0), m_SchuduleTime(0), m_ExcuteTime(0), m_LastWorker(-1), m_ProfiledIndex(-1)
+, m_szName("Invoker"), m_LastStartUs(0), m_Overruns(0)
 {
 
 }
@@ -26,23 +31,47 @@ void Invoker::UpdateTimeInfo()
 	__LEAVE_FUNCTION
 }
 
-void Invoker::UpdateInvokeTimeLeft(int32_t elapse)
-{
-	__ENTER_FUNCTION
-		m_InvokeTimeLeft -= elapse;
-	__LEAVE_FUNCTION
-}
-
 void Invoker::Invoke()
 {
 	__ENTER_FUNCTION
 		SetState(InvokerStatus::EXECUTE);
 
-	m_ExcuteTime = 0;
+	int64_t startUs = TimeUtil::TickMicroseconds();
+	m_SchuduleTime = (int32_t)((startUs - m_SchuduleUs) / 1000);
+	m_DelayHist.Record(startUs - m_SchuduleUs);
+	if (m_LastStartUs > 0)
+	{
+		int64_t jitterUs = (startUs - m_LastStartUs) - (int64_t)m_Interval * 1000;
+		m_JitterHist.Record(jitterUs < 0 ? -jitterUs : jitterUs);
+	}
+	m_LastStartUs = startUs;
+	CoScheduler::SetCurrent(&m_CoScheduler);
 	__ENTER_FUNCTION_EX
+		// FrameAllocator memory of this run is dropped at once when it ends
+		FrameScope frame;
+		// coroutines whose io finished since the last run go first
+		m_CoScheduler.Poll();
 		Do();
 	__LEAVE_FUNCTION_EX
-		m_InvokeTimeLeft = m_Interval;
+		CoScheduler::SetCurrent(NULL);
+		int64_t endUs = TimeUtil::TickMicroseconds();
+	m_ExcuteTime = (int32_t)((endUs - startUs) / 1000);
+	m_RunHist.Record(endUs - startUs);
+	if (endUs - startUs > (int64_t)m_Interval * 1000)
+	{
+		// 1st, 2nd, 4th, 8th... overrun, a slow invoker does not flood the log
+		int64_t overruns = m_Overruns.fetch_add(1) + 1;
+		if ((overruns & (overruns - 1)) == 0)
+		{
+			LOG_WARN(ServiceMgrLog, "Invoker(%s) overrun: run:%lldus interval:%ums overruns:%lld",
+				m_szName, endUs - startUs, m_Interval, overruns);
+		}
+	}
+
+	// fixed rate from the last due time; an overrun skips the missed runs
+	// instead of firing them back to back.
+	m_DueUs += (int64_t)m_Interval * 1000;
+	if (m_DueUs < endUs) m_DueUs = endUs;
 	m_LifeTimeLeft -= m_Interval;
 	if (m_LifeTimeLeft <= 0) {
 		SetState(InvokerStatus::STOP);
@@ -52,11 +81,20 @@ void Invoker::Invoke()
 
 	__LEAVE_FUNCTION
 }
+void Invoker::GetProfile(InvokerProfile& out) const
+{
+	out.Name = m_szName;
+	out.Interval = m_Interval;
+	out.Overruns = m_Overruns.load();
+	m_RunHist.GetSnapshot(out.RunUs);
+	m_DelayHist.GetSnapshot(out.DelayUs);
+	m_JitterHist.GetSnapshot(out.JitterUs);
+	out.Coroutines = m_CoScheduler.Size();
+}
 //////////////////////////////////////////////////////////////////////////
 
-Service::Service()
+Service::Service() : m_State(ServiceStatus::STOP), m_pServiceMgr(NULL)
 {
-	SetState(ServiceStatus::STOP);
 }
 
 Service::~Service()
@@ -70,32 +108,44 @@ void Service::Tick()
 	TickState();
 }
 
+// ServiceMgr and the service's own invokers may both tick it, the claim
+// makes sure a phase is entered once.
 void Service::TickState()
 {
 	__ENTER_FUNCTION
-		switch (m_State)
+		switch (m_State.load())
 	{
+		case ServiceStatus::INIT:
+		{
+			if (!ClaimState(ServiceStatus::INIT, ServiceStatus::INIT_EXC)) break;
+			if (Init()) {
+				OnInitOk();
+			} else {
+				SetState(ServiceStatus::STOP);
+			}
+		}
+		break;
 		case ServiceStatus::START:
 		{
-			SetState(ServiceStatus::START_EXC);
+			if (!ClaimState(ServiceStatus::START, ServiceStatus::START_EXC)) break;
 			Start();
 		}
 		break;
 		case ServiceStatus::LOAD:
 		{
-			SetState(ServiceStatus::LOAD_EXC);
+			if (!ClaimState(ServiceStatus::LOAD, ServiceStatus::LOAD_EXC)) break;
 			Load();
 		}
 		break;
 		case ServiceStatus::SHUTDOWN:
 		{
-			SetState(ServiceStatus::SHUTDOWN_EXC);
+			if (!ClaimState(ServiceStatus::SHUTDOWN, ServiceStatus::SHUTDOWN_EXC)) break;
 			Shutdown();
 		}
 		break;
 		case ServiceStatus::FINALSAVE:
 		{
-			SetState(ServiceStatus::FINALSAVE_EXC);
+			if (!ClaimState(ServiceStatus::FINALSAVE, ServiceStatus::FINALSAVE_EXC)) break;
 			FinalSave();
 		}
 		break;
@@ -105,6 +155,19 @@ void Service::TickState()
 	__LEAVE_FUNCTION
 }
 
+void Service::SetState(uint32 state)
+{
+	m_State.store(state);
+	if (m_pServiceMgr) m_pServiceMgr->Wake();
+}
+
+void Service::OnInitOk()
+{
+	__ENTER_FUNCTION
+		SetState(ServiceStatus::INIT_OK);
+	__LEAVE_FUNCTION
+}
+
 void Service::Start()
 {
 	__ENTER_FUNCTION
@@ -180,14 +243,28 @@ void Service::AddInvoker(InvokerPtr taskPtr)
 {
 	__ENTER_FUNCTION
 		m_InvokerPtrList.PushBack(taskPtr);
+	if (m_pServiceMgr) m_pServiceMgr->Wake();
 	__LEAVE_FUNCTION
 }
 
 //////////////////////////////////////////////////////////////////////////
+void InvokerHeap::Push(const InvokerPtr& Ptr)
+{
+	m_Heap.push_back(Ptr);
+	std::push_heap(m_Heap.begin(), m_Heap.end(), Later());
+}
+
+InvokerPtr InvokerHeap::Pop()
+{
+	std::pop_heap(m_Heap.begin(), m_Heap.end(), Later());
+	InvokerPtr Ptr = m_Heap.back();
+	m_Heap.pop_back();
+	return Ptr;
+}
 
 //////////////////////////////////////////////////////////////////////////
 
-ServiceMgr::ServiceMgr()
+ServiceMgr::ServiceMgr() : m_bWake(false)
 {
 
 }
@@ -209,10 +286,10 @@ bool ServiceMgr::Init(int32_t maxTask, int32_t maxThread)
 
 	m_ServicePtrVec.resize(maxTask);
 
-	m_ThreadPoolPtr = ThreadPoolPtr(new ThreadPool(maxThread));
-	Assert(m_ThreadPoolPtr);
+	m_ExecutorPtr = ExecutorPtr(new Executor(maxThread, "ServiceMgr", g_Config.m_ThreadConfig.m_ServiceMgrCores));
+	Assert(m_ExecutorPtr);
 
-	LOG_DEBUG(ServiceMgrLog, "New ThreadPool(%d) ok", maxThread);
+	LOG_DEBUG(ServiceMgrLog, "New Executor(%d) ok", maxThread);
 
 	return true;
 	__LEAVE_FUNCTION
@@ -229,6 +306,7 @@ bool ServiceMgr::Register(ServicePtr taskPtr)
 	Assert(!m_ServicePtrVec[taskPtr->GetServiceID()]);
 
 	LOG_DEBUG(ServiceMgrLog, "Register task:%d ok", taskPtr->GetServiceID());
+	taskPtr->SetServiceMgr(this);
 	m_ServicePtrVec[taskPtr->GetServiceID()] = taskPtr;
 
 	return true;
@@ -240,7 +318,10 @@ void ServiceMgr::Excute()
 {
 	__ENTER_FUNCTION
 
-		LOG_DEBUG(ServiceMgrLog, "Init ...");
+		bool bRet = CheckDependencies();
+	Assert(bRet);
+
+	LOG_DEBUG(ServiceMgrLog, "Init ...");
 	ExcuteAllServiceInit();
 	LOG_DEBUG(ServiceMgrLog, "Init Ok");
 
@@ -273,8 +354,32 @@ void ServiceMgr::Exit()
 		LOG_DEBUG(ServiceMgrLog, "TaskManager::Exit ...");
 
 	Wait(600);
-	m_InvokerPtrList.Clear();
+	m_InvokerHeap.Clear();
+	m_IdleVec.clear();
+	m_DoneVec.clear();
+	{
+		AutoLock_T lock(m_ProfileLock);
+		for (int32_t i = 0; i < (int32_t)m_ProfiledVec.size(); i++)
+		{
+			m_ProfiledVec[i]->SetProfiledIndex(-1);
+			if (m_ProfiledVec[i]->GetCoScheduler().Size() > 0)
+			{
+				m_RetiredVec.push_back(m_ProfiledVec[i]);
+			}
+		}
+		m_ProfiledVec.clear();
+	}
+	// AsyncIo still runs here, so io the coroutines wait on can complete
+	DrainRetired(5000);
+	if (!m_RetiredVec.empty())
+	{
+		// never freed: a late completion must not find their stacks gone
+		LOG_ERROR(ServiceMgrLog, "TaskManager::Exit %d invokers keep suspended coroutines",
+			(int32_t)m_RetiredVec.size());
+	}
 	m_ServicePtrVec.clear();
+	LogPoolStat();
+	LogPoolStat(true);
 
 	LOG_DEBUG(ServiceMgrLog, "TaskManager::Exit Ok");
 	__LEAVE_FUNCTION
@@ -283,11 +388,8 @@ void ServiceMgr::Exit()
 void ServiceMgr::ExcuteAllServiceInit()
 {
 	__ENTER_FUNCTION
-		for (int32_t i = 0; i < (int32_t)m_ServicePtrVec.size(); i++)
-		{
-			bool bRet = m_ServicePtrVec[i]->Init();
-			Assert(bRet);
-		}
+		bool bRet = this->ExcuteState("Init", ServiceStatus::INIT, ServiceStatus::INIT_OK, false);
+	Assert(bRet);
 	__LEAVE_FUNCTION
 }
 void ServiceMgr::SetAllServiceState(int32_t state)
@@ -300,23 +402,101 @@ void ServiceMgr::SetAllServiceState(int32_t state)
 	__LEAVE_FUNCTION
 }
 
+// m_ProfiledVec holds every live invoker: in the heap, on a worker or idle.
 void ServiceMgr::SetAllInvokerState_MainThread(int32_t state)
 {
 	__ENTER_FUNCTION
-		InvokerPtr Ptr;
-	m_InvokerPtrList.ResetIterator();
-	while (m_InvokerPtrList.PeekNext(Ptr))
+		AutoLock_T lock(m_ProfileLock);
+	for (int32_t i = 0; i < (int32_t)m_ProfiledVec.size(); i++)
+	{
+		m_ProfiledVec[i]->SetState(state);
+	}
+	__LEAVE_FUNCTION
+}
+
+// every registered dependency exists and the graph has no cycle (Kahn).
+bool ServiceMgr::CheckDependencies()
+{
+	__ENTER_FUNCTION
+		int32_t n = (int32_t)m_ServicePtrVec.size();
+	bstd::vector<int32_t> blocked(n, 0);
+	for (int32_t i = 0; i < n; i++)
+	{
+		Assert(m_ServicePtrVec[i]);
+		const bstd::vector<int32_t>& deps = m_ServicePtrVec[i]->GetDependencies();
+		for (int32_t d = 0; d < (int32_t)deps.size(); d++)
+		{
+			if (deps[d] < 0 || deps[d] >= n || deps[d] == i)
+			{
+				LOG_ERROR(ServiceMgrLog, "service:%d depends on invalid service:%d", i, deps[d]);
+				return false;
+			}
+		}
+		blocked[i] = (int32_t)deps.size();
+	}
+
+	bstd::vector<int32_t> ready;
+	for (int32_t i = 0; i < n; i++)
+	{
+		if (blocked[i] == 0) ready.push_back(i);
+	}
+	int32_t visited = 0;
+	while (!ready.empty())
+	{
+		int32_t done = ready.back();
+		ready.pop_back();
+		++visited;
+		for (int32_t i = 0; i < n; i++)
+		{
+			const bstd::vector<int32_t>& deps = m_ServicePtrVec[i]->GetDependencies();
+			if (std::find(deps.begin(), deps.end(), done) != deps.end() && --blocked[i] == 0)
+				ready.push_back(i);
+		}
+	}
+	if (visited != n)
 	{
-		Ptr->SetState(state);
+		LOG_ERROR(ServiceMgrLog, "service dependencies have a cycle");
+		return false;
 	}
+	return true;
 	__LEAVE_FUNCTION
+		return false;
 }
 
-void ServiceMgr::ExcuteState(int32_t setState, int32_t checkState)
+// startup: all dependencies of idx are done. shutdown: all services that
+// depend on idx are done.
+bool ServiceMgr::IsPhaseReady(int32_t idx, const bstd::vector<int64_t>& doneUs, bool bReverse)
+{
+	if (!bReverse)
+	{
+		const bstd::vector<int32_t>& deps = m_ServicePtrVec[idx]->GetDependencies();
+		for (int32_t d = 0; d < (int32_t)deps.size(); d++)
+		{
+			if (doneUs[deps[d]] == 0) return false;
+		}
+		return true;
+	}
+	for (int32_t i = 0; i < (int32_t)m_ServicePtrVec.size(); i++)
+	{
+		const bstd::vector<int32_t>& deps = m_ServicePtrVec[i]->GetDependencies();
+		if (doneUs[i] == 0 && std::find(deps.begin(), deps.end(), idx) != deps.end()) return false;
+	}
+	return true;
+}
+
+// moves every service to setState as soon as its dependencies allow and runs
+// the phase on the executor, so independent services go in parallel. the
+// main thread sleeps until a service changes state (Service::SetState wakes
+// it) or an invoker is due; false if a service fell back to STOP.
+bool ServiceMgr::ExcuteState(const CHAR* szPhase, int32_t setState, int32_t checkState, bool bReverse)
 {
 	__ENTER_FUNCTION
 
-		SetAllServiceState(setState);
+		int32_t n = (int32_t)m_ServicePtrVec.size();
+	bstd::vector<int64_t> startUs(n, 0), doneUs(n, 0);
+	int64_t phaseUs = TimeUtil::TickMicroseconds();
+	int64_t timeoutUs = (int64_t)g_Config.m_ThreadConfig.m_PhaseTimeoutSec * 1000000;
+	bool bFailed = false;
 
 	while (true)
 	{
@@ -325,37 +505,88 @@ void ServiceMgr::ExcuteState(int32_t setState, int32_t checkState)
 
 		Tick(ElapseMilli);
 
-		if (IsAllTaskInState(checkState))
+		int64_t nowUs = TimeUtil::TickMicroseconds();
+		int32_t done = 0;
+		for (int32_t i = 0; i < n; i++)
+		{
+			ServicePtr& Ptr = m_ServicePtrVec[i];
+			if (startUs[i] != 0 && doneUs[i] == 0)
+			{
+				if (Ptr->IsState(checkState)) {
+					doneUs[i] = nowUs;
+				} else if (Ptr->IsState(ServiceStatus::STOP)) {
+					LOG_ERROR(ServiceMgrLog, "%s service:%d failed", szPhase, i);
+					bFailed = true;
+				}
+			}
+			if (doneUs[i] != 0)
+			{
+				++done;
+			}
+			else if (startUs[i] == 0 && IsPhaseReady(i, doneUs, bReverse))
+			{
+				startUs[i] = nowUs;
+				Ptr->SetState(setState);
+				m_ExecutorPtr->Schedule(boost::bind(&Service::Tick, Ptr), -1, typeid(*Ptr).name());
+			}
+		}
+		if (done < n && !bFailed && nowUs - phaseUs > timeoutUs)
+		{
+			for (int32_t i = 0; i < n; i++)
+			{
+				if (doneUs[i] != 0) continue;
+				LOG_ERROR(ServiceMgrLog, "%s service:%d timeout, state:%d", szPhase, i, (int32_t)m_ServicePtrVec[i]->GetState());
+			}
+			bFailed = true;
+		}
+		if (done == n || bFailed)
 		{
 			break;
 		}
 
-		MySleep(10);
+		WaitNextDeadline(1000);
+	}
+	if (bFailed)
+	{
+		// the others may still run this phase on the workers, let them end
+		// before the caller unwinds what they use
+		Wait(g_Config.m_ThreadConfig.m_PhaseTimeoutSec);
+	}
+
+	LOG_DEBUG(ServiceMgrLog, "%s %s in %lldms", szPhase, bFailed ? "failed" : "done",
+		(TimeUtil::TickMicroseconds() - phaseUs) / 1000);
+	for (int32_t i = 0; i < n; i++)
+	{
+		LOG_DEBUG(ServiceMgrLog, "%s service:%d blocked:%lldms run:%lldms", szPhase, i,
+			startUs[i] != 0 ? (startUs[i] - phaseUs) / 1000 : -1,
+			doneUs[i] != 0 ? (doneUs[i] - startUs[i]) / 1000 : -1);
 	}
+	return !bFailed;
 	__LEAVE_FUNCTION
+		return false;
 }
 void ServiceMgr::ExcuteAllServiceStart()
 {
 	__ENTER_FUNCTION
-		this->ExcuteState(ServiceStatus::START, ServiceStatus::START_OK);
+		this->ExcuteState("Start", ServiceStatus::START, ServiceStatus::START_OK, false);
 	__LEAVE_FUNCTION
 }
 void ServiceMgr::ExcuteAllServiceLoad()
 {
 	__ENTER_FUNCTION
-		this->ExcuteState(ServiceStatus::LOAD, ServiceStatus::LOAD_OK);
+		this->ExcuteState("Load", ServiceStatus::LOAD, ServiceStatus::LOAD_OK, false);
 	__LEAVE_FUNCTION
 }
 void ServiceMgr::ExcuteAllServiceShutdown()
 {
 	__ENTER_FUNCTION
-		this->ExcuteState(ServiceStatus::SHUTDOWN, ServiceStatus::SHUTDOWN_OK);
+		this->ExcuteState("Shutdown", ServiceStatus::SHUTDOWN, ServiceStatus::SHUTDOWN_OK, true);
 	__LEAVE_FUNCTION
 }
 void ServiceMgr::ExcuteAllServiceFinalSave()
 {
 	__ENTER_FUNCTION
-		this->ExcuteState(ServiceStatus::FINALSAVE, ServiceStatus::FINALSAVE_OK);
+		this->ExcuteState("FinalSave", ServiceStatus::FINALSAVE, ServiceStatus::FINALSAVE_OK, true);
 	__LEAVE_FUNCTION
 }
 void ServiceMgr::Wait(int32_t sec)
@@ -363,14 +594,139 @@ void ServiceMgr::Wait(int32_t sec)
 	__ENTER_FUNCTION
 		LOG_DEBUG(ServiceMgrLog, "TaskManager::Wait(%d) ...", sec);
 
-	boost::xtime now_xt;
-	xtime_get(&now_xt, boost::TIME_UTC_);
-	now_xt.sec += sec;
+	bool bDone = m_ExecutorPtr->Wait(sec * 1000);
+	LOG_DEBUG(ServiceMgrLog, "TaskManager::Wait(%d) %s, pending:%d", sec, bDone ? "Ok" : "Timeout", m_ExecutorPtr->Pending());
+	__LEAVE_FUNCTION
+}
+
+void ServiceMgr::LogExecutorStat()
+{
+	__ENTER_FUNCTION
+		ExecutorStats stats;
+	m_ExecutorPtr->GetStats(stats);
+	int64_t tasks = _MAX(stats.Tasks, (int64_t)1);
+	int64_t affinityTasks = _MAX(stats.AffinityTasks, (int64_t)1);
+	LOG_DEBUG(ServiceMgrLog, "Executor threads:%d tasks:%lld steal:%.2f%% affinity:%.2f%% wait avg:%lldus max:%lldus",
+		m_ExecutorPtr->Size(), stats.Tasks, stats.Steals * 100.0 / tasks,
+		stats.AffinityHits * 100.0 / affinityTasks, stats.QueueWaitUs / tasks, stats.QueueWaitMaxUs);
+	__LEAVE_FUNCTION
+}
+
+void ServiceMgr::LogThreadStat()
+{
+	__ENTER_FUNCTION
+		bstd::vector<ThreadSample> samples;
+	g_ThreadRegistry.Sample(samples);
+	for (int32_t i = 0; i < (int32_t)samples.size(); i++)
+	{
+		const ThreadSample& t = samples[i];
+		LOG_DEBUG(ServiceMgrLog, "Thread %s tid:%d cpu:%d rate:%0.2f%% total:%lldms",
+			t.Name, t.Tid, t.Cpu, t.CpuRate, t.CpuMs);
+	}
+	__LEAVE_FUNCTION
+}
+
+void ServiceMgr::LogEventBusStat()
+{
+	__ENTER_FUNCTION
+		bstd::vector<EventTopicStat> stats;
+	g_EventBus.GetTopicStats(stats);
+	for (int32_t i = 0; i < (int32_t)stats.size(); i++)
+	{
+		const EventTopicStat& t = stats[i];
+		if (t.Published == 0) continue;
+		LOG_DEBUG(ServiceMgrLog, "EventTopic %s subscribers:%d published:%lld delivered:%lld rate:%0.1f/s latency p50:%lld p99:%lld max:%lldus",
+			t.Name, t.Subscribers, t.Published, t.Delivered, t.PublishRate,
+			t.LatencyUs.Percentile(0.5), t.LatencyUs.Percentile(0.99), t.LatencyUs.Max);
+	}
+	__LEAVE_FUNCTION
+}
+
+void ServiceMgr::LogPoolStat(bool bLeaks, bool bPeriodic)
+{
+	__ENTER_FUNCTION
+		bstd::vector<PoolStats> stats;
+	PoolRegistry::Instance().Snapshot(stats, bPeriodic);
+	for (int32_t i = 0; i < (int32_t)stats.size(); i++)
+	{
+		const PoolStats& p = stats[i];
+		if (bLeaks && p.InUse == 0) continue;
+		LOG_DEBUG(ServiceMgrLog, "%s %s size:%d capacity:%lld inuse:%lld cached:%lld peak:%lld allocs:%lld rate:%0.1f/s misses:%lld",
+			bLeaks ? "PoolLeak" : "Pool", p.Name, p.ObjectSize, p.Capacity, p.InUse, p.FreeCached, p.Peak,
+			p.Allocs, p.AllocRate, p.Misses);
+	}
+	__LEAVE_FUNCTION
+}
 
-	m_ThreadPoolPtr->wait(now_xt);
-	LOG_DEBUG(ServiceMgrLog, "TaskManager::Wait(%d) Ok", sec);
+// invokers by total run time, heaviest first; cumulative since each was added.
+static bool HeavierInvoker(const InvokerProfile& l, const InvokerProfile& r)
+{
+	return l.RunUs.Sum > r.RunUs.Sum;
+}
+
+void ServiceMgr::LogInvokerStat(int32_t topN)
+{
+	__ENTER_FUNCTION
+		bstd::vector<InvokerProfile> profiles;
+	GetInvokerProfiles(profiles);
+	std::sort(profiles.begin(), profiles.end(), HeavierInvoker);
+	for (int32_t i = 0; i < (int32_t)profiles.size() && i < topN; i++)
+	{
+		const InvokerProfile& p = profiles[i];
+		LOG_DEBUG(ServiceMgrLog, "Invoker top%d %s interval:%ums runs:%lld total:%lldms run p50:%lld p99:%lld max:%lldus delay p99:%lldus jitter p99:%lldus overruns:%lld coroutines:%d",
+			i + 1, p.Name, p.Interval, p.RunUs.Count, p.RunUs.Sum / 1000,
+			p.RunUs.Percentile(0.5), p.RunUs.Percentile(0.99), p.RunUs.Max,
+			p.DelayUs.Percentile(0.99), p.JitterUs.Percentile(0.99), p.Overruns, p.Coroutines);
+	}
+	__LEAVE_FUNCTION
+}
+
+void ServiceMgr::GetInvokerProfiles(bstd::vector<InvokerProfile>& out)
+{
+	__ENTER_FUNCTION
+		AutoLock_T lock(m_ProfileLock);
+	out.resize(m_ProfiledVec.size());
+	for (int32_t i = 0; i < (int32_t)m_ProfiledVec.size(); i++)
+	{
+		m_ProfiledVec[i]->GetProfile(out[i]);
+	}
 	__LEAVE_FUNCTION
 }
+
+void ServiceMgr::AddProfiled(const InvokerPtr& Ptr)
+{
+	AutoLock_T lock(m_ProfileLock);
+	Ptr->SetProfiledIndex((int32_t)m_ProfiledVec.size());
+	m_ProfiledVec.push_back(Ptr);
+}
+
+void ServiceMgr::DelProfiled(const InvokerPtr& Ptr)
+{
+	AutoLock_T lock(m_ProfileLock);
+	int32_t index = Ptr->GetProfiledIndex();
+	if (index < 0 || index >= (int32_t)m_ProfiledVec.size() || m_ProfiledVec[index] != Ptr) return;
+
+	// swap-remove: the last invoker takes the freed slot
+	if (index != (int32_t)m_ProfiledVec.size() - 1)
+	{
+		m_ProfiledVec[index] = m_ProfiledVec.back();
+		m_ProfiledVec[index]->SetProfiledIndex(index);
+	}
+	m_ProfiledVec.pop_back();
+	Ptr->SetProfiledIndex(-1);
+}
+
+// runs on an executor worker; remembers it so the next tick queues the
+// invoker to the same worker and its state is still in that core's cache.
+void ServiceMgr::InvokeOn(InvokerPtr Ptr)
+{
+	Ptr->SetLastWorker(m_ExecutorPtr->CurrentWorker());
+	Ptr->Invoke();
+
+	AutoLock_T lock(m_DoneLock);
+	m_DoneVec.push_back(Ptr);
+	m_WakeCond.notify_one();
+}
 void ServiceMgr::ExcuteAllService()
 {
 	__ENTER_FUNCTION
@@ -388,6 +744,11 @@ void ServiceMgr::ExcuteAllService()
 		if (checkShutdown >= 30 * 1000)
 		{
 			LogCpuMemStat("MZ");
+			LogExecutorStat();
+			LogInvokerStat(5);
+			LogThreadStat();
+			LogEventBusStat();
+			LogPoolStat(false, true);
 			checkShutdown = 0;
 			if (IsShouldShutdown())
 			{
@@ -395,9 +756,7 @@ void ServiceMgr::ExcuteAllService()
 			}
 		}
 
-
-
-		MySleep(10);
+		WaitNextDeadline(1000);
 	}
 
 	Wait(300);
@@ -407,14 +766,16 @@ void ServiceMgr::Tick(int32_t elapse)
 {
 	__ENTER_FUNCTION_EX
 		Tick_Service(elapse);
-	Tick_AllInvoker(elapse);
 	Tick_FreeInvoker();
+	Tick_IdleInvoker();
+	Tick_AllInvoker(elapse);
 	__LEAVE_FUNCTION_EX
 }
 void ServiceMgr::Tick_Service(int32_t elapse)
 {
 	__ENTER_FUNCTION
 		const int32_t maxTaskFetch = 64;
+	int64_t nowUs = TimeUtil::TickMicroseconds();
 	for (int32_t i = 0; i < (int32_t)m_ServicePtrVec.size(); i++)
 	{
 		for (int32_t fetchIdx = 0; fetchIdx < maxTaskFetch; fetchIdx++)
@@ -422,7 +783,9 @@ void ServiceMgr::Tick_Service(int32_t elapse)
 			InvokerPtr Ptr = m_ServicePtrVec[i]->FetchInvoker();
 			if (Ptr)
 			{
-				m_InvokerPtrList.PushBack(Ptr);
+				Ptr->SetDueTime(nowUs);
+				m_InvokerHeap.Push(Ptr);
+				AddProfiled(Ptr);
 			}
 			else
 			{
@@ -436,62 +799,167 @@ void ServiceMgr::Tick_AllInvoker(int32_t elapse)
 {
 	__ENTER_FUNCTION
 
-		Assert(m_ThreadPoolPtr);
-
-	InvokerPtr Ptr;
-	m_InvokerPtrList.ResetIterator();
+		Assert(m_ExecutorPtr);
 
-	while (m_InvokerPtrList.PeekNext(Ptr))
+	int64_t nowUs = TimeUtil::TickMicroseconds();
+	while (!m_InvokerHeap.Empty() && m_InvokerHeap.Top()->CanExcuteNow(nowUs))
 	{
+		InvokerPtr Ptr = m_InvokerHeap.Pop();
 		switch (Ptr->GetState())
 		{
 		case InvokerStatus::IDLE:
-		{
-			Ptr->UpdateIdleTime(elapse);
-		}
-		break;
+			m_IdleVec.push_back(Ptr);
+			break;
 		case InvokerStatus::READY:
 		{
-			Ptr->ResetIdleTime();
-			Ptr->UpdateInvokeTimeLeft(elapse);
-			if (Ptr->CanExcuteNow())
-			{
-				Ptr->SetState(InvokerStatus::SCHUDULE);
-				m_ThreadPoolPtr->schedule(boost::bind(&Invoker::Invoke, Ptr));
-			}
+			Ptr->SetState(InvokerStatus::SCHUDULE);
+			Ptr->SetSchuduleTime(nowUs);
+			m_ExecutorPtr->Schedule(boost::bind(&ServiceMgr::InvokeOn, this, Ptr), Ptr->GetLastWorker(), Ptr->GetName());
 		}
 		break;
-		case InvokerStatus::EXECUTE:
-			Ptr->UpdateExcuteTime(elapse);
+		case InvokerStatus::STOP:
+			Retire(Ptr);
+			break;
+		default:
+			AssertSpecialEx(false, "Invoker unkonwn state.");
+			break;
+		}
+	}
+
+	__LEAVE_FUNCTION
+}
+// invokers finished on the workers go back into the heap, or leave it for good.
+void ServiceMgr::Tick_FreeInvoker()
+{
+	__ENTER_FUNCTION
+	{
+		AutoLock_T lock(m_DoneLock);
+		m_DoneSwap.swap(m_DoneVec);
+	}
+	for (int32_t i = 0; i < (int32_t)m_DoneSwap.size(); i++)
+	{
+		InvokerPtr& Ptr = m_DoneSwap[i];
+		switch (Ptr->GetState())
+		{
+		case InvokerStatus::READY:
+			m_InvokerHeap.Push(Ptr);
 			break;
-		case InvokerStatus::SCHUDULE:
-			Ptr->UpdateSchuduleTime(elapse);
+		case InvokerStatus::IDLE:
+			m_IdleVec.push_back(Ptr);
 			break;
 		case InvokerStatus::STOP:
-			Ptr->Stop();
+			Retire(Ptr);
 			break;
 		default:
 			AssertSpecialEx(false, "Invoker unkonwn state.");
 			break;
 		}
 	}
+	m_DoneSwap.clear();
+	DrainRetired(0);
 
 	__LEAVE_FUNCTION
 }
-void ServiceMgr::Tick_FreeInvoker()
+
+// a passive invoker sits here until something sets it READY again, then it
+// is due at once. Wake() gets it scheduled without waiting for the next scan.
+void ServiceMgr::Tick_IdleInvoker()
 {
 	__ENTER_FUNCTION
-		TList<InvokerPtr>::TListIterator iter = m_InvokerPtrList.Begin();
-	for (; iter != m_InvokerPtrList.End();){
-		if ((*iter)->GetState() == InvokerStatus::STOP){
-			iter = m_InvokerPtrList.Erase(iter);
-		} else {
-			++iter;
+		int64_t nowUs = TimeUtil::TickMicroseconds();
+	for (int32_t i = 0; i < (int32_t)m_IdleVec.size();)
+	{
+		InvokerPtr Ptr = m_IdleVec[i];
+		switch (Ptr->GetState())
+		{
+		case InvokerStatus::IDLE:
+			i++;
+			continue;
+		case InvokerStatus::READY:
+			Ptr->SetDueTime(nowUs);
+			m_InvokerHeap.Push(Ptr);
+			break;
+		case InvokerStatus::STOP:
+			Retire(Ptr);
+			break;
+		default:
+			AssertSpecialEx(false, "Invoker unkonwn state.");
+			break;
 		}
+		m_IdleVec[i] = m_IdleVec.back();
+		m_IdleVec.pop_back();
 	}
+	__LEAVE_FUNCTION
+}
 
+// a stopped invoker whose coroutines still wait on io stays until they
+// returned: their stacks hold what the io writes to.
+void ServiceMgr::Retire(const InvokerPtr& Ptr)
+{
+	__ENTER_FUNCTION
+		Ptr->Stop();
+	DelProfiled(Ptr);
+	if (Ptr->GetCoScheduler().Size() > 0)
+	{
+		m_RetiredVec.push_back(Ptr);
+	}
+	__LEAVE_FUNCTION
+}
+
+// the coroutines of retired invokers run on the main thread from now on,
+// nothing else runs those invokers any more.
+void ServiceMgr::DrainRetired(int32_t timeoutMs)
+{
+	__ENTER_FUNCTION
+		int64_t endUs = TimeUtil::TickMicroseconds() + (int64_t)timeoutMs * 1000;
+	for (int32_t i = 0; i < (int32_t)m_RetiredVec.size();)
+	{
+		int32_t leftMs = (int32_t)_MAX((endUs - TimeUtil::TickMicroseconds()) / 1000, 0);
+		if (m_RetiredVec[i]->GetCoScheduler().Drain(leftMs) == 0)
+		{
+			m_RetiredVec[i] = m_RetiredVec.back();
+			m_RetiredVec.pop_back();
+		}
+		else
+		{
+			i++;
+		}
+	}
+	__LEAVE_FUNCTION
+}
+
+// sleeps until the earliest due invoker, a finished invoker or Wake(),
+// at most maxMilli so the caller still gets its periodic checks.
+void ServiceMgr::WaitNextDeadline(int32_t maxMilli)
+{
+	__ENTER_FUNCTION
+		int64_t nowUs = TimeUtil::TickMicroseconds();
+	int64_t waitUs = (int64_t)maxMilli * 1000;
+	if (!m_InvokerHeap.Empty())
+	{
+		waitUs = _MIN(waitUs, m_InvokerHeap.Top()->GetDueTime() - nowUs);
+	}
+	if (!m_IdleVec.empty())
+	{
+		// the old 10 ms scan for idle invokers whose setter did not Wake()
+		waitUs = _MIN(waitUs, (int64_t)10 * 1000);
+	}
+	AutoLock_T lock(m_DoneLock);
+	if (waitUs > 0 && !m_bWake && m_DoneVec.empty())
+	{
+		m_WakeCond.timed_wait(lock, boost::posix_time::microseconds(waitUs));
+	}
+	m_bWake = false;
 	__LEAVE_FUNCTION
 }
+
+void ServiceMgr::Wake()
+{
+	AutoLock_T lock(m_DoneLock);
+	m_bWake = true;
+	m_WakeCond.notify_one();
+}
+
 void ServiceMgr::Tick_Logic(int32_t elapse)
 {
 	__ENTER_FUNCTION
@@ -514,12 +982,10 @@ bool ServiceMgr::IsAllTaskInState(int32_t state)
 bool ServiceMgr::IsAllInvokerInState(int32_t state)
 {
 	__ENTER_FUNCTION
-		InvokerPtr Ptr;
-	m_InvokerPtrList.ResetIterator();
-	while (m_InvokerPtrList.PeekNext(Ptr))
+		AutoLock_T lock(m_ProfileLock);
+	for (int32_t i = 0; i < (int32_t)m_ProfiledVec.size(); i++)
 	{
-		if (!Ptr->IsState(state)) return false;
-
+		if (!m_ProfiledVec[i]->IsState(state)) return false;
 	}
 	return true;
 	__LEAVE_FUNCTION
@@ -2,6 +2,10 @@
 #define __SERVICE_H__
 
 #include "BaseLib.h"
+#include "Executor.h"
+#include "Histogram.h"
+#include "Coroutine.h"
+#include <typeinfo>
 //////////////////////////////////////////////////////////////////////////
 
 LOG_DECL(ServiceMgrLog);
@@ -30,6 +34,18 @@ public:
 	};
 };
 
+// what one invoker has done since it was added, all times in us.
+struct InvokerProfile
+{
+	const CHAR*			Name;
+	uint32				Interval;		// ms
+	int64				Overruns;		// runs longer than Interval
+	Histogram::Snapshot	RunUs;			// time in Do
+	Histogram::Snapshot	DelayUs;		// queued in the executor before starting
+	Histogram::Snapshot	JitterUs;		// |start-to-start interval - Interval|
+	int32				Coroutines;		// spawned on this invoker and not finished
+};
+
 class Invoker
 {
 public:
@@ -37,18 +53,15 @@ public:
 	virtual ~Invoker();
 public:
 	virtual void	UpdateTimeInfo();
-	void			UpdateInvokeTimeLeft(int32 elapse);
 	void			Invoke();
 	virtual void	Do() = 0;
 	virtual void	Stop() = 0;
 public:
-	bool			CanExcuteNow() const				{ return m_InvokeTimeLeft <= 0; }
-	void			UpdateSchuduleTime(int32 elapse)	{ m_SchuduleTime += elapse; }
-	void			ResetIdleTime()						{ m_IdleTime = 0; }
-	void			UpdateIdleTime(int32 elapse)		{ m_IdleTime += elapse; }
-	int32			GetIdleTime() const					{ return m_IdleTime; }
+	bool			CanExcuteNow(int64 nowUs) const		{ return m_DueUs <= nowUs; }
+	int64			GetDueTime() const					{ return m_DueUs; }
+	void			SetDueTime(int64 dueUs)				{ m_DueUs = dueUs; }
+	void			SetSchuduleTime(int64 nowUs)		{ m_SchuduleUs = nowUs; }
 	int32			GetSchuduleTime() const				{ return m_SchuduleTime; }
-	void			UpdateExcuteTime(int32 elapse)		{ m_ExcuteTime += elapse; }
 	int32			GetExcuteTime() const				{ return m_ExcuteTime; }
 	uint32			GetInterval() const					{ return m_Interval; }
 	uint32			GetLifeTime() const					{ return m_LifeTime;  }
@@ -57,17 +70,35 @@ public:
 	void			SetState(uint32 state)				{ m_State = state; }
 	uint32			GetState() const					{ return m_State; }
 	uint32			GetType() const						{ return m_Type; }
+	int32			GetLastWorker() const				{ return m_LastWorker; }
+	void			SetLastWorker(int32 worker)			{ m_LastWorker = worker; }
+	int32			GetProfiledIndex() const			{ return m_ProfiledIndex; }
+	void			SetProfiledIndex(int32 index)		{ m_ProfiledIndex = index; }
+	const CHAR*		GetName() const						{ return m_szName; }
+	void			SetName(const CHAR* szName)			{ m_szName = szName; }
+	void			GetProfile(InvokerProfile& out) const;
+	// coroutines started by CoSpawn from this invoker's Do, resumed before each Do
+	CoScheduler&	GetCoScheduler()					{ return m_CoScheduler; }
 protected:
 	TimeInfo		m_TimeInfo;
 	uint32			m_Interval;
 	uint32			m_LifeTime;
 	int64			m_LifeTimeLeft;
-	int32			m_InvokeTimeLeft;
-	int32			m_SchuduleTime;
-	int32			m_ExcuteTime;
-	int32			m_IdleTime;
+	int64			m_DueUs;			// TimeUtil::TickMicroseconds of the next run
+	int64			m_SchuduleUs;		// handed to the executor
+	int32			m_SchuduleTime;		// ms queued in the executor, last run
+	int32			m_ExcuteTime;		// ms in Do, last run
 	uint32			m_State;
 	uint32			m_Type;
+	int32			m_LastWorker;		// executor worker of the last Invoke, -1 before the first
+	int32			m_ProfiledIndex;	// slot in ServiceMgr::m_ProfiledVec, -1 when not in it
+	const CHAR*		m_szName;
+	int64			m_LastStartUs;
+	Histogram		m_RunHist;
+	Histogram		m_DelayHist;
+	Histogram		m_JitterHist;
+	boost::atomic<int64_t> m_Overruns;
+	CoScheduler		m_CoScheduler;
 };
 typedef boost::shared_ptr<Invoker> InvokerPtr;
 
@@ -76,7 +107,10 @@ template<class InvokerImpl>
 class MakeInvoker : public Invoker
 {
 public:
-	MakeInvoker(InvokerImpl& rInvokerImpl, int32 InterVal, uint32 lifeTime = -1) :Invoker(InterVal, lifeTime), m_rInvokerImpl(rInvokerImpl){}
+	MakeInvoker(InvokerImpl& rInvokerImpl, int32 InterVal, uint32 lifeTime = -1) :Invoker(InterVal, lifeTime), m_rInvokerImpl(rInvokerImpl)
+	{
+		SetName(typeid(InvokerImpl).name());
+	}
 	virtual ~MakeInvoker() {}
 public:
 	virtual void Do()
@@ -103,6 +137,10 @@ public:
 	{
 		STOP = 0,
 
+		INIT,
+		INIT_EXC,
+		INIT_OK,
+
 		START,
 		START_EXC,
 		START_OK,
@@ -124,6 +162,7 @@ public:
 };
 
 
+class ServiceMgr;
 class Service
 {
 public:
@@ -133,31 +172,40 @@ public:
 public:
 	InvokerPtr			FetchInvoker();
 	void				AddInvoker(InvokerPtr taskPtr);
+	void				SetServiceMgr(ServiceMgr* pMgr) { m_pServiceMgr = pMgr; }
+	// serviceID has to finish each startup phase before this service begins
+	// it, and begins each shutdown phase only after this service finished it.
+	void				DependOn(int32 serviceID) { m_Dependencies.push_back(serviceID); }
+	const bstd::vector<int32>& GetDependencies() const { return m_Dependencies; }
 public:
 	virtual void		Tick();
 private:
 	virtual void		TickState();
+	bool				ClaimState(uint32 from, uint32 to) { return m_State.compare_exchange_strong(from, to); }
 protected:
 	virtual	void		Start();
 	virtual	void		Load();
 	virtual void		Shutdown();
 	virtual void		FinalSave();
 public:
+	virtual void		OnInitOk();
 	virtual void		OnStartOk();
 	virtual void		OnLoadOk();
 	virtual	void		OnShutdownOk();
 	virtual	void		OnFinalSaveOk();
 public:
-	void				SetState(uint32 state){ m_State = state; }
-	uint32				GetState() const		{ return m_State; }
-	bool				IsState(uint32 state) const { return (m_State == state); }
+	void				SetState(uint32 state);
+	uint32				GetState() const		{ return m_State.load(); }
+	bool				IsState(uint32 state) const { return (m_State.load() == state); }
 
 public:
 	Service();
 	virtual ~Service();
 protected:
-	uint32_t m_State;
-	TSList<InvokerPtr>	m_InvokerPtrList;
+	boost::atomic<uint32_t> m_State;	// pool threads drive the phases, see ServiceMgr::ExcuteState
+	TSQueue<InvokerPtr>	m_InvokerPtrList;
+	ServiceMgr*			m_pServiceMgr;
+	bstd::vector<int32>	m_Dependencies;
 };
 
 typedef boost::shared_ptr<Service> ServicePtr;
@@ -177,8 +225,26 @@ protected:
 //////////////////////////////////////////////////////////////////////////
 
 
-typedef boost::threadpool::fifo_pool  ThreadPool;
-typedef boost::shared_ptr<ThreadPool> ThreadPoolPtr;
+
+// min-heap of waiting invokers by due time. running invokers are not in it,
+// they are pushed back when they finish, so a stopped one just never returns.
+class InvokerHeap
+{
+public:
+	void					Push(const InvokerPtr& Ptr);
+	InvokerPtr				Pop();
+	const InvokerPtr&		Top() const				{ return m_Heap.front(); }
+	bool					Empty() const			{ return m_Heap.empty(); }
+	int32					Size() const			{ return (int32)m_Heap.size(); }
+	const InvokerPtr&		At(int32 idx) const		{ return m_Heap[idx]; }
+	void					Clear()					{ m_Heap.clear(); }
+private:
+	struct Later
+	{
+		bool operator()(const InvokerPtr& l, const InvokerPtr& r) const { return l->GetDueTime() > r->GetDueTime(); }
+	};
+	bstd::vector<InvokerPtr> m_Heap;
+};
 
 class ServiceMgr
 {
@@ -190,10 +256,21 @@ public:
 	bool					Register(ServicePtr taskPtr);
 	void					Excute();
 	void					Exit();
+	// any thread: cut the main thread's sleep short, e.g. a new invoker or
+	// a passive one set READY again.
+	void					Wake();
+	// any thread: profiles of all live invokers.
+	void					GetInvokerProfiles(bstd::vector<InvokerProfile>& out);
+	// any thread: one line per registered pool; bLeaks logs only the pools
+	// still holding objects, as Exit does. only the periodic log passes
+	// bPeriodic, the rates of the others are since its last line.
+	void					LogPoolStat(bool bLeaks = false, bool bPeriodic = false);
 private:
 	void					SetAllInvokerState_MainThread(int32 state);
 	void					SetAllServiceState(int32 state);
-	void					ExcuteState(int32 setState, int32 checkState);
+	bool					CheckDependencies();
+	bool					IsPhaseReady(int32 idx, const bstd::vector<int64>& doneUs, bool bReverse);
+	bool					ExcuteState(const CHAR* szPhase, int32 setState, int32 checkState, bool bReverse);
 	void					ExcuteAllServiceInit();
 	void					ExcuteAllServiceStart();
 	void					ExcuteAllServiceLoad();
@@ -205,18 +282,38 @@ private:
 	void					Tick_Service(int32 elapse);
 	void					Tick_AllInvoker(int32 elapse);
 	void					Tick_FreeInvoker();
+	void					Tick_IdleInvoker();
 	void					Tick_Logic(int32 elapse);
+	void					WaitNextDeadline(int32 maxMilli);
 private:
 	void					Wait(int32 sec);
+	void					LogExecutorStat();
+	void					LogInvokerStat(int32 topN);
+	void					LogThreadStat();
+	void					LogEventBusStat();
+	void					AddProfiled(const InvokerPtr& Ptr);
+	void					DelProfiled(const InvokerPtr& Ptr);
+	void					InvokeOn(InvokerPtr Ptr);
+	void					Retire(const InvokerPtr& Ptr);
+	void					DrainRetired(int32 timeoutMs);
 private:
 	bool					IsAllInvokerInState(int32 state);
 	bool					IsAllTaskInState(int32 state);
 	bool					IsShouldShutdown();
 private:
 	TimeInfo				m_TimeInfo;
-	ThreadPoolPtr			m_ThreadPoolPtr;
+	ExecutorPtr				m_ExecutorPtr;
 	TVector<ServicePtr>		m_ServicePtrVec;
-	TList<InvokerPtr>		m_InvokerPtrList;
+	InvokerHeap				m_InvokerHeap;
+	bstd::vector<InvokerPtr> m_IdleVec;				// passive invokers after their run, scanned each tick
+	MyLock					m_DoneLock;
+	bstd::vector<InvokerPtr> m_DoneVec;				// finished on a worker, not yet back in the heap
+	bstd::vector<InvokerPtr> m_DoneSwap;
+	bool					m_bWake;
+	boost::condition_variable_any m_WakeCond;
+	MyLock					m_ProfileLock;
+	bstd::vector<InvokerPtr> m_ProfiledVec;			// every live invoker, for GetInvokerProfiles
+	bstd::vector<InvokerPtr> m_RetiredVec;			// stopped, kept until their coroutines returned
 };
 
 
@@ -13,66 +13,86 @@ BASE_NAME_SPACES
 
 #ifdef ALLOCATOR_UNIT_TEST
 
-typedef Allocator<10> MemPool;
+typedef Allocator<11, PolicyAlignPow2<10> > MemPool;
 
-AtomicInt32 all;
+/* thread-scaling benchmark: every thread keeps a window of live blocks and
+** replaces a random one per op, so blocks outlive a single alloc/free pair. */
+#define PERTHREAD	(1000000)
+#define LIVEWINDOW	(256)
+#define MAXTHREAD	(16)
 
-#define PERTHREAD (100000)
-void MyPool(MemPool* pool)
+struct PoolOps
 {
-	int32_t bytes = 0; uint32_t allbytes = 0;
-	for(int32_t i = 0; i < PERTHREAD; i++){
-		bytes = 64 * ( 1 << (GetTickCount()%11));
-		allbytes += bytes;
-		void *p = pool->allocZ(bytes);
-		pool->freeZ(p);
-	}
-	all.addAndGet(allbytes/1024);
-}
+	PoolOps(MemPool* pool) : pool_(pool) { }
+	void* alloc(int32_t bytes) { return pool_->allocZ(bytes); }
+	void  free(void* p) { pool_->freeZ(p); }
+	MemPool* pool_;
+};
+
+struct MallocOps
+{
+	void* alloc(int32_t bytes) { return ::malloc(bytes); }
+	void  free(void* p) { ::free(p); }
+};
 
-void SysPool( )
+#if defined(USE_JEMALLOC)
+struct JemallocOps
 {
-	int32_t bytes = 0; uint32_t allbytes = 0;
+	void* alloc(int32_t bytes) { return je_malloc(bytes); }
+	void  free(void* p) { je_free(p); }
+};
+#endif
+
+template<typename Ops>
+void benchThread(Ops ops, uint32_t seed)
+{
+	void* live[LIVEWINDOW] = {0};
+	RandUitl rnd(seed);
 	for(int32_t i = 0; i < PERTHREAD; i++){
-		bytes = 64 * ( 1 << (GetTickCount()%11));
-		allbytes += bytes;
-		void *p = malloc(bytes);
-		free(p);
+		int32_t slot = rnd.rand() % LIVEWINDOW;
+		if( live[slot] ) ops.free(live[slot]);
+		live[slot] = ops.alloc(64 * ( 1 << (rnd.rand() % 10)));
 	}
-	all.addAndGet(allbytes/1024);
+	for(int32_t i = 0; i < LIVEWINDOW; i++)
+		if( live[i] ) ops.free(live[i]);
 }
 
-template<typename F>
-void Test(F f, const char* name)
+template<typename Ops>
+void bench(Ops ops, const char* name)
 {
-	boost::timer t;
-#define MAXTHREAD (20)
-	all.set(0);
-
-	ThreadPool pool(MAXTHREAD);
-	for(int32_t i = 0; i < MAXTHREAD; i++)
-		pool.schedule(f);
-
-	pool.wait();
-
-	double elase = t.elapsed();
-	int32_t kb = (int32_t)all.get();
-	double mbs = kb/elase/1024;
-	fprintf(stdout, "%s:%0.5f(Sec),%d(Kb),%f(Mb/Sec)\n",
-		name, elase, kb, mbs );
+	for(int32_t threads = 1; threads <= MAXTHREAD; threads *= 2)
+	{
+		int64_t start = TimeUtil::tickMicroseconds( );
+		{
+			ThreadPool pool(threads);
+			for(int32_t i = 0; i < threads; i++)
+				pool.schedule(boost::bind(&benchThread<Ops>, ops, (uint32_t)(i + 1)));
+			pool.wait();
+		}
+		double elapse = (TimeUtil::tickMicroseconds( ) - start) / 1000000.0;
+		double mops = (double)PERTHREAD * threads / (elapse > 0 ? elapse : 1e-6) / 1000000;
+		fprintf(stdout, "allocator,%s,%d,%0.5f,%0.3f\n", name, threads, elapse, mops);
+	}
 }
 
 void allocatorUT(void*)
 {
+	// csv: allocator,impl,threads,seconds,Mops/sec
 	{
-		MemPool allocZ(4*1024*1024, 64);
-		Test(boost::bind(&MyPool, &allocZ), "pool");
+		MemPool allocZ(64*1024*1024, 64);
+		bench(PoolOps(&allocZ), "pool");
+		fprintf(stdout, "allocator,pool,sysAllocs=%d,sysFrees=%d\n", allocZ.sysAllocs(), allocZ.sysFrees());
 	}
 
-	{
-		Test(boost::bind(&SysPool), "malloc");
-	}
+#if defined(USE_TCMALLOC)
+	bench(MallocOps(), "tcmalloc");
+#else
+	bench(MallocOps(), "malloc");
+#endif
 
+#if defined(USE_JEMALLOC)
+	bench(JemallocOps(), "jemalloc");
+#endif
 }
 
 AUTOTEST_IMP(AllocatorUnit, allocatorUT);
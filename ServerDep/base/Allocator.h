@@ -12,6 +12,7 @@ license agreement you entered into with backkom.
 #define ALLOCATOR_H
 
 #include <PreCompier.h>
+#include <PoolRegistry.h>
 
 BASE_NAME_SPACES
 
@@ -95,7 +96,18 @@ public:
 
 
 
-/* memory pool */
+/** allocate(deallocate) memory from system heap */
+inline void* _sysAlloc( int32_t size ){ return calloc(1, size); }
+inline void  _sysFree( void *p ) { if( p )free(p); }
+
+/* batch link lives in the first payload word of a batch's head node */
+#define MNODE_BATCH(node)	(*(MemNode**)MNODECASTO(node))
+
+/* memory pool
+** thread cache(magazine per size class) -> central lock-free batch stacks -> system heap.
+** nodes move between a thread and the central lists only in batches, so the hot
+** path of allocZ/freeZ touches no shared cache line.
+*/
 template
 <
 	int32_t INDEX = 1,
@@ -104,104 +116,201 @@ template
 class Allocator : public boost::noncopyable, public boost::enable_shared_from_this< Allocator<INDEX> >
 {
 	const static int32_t POOL_INDEX = INDEX;
-public:
-	/** @size memory size */
-	void* allocZ(int32_t size)
+	const static int32_t kBatchBytes = 32 * 1024;
+	const static int32_t kMaxBatchNodes = 32;
+	const static int32_t kStatBatch = 64;
+
+	/* central lists, shared by the pool and every thread cache of it, so a
+	** thread exiting after the pool is gone can still flush safely. */
+	struct Central : public boost::noncopyable
 	{
-		MemNode *node;
-		int32_t i,  
-			newSize = PolicyAlign::align(size, reqUnitSize_),
-			j = PolicyAlign::index(newSize, reqUnitSize_);
-		if( j >=0 ) {
-			lock( );
-			if( nodeList_[j].next ){
-				node = nodeList_[j].next;
-				node->hits += 1;
-				nodeList_[j].next = node->next;
-				cachedSize_ -= node->size;
-				nodeList_[j].hits += 1;
-				unlock( );
-				return MNODECASTO(node);
+		Central(int32_t limit) : cachedSize(0), cachedSizeLimit(limit), sysAllocs(0), sysFrees(0),
+			allocs(0), frees(0), peak(0)
+		{
+			for(int32_t i = 0; i < POOL_INDEX; i++) lists[i] = NULL;
+		}
+		~Central( )
+		{
+			for(int32_t i = 0; i < POOL_INDEX; i++) 
+			{
+				MemNode *batch = lists[i].exchange(NULL);
+				while( batch )
+				{
+					MemNode *nextBatch = MNODE_BATCH(batch);
+					freeChain(batch);
+					batch = nextBatch;
+				}
 			}
-			unlock( );
 		}
-
-		node = (MemNode*)_sysAlloc(MNODE_SIZE+newSize);
-		if(!node) {
-			if( j >= 0 ) {
-				/** we try to alloc from the larger block */
-				lock( );
-				for( i = j ; i < POOL_INDEX; i++ ) {
-					node = nodeList_[i].next;
-					if( nodeList_[i].next ){
-						node = nodeList_[i].next;
-						node->hits += 1;
-						nodeList_[i].next = node->next;
-						cachedSize_ -= node->size;
-						unlock( );
-						return MNODECASTO(node);
-					}
+		/* push a chain of batches [head..tail], ABA free */
+		void pushBatches(int32_t j, MemNode *head, MemNode *tail)
+		{
+			MemNode *old = lists[j].load(boost::memory_order_relaxed);
+			do {
+				MNODE_BATCH(tail) = old;
+			} while( !lists[j].compare_exchange_weak(old, head,
+				boost::memory_order_release, boost::memory_order_relaxed) );
+		}
+		/* take the whole stack, keep one batch and give the rest back,
+		** so no pop ever races a reused head (no ABA). */
+		MemNode* popBatch(int32_t j)
+		{
+			MemNode *batch = lists[j].exchange(NULL, boost::memory_order_acquire);
+			if( batch )
+			{
+				MemNode *rest = MNODE_BATCH(batch);
+				if( rest )
+				{
+					MemNode *tail = rest;
+					while( MNODE_BATCH(tail) ) tail = MNODE_BATCH(tail);
+					pushBatches(j, rest, tail);
 				}
-
-				unlock( );
 			}
-
-			/** we feel so helpless !*/
-			return NULL;
+			return batch;
+		}
+		void addStat(int32_t nAllocs, int32_t nFrees)
+		{
+			int64_t inUse = allocs.fetch_add(nAllocs, boost::memory_order_relaxed) + nAllocs
+				- frees.fetch_add(nFrees, boost::memory_order_relaxed) - nFrees;
+			int64_t old = peak.load(boost::memory_order_relaxed);
+			while( inUse > old && !peak.compare_exchange_weak(old, inUse, boost::memory_order_relaxed) );
+		}
+		static void freeChain(MemNode *node)
+		{
+			while( node )
+			{
+				MemNode *next = node->next;
+				_sysFree(node);
+				node = next;
+			}
 		}
 
-		node->next = 0;
-		node->hits = 0;
-		node->size = newSize;
+		boost::atomic<MemNode*> lists[POOL_INDEX];
+		boost::atomic<int32_t> cachedSize;
+		int32_t cachedSizeLimit;
+		boost::atomic<int32_t> sysAllocs;
+		boost::atomic<int32_t> sysFrees;
+		boost::atomic<int64_t> allocs;
+		boost::atomic<int64_t> frees;
+		boost::atomic<int64_t> peak;
+	};
+	typedef boost::shared_ptr<Central> CentralPtr;
+
+	struct Magazine
+	{
+		MemNode *head;
+		int32_t count;
+	};
 
-		return MNODECASTO(node);
-	}
-	void* tryAllocZ(int32_t size)
+	struct ThreadCache : public boost::noncopyable
+	{
+		ThreadCache(const CentralPtr& c) : central(c), allocs(0), frees(0)
+		{
+			memset(mags, 0, sizeof(mags));
+		}
+		~ThreadCache( )
+		{
+			for(int32_t j = 0; j < POOL_INDEX; j++)
+				if( mags[j].count > 0 ) release(j, mags[j].count);
+			flushStat( );
+		}
+		/* counts reach the central in batches too, so stats cost no shared write per block */
+		void countAlloc( ) { if( ++allocs >= kStatBatch ) flushStat( ); }
+		void countFree( ) { if( ++frees >= kStatBatch ) flushStat( ); }
+		void flushStat( )
+		{
+			central->addStat(allocs, frees);
+			allocs = frees = 0;
+		}
+		static int32_t batchNodes(int32_t size)
+		{
+			int32_t n = kBatchBytes / size;
+			return n < 2 ? 2 : (n > kMaxBatchNodes ? kMaxBatchNodes : n);
+		}
+		/* move @n nodes of class @j to the central list (or the system heap when over limit) */
+		void release(int32_t j, int32_t n)
+		{
+			Magazine &m = mags[j];
+			MemNode *head = m.head, *tail = head;
+			int32_t bytes = tail->size;
+			for(int32_t i = 1; i < n; i++) { tail = tail->next; bytes += tail->size; }
+			m.head = tail->next;
+			m.count -= n;
+			tail->next = NULL;
+
+			if( central->cachedSize.fetch_add(bytes, boost::memory_order_relaxed) + bytes <= central->cachedSizeLimit )
+			{
+				MNODE_BATCH(head) = NULL;
+				central->pushBatches(j, head, head);
+			}
+			else
+			{
+				central->cachedSize.fetch_sub(bytes, boost::memory_order_relaxed);
+				central->sysFrees.fetch_add(n, boost::memory_order_relaxed);
+				Central::freeChain(head);
+			}
+		}
+		bool refill(int32_t j)
+		{
+			MemNode *batch = central->popBatch(j);
+			if( !batch ) return false;
+
+			int32_t bytes = 0, n = 0;
+			MemNode *tail = batch;
+			for( ; ; tail = tail->next) { bytes += tail->size; ++n; if( !tail->next ) break; }
+			central->cachedSize.fetch_sub(bytes, boost::memory_order_relaxed);
+			tail->next = mags[j].head;
+			mags[j].head = batch;
+			mags[j].count += n;
+			return true;
+		}
+
+		CentralPtr central;
+		Magazine mags[POOL_INDEX];
+		int32_t allocs;
+		int32_t frees;
+	};
+	static void releaseCache(ThreadCache *cache) { delete cache; }
+public:
+	/** @size memory size */
+	void* allocZ(int32_t size)
 	{
 		MemNode *node;
-		int32_t i,  
+		int32_t i,
 			newSize = PolicyAlign::align(size, reqUnitSize_),
 			j = PolicyAlign::index(newSize, reqUnitSize_);
-
-		if( j >= 0 ){
-			if( !tryLock( ) ) {
-				return NULL;
-			}
-
-			if( nodeList_[j].next ) {
-				node = nodeList_[j].next;
+		if( j >= 0 && j < POOL_INDEX ) {
+			ThreadCache *cache = threadCache( );
+			Magazine &m = cache->mags[j];
+			if( m.head || cache->refill(j) ) {
+				node = m.head;
+				m.head = node->next;
+				m.count -= 1;
 				node->hits += 1;
-				nodeList_[j].next = node->next;
-				cachedSize_ -= node->size;
-				nodeList_[j].hits += 1;
-				unlock( );
+				cache->countAlloc( );
 				return MNODECASTO(node);
 			}
-			unlock( );
-		} 
+		}
 
+		central_->sysAllocs.fetch_add(1, boost::memory_order_relaxed);
 		node = (MemNode*)_sysAlloc(MNODE_SIZE+newSize);
 		if(!node) {
 			if( j >= 0 ) {
 				/** we try to alloc from the larger block */
-				if( !tryLock( ) ) {
-					return NULL;
-				}
-
-				for( i = j ; i < POOL_INDEX; i++ ) {
-					node = nodeList_[i].next;
-					if( nodeList_[i].next ) {
-						node = nodeList_[i].next;
+				ThreadCache *cache = threadCache( );
+				for( i = j + 1; i < POOL_INDEX; i++ ) {
+					Magazine &m = cache->mags[i];
+					if( m.head || cache->refill(i) ) {
+						node = m.head;
+						m.head = node->next;
+						m.count -= 1;
 						node->hits += 1;
-						nodeList_[i].next = node->next;
-						cachedSize_ -= node->size;
-						unlock( );
+						cache->countAlloc( );
 						return MNODECASTO(node);
 					}
 				}
-
-				unlock( );
 			}
+
 			/** we feel so helpless !*/
 			return NULL;
 		}
@@ -209,56 +318,37 @@ public:
 		node->next = 0;
 		node->hits = 0;
 		node->size = newSize;
+		central_->addStat(1, 0);
 
 		return MNODECASTO(node);
 	}
+	/* the thread cache never blocks, kept for callers that must not wait */
+	void* tryAllocZ(int32_t size)
+	{
+		return allocZ(size);
+	}
 	void  freeZ(void *p)
 	{
 		MemNode *node = MNODECASFROM(p);
-		int32_t x, hits, i, j = PolicyAlign::index(node->size, reqUnitSize_);
-
-		if( j >= 0 ) {
-			lock( );
-
-			hits = node->hits;
-			x = cachedSize_ < cachedSizeLimit_ ?
-				0 : (node->size * 2);
-
-			if( x > 0 && hits ) {
-				MemNode *prev;
-				for(i = POOL_INDEX - 1;
-					i >= 0 && x > 0;
-					i --){
-						prev = &nodeList_[i];
-						node = nodeList_[i].next;
-						for( ; x > 0 && node; ){
-							if(node->hits < hits){
-								prev->next = node->next;
-								x -= node->size;
-								_sysFree(node);
-								node = prev->next;
-							} else {
-								prev = node;
-								node = node->next;
-							}
-						}
-				}
-			}
-
-			if( cachedSizeLimit_ > cachedSize_ ) {
-				if( j >= 0 && j < POOL_INDEX) {
-					node->next = nodeList_[j].next;
-					nodeList_[j].next = node;
-					cachedSize_ += node->size;
-					unlock( );
-					return ;
-				}
-			}
-
-			unlock( );
+		int32_t j = PolicyAlign::index(node->size, reqUnitSize_);
+
+		if( j >= 0 && j < POOL_INDEX ) {
+			ThreadCache *cache = threadCache( );
+			Magazine &m = cache->mags[j];
+			node->next = m.head;
+			m.head = node;
+			m.count += 1;
+
+			int32_t batch = ThreadCache::batchNodes(node->size);
+			if( m.count >= batch * 2 )
+				cache->release(j, batch);
+			cache->countFree( );
+			return ;
 		}
 
-		_sysFree(MNODECASFROM(p));
+		central_->sysFrees.fetch_add(1, boost::memory_order_relaxed);
+		central_->addStat(0, 1);
+		_sysFree(node);
 	}
 	/* debug head in memory's head */
 	void* allocZD(int32_t size, const char *func, int32_t line)
@@ -298,45 +388,55 @@ public:
 
 		freeZ(pDBGHead);
 	}
+public:
+	/* bytes parked in the central lists(thread caches excluded) */
+	int32_t cachedSize( ) const { return central_->cachedSize.load(boost::memory_order_relaxed); }
+	int32_t sysAllocs( ) const { return central_->sysAllocs.load(boost::memory_order_relaxed); }
+	int32_t sysFrees( ) const { return central_->sysFrees.load(boost::memory_order_relaxed); }
+	/* capacity is the central cache limit in bytes; block counts lag every other
+	** thread by less than kStatBatch. */
+	void stat(PoolStat& out) const
+	{
+		ThreadCache *cache = cache_.get( );
+		if( cache && cache->central == central_ ) cache->flushStat( );
+
+		out.objectSize = 0;
+		out.capacity = central_->cachedSizeLimit;
+		out.freeCached = cachedSize( );
+		out.allocs = central_->allocs.load(boost::memory_order_relaxed);
+		out.frees = central_->frees.load(boost::memory_order_relaxed);
+		out.inUse = out.allocs - out.frees;
+		out.peak = central_->peak.load(boost::memory_order_relaxed);
+		out.misses = sysAllocs( );
+	}
 public:
 	Allocator(int32_t poolSize, int32_t unit = 64)
+		: central_(new Central(poolSize)), cache_(&Allocator::releaseCache)
 	{
-		cachedSize_ = 0;
 		reqUnitSize_ = Util::nextPow2(unit);
-		cachedSizeLimit_ = poolSize;
-		memset(nodeList_, 0, sizeof(nodeList_));
 	}
 	~Allocator( )
 	{
-		int32_t i;
-		MemNode *node;
-
-		for( i = 0; i < POOL_INDEX; i++)
-		{
-			while(node = nodeList_[i].next)
-			{
-				nodeList_[i].next = node->next;
-				_sysFree(node);
-			}
+		/* the calling thread flushes now, others flush at their exit and
+		** keep central_ alive until then. */
+		cache_.reset( );
+	}
+private:
+	ThreadCache* threadCache( )
+	{
+		ThreadCache *cache = cache_.get( );
+		if( !cache || cache->central != central_ ) {
+			cache = new ThreadCache(central_);
+			cache_.reset(cache);
 		}
+		return cache;
 	}
 private:
-	int32_t cachedSize_;
-    int32_t cachedSizeLimit_;
 	int32_t reqUnitSize_;
-	AtomicInt32 busyLock_;
-    
-    MemNode nodeList_[POOL_INDEX];
-
-	void lock( )	{ while( busyLock_.compareAndSet(0, 1) != 0) Util::thisThreadSleep(0);  }
-	void unlock( )	{ busyLock_.set( 0 ); }
-	bool tryLock( ) { return !busyLock_.compareAndSet(0, 1); }
+	CentralPtr central_;
+	boost::thread_specific_ptr<ThreadCache> cache_;
  };
 
-/** allocate(deallocate) memory from system heap */
-inline void* _sysAlloc( int32_t size ){ return calloc(1, size); }
-inline void  _sysFree( void *p ) { if( p )free(p); }
-
 #ifdef ALLOCATOR_UNIT_TEST
 AUTOTEST_DEF(AllocatorUnit);
 #endif
@@ -11,12 +11,28 @@ struct tagCmd
 typedef boost::shared_ptr<tagCmd> CmdPtr;
 
 
+// the name hash with its top bit set, so a hashed id never lands in the
+// flat range of CMD_START_ID.
+const uint32_t kHashCmdIdBit = 0x80000000u;
+inline uint32_t hashCmdId(const char* name) { return base::crc32(name) | kHashCmdIdBit; }
+
 #define CMD_START(CMD)\
 struct CMD : tagCmd {\
 	CMD( ){\
 	memset(this, 0, sizeof(*this));\
 	size = sizeof(*this);\
-	id=base::crc32(#CMD);}
+	id=hashCmdId(#CMD);}
+
+// dense compile-time id, dispatched by CmdDispatcher through a flat table.
+// ID must be in (0, CmdDispatcher::kMaxCmdId).
+#define CMD_START_ID(CMD, ID)\
+struct CMD : tagCmd {\
+	enum { kCmdId = ID };\
+	static const char* cmdName( ) { return #CMD; }\
+	CMD( ){\
+	memset(this, 0, sizeof(*this));\
+	size = sizeof(*this);\
+	id = kCmdId;}
 
 #define CMD_END };
 
@@ -27,6 +43,7 @@ enum MSG_FLAG
 	MSG_FLAG_GATHER		= 1 << 0,
 	MSG_FLAG_COMPRESS	= 1 << 1,
 	MSG_FLAG_GCBOTH		= MSG_FLAG_GATHER | MSG_FLAG_COMPRESS,
+	MSG_FLAG_LARGE		= 1 << 2,	// wire only: a tagFragmentCmd, its chunk follows unbuffered
 };
 
 //...
@@ -39,6 +56,11 @@ struct NetworkConfig {
 		recvBufferSize = 1024;
 		maxConnectionSize = 4096;
 		maxAcceptionExceptionSecond = 3;
+		metricsLogSecond = 60;
+		coalesceMicroseconds = 0;
+		coalesceBytes = 0;
+		maxLargeCmdSize = 4 * 1024 * 1024;
+		ioCpus = "";
 #if defined(USE_SELF_POOL)
 		maxCmdPoolSize = 64 * 1024;
 		maxCmdPoolNumber = 8;
@@ -52,6 +74,11 @@ struct NetworkConfig {
 	int32_t recvBufferSize;
 	int32_t maxConnectionSize;
 	int32_t maxAcceptionExceptionSecond;
+	int32_t metricsLogSecond;	// 0: no periodic metrics log
+	int32_t coalesceMicroseconds;	// 0: every sendCmd starts a write, see TcpConnection::flush
+	int32_t coalesceBytes;	// queued bytes that end the window early, 0: sendBufferSize
+	int32_t maxLargeCmdSize;	// cmds in (maxCmdSize, maxLargeCmdSize] travel fragmented, 0: off
+	bstd::string ioCpus;	// "0-3": io thread i pinned to the (i % n)th cpu listed, empty: not pinned
 #if defined(USE_SELF_POOL)
 	int32_t maxCmdPoolNumber;
 #endif
@@ -0,0 +1,99 @@
+#include <CmdDispatcher.h>
+#include <TcpConnection.h>
+
+BASE_NAME_SPACES
+
+CmdDispatcher::CmdDispatcher( ) : unknown_(0)
+{
+}
+
+CmdDispatcher::~CmdDispatcher( )
+{
+}
+
+void CmdDispatcher::registerRaw(uint32_t id, const char* name, int32_t minSize, int32_t maxSize, const MessageCallback& handler)
+{
+	_Assert(id > 0 && id < kMaxCmdId, "cmd id out of range.");
+	Entry& e = entries_[id];
+	_Assert(!e.handler, "duplicate cmd id.");
+	e.name = name;
+	e.minSize = minSize;
+	e.maxSize = maxSize;
+	e.handler = handler;
+}
+
+void CmdDispatcher::dispatch(const TcpConnectionPtr& conn, const tagCmd* cmd)
+{
+	if( cmd->id < (uint32_t)kMaxCmdId && entries_[cmd->id].handler )
+	{
+		Entry& e = entries_[cmd->id];
+		if( cmd->size < e.minSize || cmd->size > e.maxSize )
+		{
+			e.rejects.fetch_add(1, boost::memory_order_relaxed);
+			LOGW("%s: bad size %d, expect [%d, %d], from %s.", e.name, cmd->size,
+				e.minSize, e.maxSize, conn->name().c_str());
+			return;
+		}
+
+		int64_t start = TimeUtil::tickMicroseconds( );
+		_MY_TRY
+		{
+			e.handler(conn, cmd);
+		}
+		_MY_CATCH
+		{
+		}
+		e.handleMicroseconds.fetch_add(TimeUtil::tickMicroseconds( ) - start, boost::memory_order_relaxed);
+		e.calls.fetch_add(1, boost::memory_order_relaxed);
+		e.bytes.fetch_add(cmd->size, boost::memory_order_relaxed);
+	}
+	else if( fallback_ )
+	{
+		fallback_(conn, cmd);
+	}
+	else
+	{
+		unknown_.fetch_add(1, boost::memory_order_relaxed);
+	}
+}
+
+bool CmdDispatcher::stat(uint32_t id, CmdStat& out)
+{
+	if( id >= (uint32_t)kMaxCmdId || !entries_[id].handler )
+		return false;
+
+	Entry& e = entries_[id];
+	out.name = e.name;
+	out.id = id;
+	out.calls = e.calls.load(boost::memory_order_relaxed);
+	out.bytes = e.bytes.load(boost::memory_order_relaxed);
+	out.handleMicroseconds = e.handleMicroseconds.load(boost::memory_order_relaxed);
+	out.rejects = e.rejects.load(boost::memory_order_relaxed);
+	return true;
+}
+
+int32_t CmdDispatcher::exportStats(bstd::vector<CmdStat>& out)
+{
+	CmdStat st;
+	for(uint32_t id = 1; id < (uint32_t)kMaxCmdId; id++)
+	{
+		if( stat(id, st) )
+			out.push_back(st);
+	}
+	return (int32_t)out.size();
+}
+
+void CmdDispatcher::dumpStats( )
+{
+	bstd::vector<CmdStat> stats;
+	exportStats(stats);
+	for(size_t i = 0; i < stats.size(); i++)
+	{
+		const CmdStat& st = stats[i];
+		LOGI("cmd %-24s id=%u calls=%lld bytes=%lld avg=%lldus rejects=%lld", st.name, st.id,
+			st.calls, st.bytes, st.calls > 0 ? st.handleMicroseconds / st.calls : 0, st.rejects);
+	}
+	LOGI("cmd unknown=%lld", unknownCmds( ));
+}
+
+BASE_NAME_SPACEE
@@ -0,0 +1,90 @@
+#ifndef CMD_DISPATCHER_H
+#define CMD_DISPATCHER_H
+
+#include <PreCompier.h>
+
+BASE_NAME_SPACES
+
+//////////////////////////////////////////////////////////////////////////
+// flat dispatch table for CMD_START_ID commands.
+// register every handler before TcpServer::start( ), dispatch( ) is lock free.
+// ids outside the table (the hashed ids of CMD_START) go to the fallback callback.
+class CmdDispatcher : boost::noncopyable
+{
+public:
+	enum { kMaxCmdId = 1024 };
+
+	struct CmdStat
+	{
+		const char* name;
+		uint32_t id;
+		int64_t calls;
+		int64_t bytes;
+		int64_t handleMicroseconds;
+		int64_t rejects;
+	};
+public:
+	CmdDispatcher( );
+	~CmdDispatcher( );
+public:
+	// variableSize: accept any size in [sizeof(tagCmd), sizeof(CMD)], for commands
+	// whose tail is trimmed on send; otherwise size must equal sizeof(CMD).
+	// a trimmed frame reaches the handler as a zero-filled CMD copy.
+	template<typename CMD>
+	void registerHandler(const boost::function<void (const TcpConnectionPtr&, const CMD*)>& handler, bool variableSize = false)
+	{
+		BOOST_STATIC_ASSERT((int32_t)CMD::kCmdId > 0 && (int32_t)CMD::kCmdId < (int32_t)kMaxCmdId);
+		registerRaw(CMD::kCmdId, CMD::cmdName( ),
+			variableSize ? (int32_t)sizeof(tagCmd) : (int32_t)sizeof(CMD), (int32_t)sizeof(CMD),
+			boost::bind(&CmdDispatcher::invoke<CMD>, handler, _1, _2));
+	}
+
+	// for frames with their own variable-length layout (e.g. rpc), size in [minSize, maxSize].
+	void registerRaw(uint32_t id, const char* name, int32_t minSize, int32_t maxSize, const MessageCallback& handler);
+
+	void setFallbackCallback(const MessageCallback& cb) { fallback_ = cb; }
+
+	// bind as the MessageCallback of TcpServer/TcpClient.
+	void dispatch(const TcpConnectionPtr& conn, const tagCmd* cmd);
+public:
+	bool stat(uint32_t id, CmdStat& out);
+	int32_t exportStats(bstd::vector<CmdStat>& out);
+	void dumpStats( );
+	int64_t unknownCmds( ) { return unknown_.load(boost::memory_order_relaxed); }
+private:
+	template<typename CMD>
+	static void invoke(const boost::function<void (const TcpConnectionPtr&, const CMD*)>& handler,
+		const TcpConnectionPtr& conn, const tagCmd* cmd)
+	{
+		if( cmd->size >= (int32_t)sizeof(CMD) )
+		{
+			handler(conn, static_cast<const CMD*>(cmd));
+			return;
+		}
+		// the frame ends before CMD does, never read past it
+		CMD full;
+		memcpy(&full, cmd, cmd->size);
+		handler(conn, &full);
+	}
+private:
+	struct Entry
+	{
+		Entry( ) : name(NULL), minSize(0), maxSize(0), calls(0), bytes(0), handleMicroseconds(0), rejects(0) { }
+		MessageCallback handler;
+		const char* name;
+		int32_t minSize;
+		int32_t maxSize;
+		boost::atomic<int64_t> calls;
+		boost::atomic<int64_t> bytes;
+		boost::atomic<int64_t> handleMicroseconds;
+		boost::atomic<int64_t> rejects;
+	};
+
+	Entry entries_[kMaxCmdId];
+	MessageCallback fallback_;
+	boost::atomic<int64_t> unknown_;
+};
+
+BASE_NAME_SPACEE
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef CONNECTION_REGISTRY_H
+#define CONNECTION_REGISTRY_H
+
+#include <PreCompier.h>
+
+BASE_NAME_SPACES
+
+//////////////////////////////////////////////////////////////////////////
+// lock-striped slot map of live connections.
+// id = (generation << 32) | (localSlot << kShardBits | shard), 0 is invalid.
+// a removed slot bumps its generation, so a stale id never hits a reused slot.
+class ConnectionRegistry : boost::noncopyable
+{
+public:
+	static const int32_t kShardBits = 4;
+	static const int32_t kShardSize = 1 << kShardBits;
+	static const int32_t kShardMask = kShardSize - 1;
+	static const int64_t kInvalidId = 0;
+public:
+	explicit ConnectionRegistry(int32_t capacity = 0) : size_(0), nextShard_(0)
+	{
+		int32_t perShard = (capacity + kShardMask) / kShardSize;
+		for(int32_t i = 0; i < kShardSize; i++)
+			shards_[i].slots_.reserve(perShard);
+	}
+public:
+	// allocate a new id for conn.
+	int64_t add(const TcpConnectionPtr& conn)
+	{
+		_Assert(conn, "null connection.");
+		uint32_t shard = (uint32_t)nextShard_.addAndGet() & kShardMask;
+		Shard& s = shards_[shard];
+		ScopedLock lock(s.lock_);
+		uint32_t local = 0;
+		if( !s.free_.empty() )
+		{
+			local = s.free_.back();
+			s.free_.pop_back();
+		}
+		else
+		{
+			local = (uint32_t)s.slots_.size();
+			s.slots_.push_back(Slot());
+		}
+		Slot& slot = s.slots_[local];
+		slot.conn_ = conn;
+		size_.addAndGet();
+		return makeId(slot.generation_, (local << kShardBits) | shard);
+	}
+
+	// mirror an id allocated by another registry (e.g. TcpServer -> LServer).
+	// a registry is filled either by add() or by attach(), never both.
+	bool attach(int64_t id, const TcpConnectionPtr& conn)
+	{
+		if( id == kInvalidId || !conn )
+			return false;
+		uint32_t index = slotIndex(id);
+		Shard& s = shards_[index & kShardMask];
+		uint32_t local = index >> kShardBits;
+		ScopedLock lock(s.lock_);
+		if( local >= s.slots_.size() )
+			s.slots_.resize(local + 1);
+		Slot& slot = s.slots_[local];
+		if( slot.conn_ )
+			return false;
+		slot.conn_ = conn;
+		slot.generation_ = generation(id);
+		size_.addAndGet();
+		return true;
+	}
+
+	bool remove(int64_t id)
+	{
+		if( id == kInvalidId )
+			return false;
+		uint32_t index = slotIndex(id);
+		Shard& s = shards_[index & kShardMask];
+		uint32_t local = index >> kShardBits;
+		TcpConnectionPtr holder;	// released outside the shard lock
+		{
+			ScopedLock lock(s.lock_);
+			if( local >= s.slots_.size() )
+				return false;
+			Slot& slot = s.slots_[local];
+			if( !slot.conn_ || slot.generation_ != generation(id) )
+				return false;
+			holder.swap(slot.conn_);
+			if( ++slot.generation_ == 0 )
+				slot.generation_ = 1;
+			s.free_.push_back(local);
+		}
+		size_.subAndGet();
+		return true;
+	}
+
+	TcpConnectionPtr find(int64_t id)
+	{
+		if( id == kInvalidId )
+			return TcpConnectionPtr();
+		uint32_t index = slotIndex(id);
+		Shard& s = shards_[index & kShardMask];
+		uint32_t local = index >> kShardBits;
+		ScopedLock lock(s.lock_);
+		if( local < s.slots_.size() && s.slots_[local].generation_ == generation(id) )
+			return s.slots_[local].conn_;
+		return TcpConnectionPtr();
+	}
+
+	int32_t size( ) { return (int32_t)size_.get(); }
+
+	// the slots stay with their generations bumped, so an id from before
+	// the clear never matches a connection added after it.
+	void clear( )
+	{
+		for(int32_t i = 0; i < kShardSize; i++)
+		{
+			Shard& s = shards_[i];
+			bstd::vector<TcpConnectionPtr> holders;	// released outside the shard lock
+			{
+				ScopedLock lock(s.lock_);
+				s.free_.clear();
+				for(uint32_t n = (uint32_t)s.slots_.size(); n > 0; n--)
+				{
+					Slot& slot = s.slots_[n - 1];
+					if( slot.conn_ )
+					{
+						holders.push_back(slot.conn_);
+						slot.conn_.reset();
+						size_.subAndGet();
+					}
+					if( ++slot.generation_ == 0 )
+						slot.generation_ = 1;
+					s.free_.push_back(n - 1);
+				}
+			}
+		}
+	}
+
+	// only one shard is locked at a time, and only while its live entries are copied;
+	// fn runs unlocked, so add/remove (accept, close) never wait on a full sweep.
+	template<typename Fn>
+	void forEach(Fn fn)
+	{
+		bstd::vector<TcpConnectionPtr> snapshot;
+		for(int32_t i = 0; i < kShardSize; i++)
+		{
+			snapshot.clear();
+			{
+				Shard& s = shards_[i];
+				ScopedLock lock(s.lock_);
+				for(size_t n = 0; n < s.slots_.size(); n++)
+				{
+					if( s.slots_[n].conn_ )
+						snapshot.push_back(s.slots_[n].conn_);
+				}
+			}
+			for(size_t n = 0; n < snapshot.size(); n++)
+				fn(snapshot[n]);
+		}
+	}
+private:
+	static int64_t makeId(uint32_t gen, uint32_t index) { return ((int64_t)gen << 32) | (int64_t)index; }
+	static uint32_t generation(int64_t id) { return (uint32_t)((uint64_t)id >> 32); }
+	static uint32_t slotIndex(int64_t id) { return (uint32_t)((uint64_t)id & 0xffffffff); }
+private:
+	struct Slot
+	{
+		Slot( ) : generation_(1) { }
+		TcpConnectionPtr conn_;
+		uint32_t generation_;
+	};
+
+	struct Shard
+	{
+		Mutex lock_;
+		bstd::vector<Slot> slots_;
+		bstd::vector<uint32_t> free_;
+	};
+
+	Shard shards_[kShardSize];
+	AtomicInt32 size_;
+	AtomicInt32 nextShard_;
+};
+
+BASE_NAME_SPACEE
+
+#endif
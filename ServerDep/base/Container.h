@@ -1,5 +1,8 @@
 #ifndef BASE_CONTAINER_H
 #define BASE_CONTAINER_H
+#include <boost/atomic.hpp>
+#include <boost/unordered_map.hpp>
+
 //////////////////////////////////////////////////////////////////////////
 template<typename Type, int32_t SizeMax>
 class TArray
@@ -348,6 +351,7 @@ class TSMap
 {
 public:
 	typedef boost::container::map<KeyType, ValueType> _mapImpl;
+	typedef typename _mapImpl::iterator TMapIterator;
 public:
 	//! Ԫ
 	void add(KeyType key, ValueType value)
@@ -631,4 +635,244 @@ private:
 	typename _mapImpl::iterator m_it;
 };
 //////////////////////////////////////////////////////////////////////////
+/* TSList for cross-thread hand-offs, many producers and one consumer
+** (several consumers take turns on LockType). pushBack is one exchange and
+** never waits. only the consumer frees nodes, and only one whose successor
+** is linked, so no producer touches freed memory. a producer between its
+** exchange and its link hides its element and every one pushed after it
+** until the link is made. size counts an element once it is linked, but
+** those hidden behind it are counted too: popFront may fail while size > 0. */
+template<typename Type, typename LockType = Mutex> 
+class TSQueue
+{
+	struct Node
+	{
+		Node( ) : next(NULL) { }
+		explicit Node(const Type& val) : value(val), next(NULL) { }
+
+		Type value;
+		boost::atomic<Node*> next;
+	};
+public:
+	// any thread
+	void pushBack(const Type& val)
+	{
+		Node* node = new Node(val);
+		Node* prev = tail_.exchange(node, boost::memory_order_acq_rel);
+		prev->next.store(node, boost::memory_order_release);
+		// after the link: the consumer may pop it first, size reads one low meanwhile
+		size_.fetch_add(1, boost::memory_order_release);
+	}
+
+	// consumer: gives back what popFront returned, it comes out first again
+	void pushFront(const Type& val)
+	{
+		ScopedLock lock(lock_);
+		front_.push_back(val);
+		size_.fetch_add(1, boost::memory_order_relaxed);
+	}
+
+	Type popFront()
+	{
+		Type val;
+		ScopedLock lock(lock_);
+		popFrontLocked(val);
+		return val;
+	}
+
+	bool popFront(Type& val)
+	{
+		ScopedLock lock(lock_);
+		return popFrontLocked(val);
+	}
+
+	void clear()
+	{
+		ScopedLock lock(lock_);
+		Type val;
+		while( popFrontLocked(val) );
+	}
+
+	int32_t	sizeUnSafe() { return size_.load(boost::memory_order_relaxed); }
+	int32_t	size() { return size_.load(boost::memory_order_acquire); }
+
+	// consumer: popFront would return an element now
+	bool frontReady()
+	{
+		ScopedLock lock(lock_);
+		return !front_.empty() || head_->next.load(boost::memory_order_acquire) != NULL;
+	}
+
+	explicit TSQueue() : size_(0)
+	{
+		head_ = new Node( );
+		tail_.store(head_);
+	}
+	~TSQueue()
+	{
+		clear( );
+		delete head_;
+	}
+private:
+	bool popFrontLocked(Type& val)
+	{
+		if( !front_.empty() )
+		{
+			val = front_.back( );
+			front_.pop_back( );
+			size_.fetch_sub(1, boost::memory_order_relaxed);
+			return true;
+		}
+
+		// head_ is a consumed node (or the first stub), its successor is the front
+		Node* next = head_->next.load(boost::memory_order_acquire);
+		if( next == NULL )
+			return false;
+		val = next->value;
+		next->value = Type( );
+		delete head_;
+		head_ = next;
+		size_.fetch_sub(1, boost::memory_order_relaxed);
+		return true;
+	}
+private:
+	TSQueue(const TSQueue&);
+	TSQueue& operator=(const TSQueue&);
+private:
+	boost::atomic<Node*> tail_;
+	char pad_[64];		// producers' line apart from the consumer's
+	Node* head_;
+	bstd::vector<Type> front_;
+	boost::atomic<int32_t> size_;
+	LockType lock_;
+};
+//////////////////////////////////////////////////////////////////////////
+/* TSMap split into STRIPES hash maps with a lock each: threads on different
+** keys rarely meet on a lock, and the exports copy one stripe at a time
+** instead of holding the whole map. the order is not a key order. */
+template<typename KeyType, typename ValueType, int32_t STRIPES = 16, typename LockType = Mutex> 
+class TSHashMap
+{
+public:
+	typedef boost::unordered_map<KeyType, ValueType> _mapImpl;
+	typedef typename _mapImpl::iterator TMapIterator;
+private:
+	BOOST_STATIC_ASSERT((STRIPES & (STRIPES - 1)) == 0);
+
+	struct Stripe
+	{
+		LockType lock;
+		_mapImpl map;
+		char pad[64];		// the next stripe's lock on another cache line
+	};
+public:
+	void add(KeyType key, ValueType value)
+	{
+		Stripe& s = stripe(key);
+		ScopedLock lock(s.lock);
+		if( s.map.insert(std::pair<KeyType, ValueType>(key, value)).second )
+			size_.fetch_add(1, boost::memory_order_relaxed);
+	}
+
+	ValueType peek(KeyType key)
+	{
+		Stripe& s = stripe(key);
+		ScopedLock lock(s.lock);
+		ValueType temp;
+		TMapIterator it = s.map.find(key);
+		if( it != s.map.end() )
+		{
+			temp = it->second;
+		}
+		return temp;
+	}
+
+	bool changeValue(KeyType key, ValueType new_value)
+	{
+		Stripe& s = stripe(key);
+		ScopedLock lock(s.lock);
+		TMapIterator it = s.map.find(key);
+		if( it != s.map.end() )
+		{
+			it->second = new_value;
+			return true;
+		}
+		return false;
+	}
+
+	bool isExist(KeyType key)
+	{
+		Stripe& s = stripe(key);
+		ScopedLock lock(s.lock);
+		return s.map.find(key) != s.map.end();
+	}
+
+	bool erase(KeyType key)
+	{
+		Stripe& s = stripe(key);
+		ScopedLock lock(s.lock);
+		if( s.map.erase(key) > 0 )
+		{
+			size_.fetch_sub(1, boost::memory_order_relaxed);
+			return true;
+		}
+		return false;
+	}
+
+	void clear()
+	{
+		for( int32_t i = 0; i < STRIPES; i++ )
+		{
+			ScopedLock lock(stripes_[i].lock);
+			size_.fetch_sub((int32_t)stripes_[i].map.size(), boost::memory_order_relaxed);
+			stripes_[i].map.clear();
+		}
+	}
+
+	int32_t	sizeUnSafe() { return size_.load(boost::memory_order_relaxed); }
+	int32_t	size() { return size_.load(boost::memory_order_acquire); }
+
+	template<class OutList>
+	int32_t exportAllKey(OutList& listDest)
+	{
+		int32_t n = 0;
+		for( int32_t i = 0; i < STRIPES; i++ )
+		{
+			ScopedLock lock(stripes_[i].lock);
+			for( TMapIterator it = stripes_[i].map.begin(); it != stripes_[i].map.end(); ++it, ++n )
+				listDest.push_back(it->first);
+		}
+		return n;
+	}
+
+	template<class OutList>
+	int32_t exportAllValue(OutList& listDest)
+	{
+		int32_t n = 0;
+		for( int32_t i = 0; i < STRIPES; i++ )
+		{
+			ScopedLock lock(stripes_[i].lock);
+			for( TMapIterator it = stripes_[i].map.begin(); it != stripes_[i].map.end(); ++it, ++n )
+				listDest.push_back(it->second);
+		}
+		return n;
+	}
+
+	explicit TSHashMap() : size_(0) {  }
+	~TSHashMap()	{ }
+private:
+	Stripe& stripe(const KeyType& key)
+	{
+		size_t h = boost::hash<KeyType>()(key);
+		// the maps inside use the low bits, the stripe takes mixed ones
+		return stripes_[(h ^ (h >> 8) ^ (h >> 16)) & (STRIPES - 1)];
+	}
+private:
+	TSHashMap(const TSHashMap&);
+	TSHashMap& operator=(const TSHashMap&);
+private:
+	Stripe stripes_[STRIPES];
+	boost::atomic<int32_t> size_;
+};
+//////////////////////////////////////////////////////////////////////////
 #endif
\ No newline at end of file
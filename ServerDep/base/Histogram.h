@@ -0,0 +1,112 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <PreCompier.h>
+
+BASE_NAME_SPACES
+
+//////////////////////////////////////////////////////////////////////////
+// hdr-style log-linear histogram: values below kSubCount are exact, above that
+// every power of two is split into kSubCount buckets (<= 12.5% error).
+// record( ) is a relaxed atomic add, so any thread can snapshot while io threads write.
+class Histogram : boost::noncopyable
+{
+public:
+	enum
+	{
+		kSubBits = 3,
+		kSubCount = 1 << kSubBits,
+		kMaxBits = 32,
+		kBucketSize = kSubCount + (kMaxBits - kSubBits) * kSubCount,
+	};
+
+	class Snapshot
+	{
+	public:
+		Snapshot( ) { reset( ); }
+	public:
+		void reset( )
+		{
+			memset(counts, 0, sizeof(counts));
+			count = 0; sum = 0; max = 0;
+		}
+		void merge(const Snapshot& other)
+		{
+			for(int32_t i = 0; i < kBucketSize; i++) counts[i] += other.counts[i];
+			count += other.count;
+			sum += other.sum;
+			if( other.max > max ) max = other.max;
+		}
+		// lower bound of the bucket holding the p-th value, p in [0, 1]
+		int64_t percentile(double p) const
+		{
+			if( count <= 0 ) return 0;
+			int64_t rank = (int64_t)(p * (count - 1)) + 1, seen = 0;
+			for(int32_t i = 0; i < kBucketSize; i++)
+			{
+				seen += counts[i];
+				if( seen >= rank ) return lowerBound(i);
+			}
+			return max;
+		}
+		int64_t mean( ) const { return count > 0 ? sum / count : 0; }
+	public:
+		int64_t counts[kBucketSize];
+		int64_t count;
+		int64_t sum;
+		int64_t max;
+	};
+public:
+	Histogram( ) : sum_(0), max_(0)
+	{
+		for(int32_t i = 0; i < kBucketSize; i++) counts_[i] = 0;
+	}
+public:
+	void record(int64_t value)
+	{
+		if( value < 0 ) value = 0;
+		counts_[index(value)].fetch_add(1, boost::memory_order_relaxed);
+		sum_.fetch_add(value, boost::memory_order_relaxed);
+		int64_t old = max_.load(boost::memory_order_relaxed);
+		while( value > old && !max_.compare_exchange_weak(old, value, boost::memory_order_relaxed) );
+	}
+
+	// adds into @out, so several histograms can be folded into one snapshot.
+	void snapshot(Snapshot& out) const
+	{
+		Snapshot s;
+		for(int32_t i = 0; i < kBucketSize; i++)
+		{
+			s.counts[i] = counts_[i].load(boost::memory_order_relaxed);
+			s.count += s.counts[i];
+		}
+		s.sum = sum_.load(boost::memory_order_relaxed);
+		s.max = max_.load(boost::memory_order_relaxed);
+		out.merge(s);
+	}
+
+	static int32_t index(int64_t value)
+	{
+		if( value < kSubCount ) return (int32_t)value;
+		if( value >= ((int64_t)1 << kMaxBits) ) return kBucketSize - 1;
+		int32_t msb = 0;
+		for(int64_t v = value; v >>= 1; ) ++msb;
+		int32_t shift = msb - kSubBits;
+		return kSubCount + shift * kSubCount + (int32_t)((value >> shift) - kSubCount);
+	}
+
+	static int64_t lowerBound(int32_t idx)
+	{
+		if( idx < kSubCount ) return idx;
+		int32_t shift = (idx - kSubCount) / kSubCount;
+		return (int64_t)(kSubCount + (idx - kSubCount) % kSubCount) << shift;
+	}
+private:
+	boost::atomic<int32_t> counts_[kBucketSize];
+	boost::atomic<int64_t> sum_;
+	boost::atomic<int64_t> max_;
+};
+
+BASE_NAME_SPACEE
+
+#endif
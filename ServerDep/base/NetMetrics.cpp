@@ -0,0 +1,34 @@
+#include <NetMetrics.h>
+
+BASE_NAME_SPACES
+
+void NetMetrics::Snapshot::merge(const Snapshot& other)
+{
+	queueDelayUs.merge(other.queueDelayUs);
+	cmdsPerRead.merge(other.cmdsPerRead);
+	bytesPerWrite.merge(other.bytesPerWrite);
+	compressPercent.merge(other.compressPercent);
+	recvBytes += other.recvBytes;
+	sendBytes += other.sendBytes;
+	recvCmds += other.recvCmds;
+	connections += other.connections;
+}
+
+static void logHistogram(const char* name, const char* what, const Histogram::Snapshot& h)
+{
+	LOGI("%s %s: n=%lld mean=%lld p50=%lld p90=%lld p99=%lld p999=%lld max=%lld", name, what,
+		h.count, h.mean(), h.percentile(0.5), h.percentile(0.9),
+		h.percentile(0.99), h.percentile(0.999), h.max);
+}
+
+void NetMetrics::Snapshot::log(const char* name) const
+{
+	LOGI("%s: connections=%d recvBytes=%lld sendBytes=%lld recvCmds=%lld", name,
+		connections, recvBytes, sendBytes, recvCmds);
+	logHistogram(name, "queueDelayUs", queueDelayUs);
+	logHistogram(name, "cmdsPerRead", cmdsPerRead);
+	logHistogram(name, "bytesPerWrite", bytesPerWrite);
+	logHistogram(name, "compressPercent", compressPercent);
+}
+
+BASE_NAME_SPACEE
@@ -0,0 +1,48 @@
+#ifndef NET_METRICS_H
+#define NET_METRICS_H
+
+#include <PreCompier.h>
+#include <Histogram.h>
+
+BASE_NAME_SPACES
+
+//////////////////////////////////////////////////////////////////////////
+// io metrics of one TcpConnection; TcpServer folds them into a server view.
+class NetMetrics : boost::noncopyable
+{
+public:
+	class Snapshot
+	{
+	public:
+		Snapshot( ) : recvBytes(0), sendBytes(0), recvCmds(0), connections(0) { }
+	public:
+		void merge(const Snapshot& other);
+		void log(const char* name) const;
+	public:
+		Histogram::Snapshot queueDelayUs;	// sendCmd -> write completion, oldest cmd of each write
+		Histogram::Snapshot cmdsPerRead;
+		Histogram::Snapshot bytesPerWrite;
+		Histogram::Snapshot compressPercent;	// compressed/original * 100
+		int64_t recvBytes;
+		int64_t sendBytes;
+		int64_t recvCmds;
+		int32_t connections;
+	};
+public:
+	void snapshot(Snapshot& out) const
+	{
+		queueDelayUs.snapshot(out.queueDelayUs);
+		cmdsPerRead.snapshot(out.cmdsPerRead);
+		bytesPerWrite.snapshot(out.bytesPerWrite);
+		compressPercent.snapshot(out.compressPercent);
+	}
+public:
+	Histogram queueDelayUs;
+	Histogram cmdsPerRead;
+	Histogram bytesPerWrite;
+	Histogram compressPercent;
+};
+
+BASE_NAME_SPACEE
+
+#endif
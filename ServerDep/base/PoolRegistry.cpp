@@ -0,0 +1,79 @@
+#include <PoolRegistry.h>
+
+BASE_NAME_SPACES
+
+void PoolStat::merge(const PoolStat& other)
+{
+	capacity = (capacity < 0 || other.capacity < 0) ? -1 : capacity + other.capacity;
+	inUse += other.inUse;
+	freeCached += other.freeCached;
+	peak += other.peak;		// sum of the parts' peaks, an upper bound
+	allocs += other.allocs;
+	frees += other.frees;
+	misses += other.misses;
+}
+
+void PoolStat::log( ) const
+{
+	LOGI("pool %s: size=%d capacity=%lld inUse=%lld cached=%lld peak=%lld allocs=%lld rate=%0.1f/s misses=%lld",
+		name.c_str(), objectSize, capacity, inUse, freeCached, peak, allocs, allocRate, misses);
+}
+
+int32_t PoolRegistry::add(const bstd::string& name, const PoolStatCallback& cb)
+{
+	ScopedLock lock(lock_);
+	Entry entry;
+	entry.id = ++nextId_;
+	entry.name = name;
+	entry.cb = cb;
+	entry.lastAllocs = 0;
+	entries_.push_back(entry);
+	return entry.id;
+}
+
+void PoolRegistry::remove(int32_t id)
+{
+	ScopedLock lock(lock_);
+	for(int32_t i = 0; i < (int32_t)entries_.size(); i++)
+	{
+		if( entries_[i].id != id ) continue;
+		entries_[i] = entries_.back( );
+		entries_.pop_back( );
+		break;
+	}
+}
+
+void PoolRegistry::snapshot(bstd::vector<PoolStat>& out)
+{
+	out.clear( );
+	ScopedLock lock(lock_);
+	int64_t now = TimeUtil::tickMicroseconds( );
+	double seconds = lastSnapshotUs_ > 0 ? (std::max)(now - lastSnapshotUs_, (int64_t)1) / 1000000.0 : 0.0;
+	lastSnapshotUs_ = now;
+
+	out.resize(entries_.size());
+	for(int32_t i = 0; i < (int32_t)entries_.size(); i++)
+	{
+		Entry& entry = entries_[i];
+		PoolStat& stat = out[i];
+		entry.cb(stat);
+		stat.name = entry.name;
+		stat.allocRate = seconds > 0.0 ? (float)((stat.allocs - entry.lastAllocs) / seconds) : 0.0f;
+		entry.lastAllocs = stat.allocs;
+	}
+}
+
+void PoolRegistry::log(bool leaks)
+{
+	bstd::vector<PoolStat> stats;
+	snapshot(stats);
+	for(int32_t i = 0; i < (int32_t)stats.size(); i++)
+	{
+		if( !leaks )
+			stats[i].log( );
+		else if( stats[i].inUse > 0 )
+			LOGW("pool %s: %lld blocks still in use", stats[i].name.c_str(), stats[i].inUse);
+	}
+}
+
+BASE_NAME_SPACEE
@@ -0,0 +1,62 @@
+#ifndef POOL_REGISTRY_H
+#define POOL_REGISTRY_H
+
+#include <PreCompier.h>
+
+BASE_NAME_SPACES
+
+/* counters of one pool or allocator. for variable sized blocks (objectSize 0)
+** capacity and freeCached are bytes, the other counts are blocks. */
+class PoolStat
+{
+public:
+	PoolStat( ) : objectSize(0), capacity(-1), inUse(0), freeCached(0), peak(0),
+		allocs(0), frees(0), misses(0), allocRate(0.0f) { }
+public:
+	void merge(const PoolStat& other);
+	void log( ) const;
+public:
+	bstd::string name;
+	int32_t objectSize;
+	int64_t capacity;		// -1 unbounded
+	int64_t inUse;
+	int64_t freeCached;		// ready for the next allocation
+	int64_t peak;			// high-water mark of inUse
+	int64_t allocs;
+	int64_t frees;
+	int64_t misses;			// allocations that went to the system heap
+	float allocRate;		// per second since the previous snapshot, filled by PoolRegistry
+};
+
+typedef boost::function<void (PoolStat&)> PoolStatCallback;
+
+/* process wide list of pools, Singleton<PoolRegistry>::instance().
+** a pool adds a callback filling its PoolStat and removes it before it dies. */
+class PoolRegistry : boost::noncopyable
+{
+public:
+	PoolRegistry( ) : nextId_(0), lastSnapshotUs_(0) { }
+public:
+	int32_t add(const bstd::string& name, const PoolStatCallback& cb);
+	void remove(int32_t id);
+	void snapshot(bstd::vector<PoolStat>& out);
+	/* one line per pool; leaks only logs the pools still holding blocks */
+	void log(bool leaks = false);
+private:
+	struct Entry
+	{
+		int32_t id;
+		bstd::string name;
+		PoolStatCallback cb;
+		int64_t lastAllocs;
+	};
+private:
+	Mutex lock_;
+	bstd::vector<Entry> entries_;
+	int32_t nextId_;
+	int64_t lastSnapshotUs_;
+};
+
+BASE_NAME_SPACEE
+
+#endif
@@ -19,6 +19,9 @@
 #define TIME_UNIT_TEST
 #define EXCEPTION_UNIT_TEST
 //#define LOG_UNIT_TEST
+//#define ALLOCATOR_UNIT_TEST
+//#define TCPCMDPOOL_UNIT_TEST
+//#define RPC_UNIT_TEST
 
 // lua
 #define LUA_STRING
@@ -36,6 +39,7 @@
 #endif
 
 //memory
+//#define USE_SELF_POOL
 #ifdef __WINDOWS__
 #if defined(USE_JEMALLOC)
 
@@ -0,0 +1,117 @@
+#ifndef RPC_CHANNEL_H
+#define RPC_CHANNEL_H
+
+#include <PreCompier.h>
+#include <RpcDefine.h>
+#include <TcpConnection.h>
+
+BASE_NAME_SPACES
+
+//////////////////////////////////////////////////////////////////////////
+// client side of a pipelined rpc connection.
+// call( ) and poll( ) belong to one owner thread (a Service tick / invoker);
+// responses are queued by the io thread and handed over in one swap per poll( ),
+// so every DoneCallback runs on the owner thread. any number of calls may be in flight.
+class RpcChannel : boost::noncopyable
+{
+public:
+	typedef boost::function<void (int32_t status)> DoneCallback;
+	typedef boost::function<bool (const char* data, int32_t size)> ParseCallback;
+public:
+	// @maxFrameSize is NetworkConfig::maxLargeCmdSize: a frame above maxCmdSize
+	// goes out in fragments, in its place among the other calls.
+	explicit RpcChannel(int32_t maxFrameSize);
+	~RpcChannel( );
+public:
+	// connection callbacks, any thread.
+	void attach(const TcpConnectionPtr& conn);
+	void detach( );
+	// message callback, io thread.
+	void onMessage(const TcpConnectionPtr& conn, const tagCmd* cmd);
+public:
+	// returns the request id, 0 if done was already called with a failure.
+	// the request is serialized straight into the connection's cmd pool.
+	template<typename Req, typename Resp>
+	int64_t call(uint32_t method, const Req& req, Resp* resp, const DoneCallback& done, int32_t timeoutMs)
+	{
+		int32_t bytes = req.ByteSize( );
+		if( kRpcHeadSize + bytes > maxFrameSize_ )
+		{
+			if( done ) done(kRpcTooLarge);
+			return 0;
+		}
+		int64_t epoch = 0;
+		TcpConnectionPtr conn = connection(epoch);
+		ReservedCmd<tagRpcCmd> cmd;
+		if( conn ) cmd = conn->reserveCmd<tagRpcCmd>(bytes);
+		if( !cmd )
+		{
+			if( done ) done(kRpcClosed);
+			return 0;
+		}
+		if( !req.SerializeToArray(cmd->payload(), bytes) )
+		{
+			if( done ) done(kRpcBadRequest);
+			return 0;
+		}
+		return submit(conn, epoch, method, cmd, boost::bind(&RpcChannel::parseInto<Resp>, resp, _1, _2), done, timeoutMs);
+	}
+
+	// deliver queued responses, expire deadlines; returns the number of completed calls.
+	int32_t poll( );
+	int32_t pendingSize( ) const { return (int32_t)pending_.size(); }
+private:
+	TcpConnectionPtr connection(int64_t& epoch);
+	int64_t submit(const TcpConnectionPtr& conn, int64_t epoch, uint32_t method, const ReservedCmd<tagRpcCmd>& req,
+		const ParseCallback& parse, const DoneCallback& done, int32_t timeoutMs);
+	void complete(int64_t requestId, int32_t status, const char* data, int32_t size);
+	// fails the calls made on connections up to @epoch, returns how many.
+	int32_t failUpTo(int64_t epoch, int32_t status);
+
+	template<typename Resp>
+	static bool parseInto(Resp* resp, const char* data, int32_t size)
+	{
+		return resp == NULL || resp->ParseFromArray(data, size);
+	}
+private:
+	typedef bstd::multimap<int64_t, int64_t> DeadlineMap;
+	struct Pending
+	{
+		ParseCallback parse;
+		DoneCallback done;
+		int64_t epoch;					// connection the request went out on
+		DeadlineMap::iterator deadline;	// erased with the call
+	};
+	struct Reply
+	{
+		int64_t requestId;
+		int32_t status;
+		std::string payload;
+	};
+	typedef boost::shared_ptr<Reply> ReplyPtr;
+	typedef bstd::map<int64_t, Pending> PendingMap;
+
+	int32_t maxFrameSize_;
+	// owner thread
+	int64_t nextRequestId_;
+	PendingMap pending_;
+	DeadlineMap deadlines_;
+	bstd::vector<ReplyPtr> batch_;
+	int64_t failedEpoch_;
+	// shared with io thread. every attach starts a new epoch, a detach
+	// closes all epochs up to the current one: a call fails only when
+	// the connection it went out on is gone, not a newer one.
+	Mutex lock_;
+	TcpConnectionPtr connection_;
+	bstd::vector<ReplyPtr> inbox_;
+	int64_t epoch_;
+	int64_t closedEpoch_;
+};
+
+#ifdef RPC_UNIT_TEST
+AUTOTEST_DEF(RpcUnit);
+#endif
+
+BASE_NAME_SPACEE
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef RPC_DEFINE_H
+#define RPC_DEFINE_H
+
+#include <PreCompier.h>
+#include <CmdDispatcher.h>
+
+BASE_NAME_SPACES
+
+enum RpcStatus
+{
+	kRpcOk = 0,
+	kRpcTimeout,
+	kRpcNoMethod,
+	kRpcBadRequest,
+	kRpcBadResponse,
+	kRpcClosed,
+	kRpcTooLarge,
+};
+
+// the top two dispatcher slots are reserved for rpc frames, the one below
+// them for TcpConnection fragments (kFragmentCmdId).
+enum
+{
+	kRpcRequestCmdId	= CmdDispatcher::kMaxCmdId - 2,
+	kRpcResponseCmdId	= CmdDispatcher::kMaxCmdId - 1,
+};
+
+// wire frame: tagRpcCmd + serialized message(protobuf or anything with the same
+// ByteSize/SerializeToArray/ParseFromArray interface).
+struct tagRpcCmd : tagCmd
+{
+	int64_t requestId;
+	uint32_t method;
+	int32_t status;
+
+	char* payload( ) { return (char*)(this + 1); }
+	const char* payload( ) const { return (const char*)(this + 1); }
+	int32_t payloadSize( ) const { return size - (int32_t)sizeof(tagRpcCmd); }
+};
+
+const static int32_t kRpcHeadSize = sizeof(tagRpcCmd);
+
+// e.g. rpcMethodId("login.Auth")
+inline uint32_t rpcMethodId(const char* fullName) { return crc32(fullName); }
+
+BASE_NAME_SPACEE
+
+#endif
@@ -0,0 +1,66 @@
+#include <RpcServer.h>
+#include <TcpConnection.h>
+
+BASE_NAME_SPACES
+
+RpcServer::RpcServer(int32_t maxFrameSize) : maxFrameSize_(maxFrameSize)
+{
+}
+
+RpcServer::~RpcServer( )
+{
+}
+
+void RpcServer::registerRaw(uint32_t method, const RawMethod& fn)
+{
+	_Verify(methods_.find(method) == methods_.end(), "duplicate rpc method.");
+	methods_[method] = fn;
+}
+
+void RpcServer::bindDispatcher(CmdDispatcher& dispatcher)
+{
+	dispatcher.registerRaw(kRpcRequestCmdId, "rpcRequest", kRpcHeadSize, maxFrameSize_,
+		boost::bind(&RpcServer::onMessage, this, _1, _2));
+}
+
+void RpcServer::onMessage(const TcpConnectionPtr& conn, const tagCmd* cmd)
+{
+	if( cmd->id != (uint32_t)kRpcRequestCmdId || cmd->size < kRpcHeadSize )
+		return;
+
+	const tagRpcCmd* req = static_cast<const tagRpcCmd*>(cmd);
+	std::string out;
+	int32_t status = kRpcNoMethod;
+
+	BOOST_AUTO(it, methods_.find(req->method));
+	if( it != methods_.end() )
+	{
+		_MY_TRY
+		{
+			status = it->second(req->payload(), req->payloadSize(), out);
+		}
+		_MY_CATCH
+		{
+			status = kRpcBadRequest;
+		}
+	}
+
+	if( status != kRpcOk || kRpcHeadSize + (int32_t)out.size() > maxFrameSize_ )
+	{
+		if( status == kRpcOk ) status = kRpcTooLarge;
+		out.clear();
+	}
+
+	ReservedCmd<tagRpcCmd> resp = conn->reserveCmd<tagRpcCmd>((int32_t)out.size());
+	if( !resp )
+		return;
+	resp->id = kRpcResponseCmdId;
+	resp->requestId = req->requestId;
+	resp->method = req->method;
+	resp->status = status;
+	if( !out.empty() )
+		memcpy(resp->payload(), out.data(), out.size());
+	conn->commit(resp);
+}
+
+BASE_NAME_SPACEE
@@ -0,0 +1,55 @@
+#ifndef RPC_SERVER_H
+#define RPC_SERVER_H
+
+#include <PreCompier.h>
+#include <RpcDefine.h>
+
+BASE_NAME_SPACES
+
+//////////////////////////////////////////////////////////////////////////
+// server side: methods run on the io thread that read the request and reply
+// through sendCmd, so replies to pipelined requests leave in one gathered write.
+// register every method before the server starts.
+class RpcServer : boost::noncopyable
+{
+public:
+	typedef boost::function<int32_t (const char* data, int32_t size, std::string& out)> RawMethod;
+public:
+	// @maxFrameSize is NetworkConfig::maxLargeCmdSize, requests and replies
+	// above maxCmdSize travel in fragments.
+	explicit RpcServer(int32_t maxFrameSize);
+	~RpcServer( );
+public:
+	template<typename Req, typename Resp>
+	void registerMethod(uint32_t method, const boost::function<int32_t (const Req&, Resp&)>& fn)
+	{
+		registerRaw(method, boost::bind(&RpcServer::invoke<Req, Resp>, fn, _1, _2, _3));
+	}
+	void registerRaw(uint32_t method, const RawMethod& fn);
+
+	// route kRpcRequestCmdId frames of @dispatcher here.
+	void bindDispatcher(CmdDispatcher& dispatcher);
+	void onMessage(const TcpConnectionPtr& conn, const tagCmd* cmd);
+private:
+	template<typename Req, typename Resp>
+	static int32_t invoke(const boost::function<int32_t (const Req&, Resp&)>& fn,
+		const char* data, int32_t size, std::string& out)
+	{
+		Req req;
+		if( !req.ParseFromArray(data, size) )
+			return kRpcBadRequest;
+		Resp resp;
+		int32_t status = fn(req, resp);
+		if( status == kRpcOk && !resp.SerializeToString(&out) )
+			return kRpcBadResponse;
+		return status;
+	}
+private:
+	typedef bstd::map<uint32_t, RawMethod> MethodMap;
+	MethodMap methods_;
+	int32_t maxFrameSize_;
+};
+
+BASE_NAME_SPACEE
+
+#endif
@@ -6,9 +6,10 @@ BASE_NAME_SPACES
  TcpClient::TcpClient(basio::io_service& service, basio::ip::tcp::endpoint addr, const bstd::string& name, const NetworkConfig& config)
  :service_(service), serverAddr_(addr), name_(name),netConfig_(config),state_(kDisconnected)
 #if defined(USE_SELF_POOL)
- ,tcpCmdPoolArray_(new TcpCmdPoolArray(config.maxCmdPoolNumber, config.maxCmdPoolSize, config.maxCmdSize))
+ ,tcpCmdPoolArray_(new TcpCmdPoolArray(config.maxCmdPoolNumber, config.maxCmdPoolSize, config.maxCmdSize, name + ".cmd"))
 #endif
  {
+	TcpConnection::checkConfig(netConfig_);
 #if defined(USE_SELF_POOL)
 	cmdAllocateCallback_ = boost::bind(&TcpCmdPoolArray::allocate, tcpCmdPoolArray_.get(), _1, _2);
 #else
@@ -0,0 +1,208 @@
+#include <TcpCmdPool.h>
+
+BASE_NAME_SPACES
+
+LargeCmdPool::LargeCmdPool( ) : cachedBytes_(0), maxCachedBytes_(kDefaultMaxCachedBytes)
+	, allocs_(0), frees_(0), misses_(0), peak_(0)
+{
+	statId_ = Singleton<PoolRegistry>::instance().add("LargeCmdPool", boost::bind(&LargeCmdPool::stat, this, _1));
+}
+
+LargeCmdPool::~LargeCmdPool( )
+{
+	Singleton<PoolRegistry>::instance().remove(statId_);
+	if( allocs_ > frees_ )
+		LOGW("pool LargeCmdPool: %lld cmds still in use", allocs_ - frees_);
+	setMaxCachedBytes(0);
+}
+
+int32_t LargeCmdPool::classOf(int32_t bytes)
+{
+	int32_t cls = 0;
+	while( cls < kClassSize && ((int64_t)1 << (kMinShift + cls)) < bytes ) ++cls;
+	return cls;
+}
+
+CmdPtr LargeCmdPool::allocate(int32_t bytes)
+{
+	int32_t cls = classOf(bytes);
+	if( bytes <= 0 || cls >= kClassSize )
+		return CmdPtr();
+
+	void* p = NULL;
+	{
+		ScopedLock lock(lock_);
+		if( !free_[cls].empty() )
+		{
+			p = free_[cls].back( );
+			free_[cls].pop_back( );
+			cachedBytes_ -= (int64_t)1 << (kMinShift + cls);
+		}
+		else
+		{
+			++misses_;
+		}
+		if( ++allocs_ - frees_ > peak_ ) peak_ = allocs_ - frees_;
+	}
+	if( !p ) p = zmalloc((size_t)1 << (kMinShift + cls));
+	if( !p )
+	{
+		ScopedLock lock(lock_);
+		--allocs_;
+		return CmdPtr();
+	}
+	return CmdPtr(new(p)tagCmd, boost::bind(&LargeCmdPool::deallocate, this, _1, cls));
+}
+
+void LargeCmdPool::deallocate(void* p, int32_t cls)
+{
+	int64_t bytes = (int64_t)1 << (kMinShift + cls);
+	{
+		ScopedLock lock(lock_);
+		++frees_;
+		if( cachedBytes_ + bytes <= maxCachedBytes_ )
+		{
+			free_[cls].push_back(p);
+			cachedBytes_ += bytes;
+			return;
+		}
+	}
+	zfree(p);
+}
+
+void LargeCmdPool::setMaxCachedBytes(int64_t bytes)
+{
+	ScopedLock lock(lock_);
+	maxCachedBytes_ = bytes;
+	for(int32_t cls = kClassSize - 1; cls >= 0 && cachedBytes_ > maxCachedBytes_; cls--)
+	{
+		while( !free_[cls].empty() && cachedBytes_ > maxCachedBytes_ )
+		{
+			void* p = free_[cls].back( );
+			free_[cls].pop_back( );
+			cachedBytes_ -= (int64_t)1 << (kMinShift + cls);
+			zfree(p);
+		}
+	}
+}
+
+int64_t LargeCmdPool::cachedBytes( )
+{
+	ScopedLock lock(lock_);
+	return cachedBytes_;
+}
+
+void LargeCmdPool::stat(PoolStat& out)
+{
+	ScopedLock lock(lock_);
+	out.objectSize = 0;
+	out.capacity = maxCachedBytes_;
+	out.freeCached = cachedBytes_;
+	out.allocs = allocs_;
+	out.frees = frees_;
+	out.inUse = allocs_ - frees_;
+	out.peak = peak_;
+	out.misses = misses_;
+}
+
+#if defined(USE_SELF_POOL) && defined(TCPCMDPOOL_UNIT_TEST)
+
+/* 8 io threads allocate commands at 1M msgs/s in total and hand them to one
+** logic thread, which drops them: every free is a remote free. */
+#define BENCH_IOTHREAD	(8)
+#define BENCH_RATE		(1000*1000)
+#define BENCH_SECONDS	(5)
+#define BENCH_MAXCMD	(512)
+
+typedef boost::function<CmdPtr (int64_t, int32_t)> BenchAllocator;
+
+struct BenchState
+{
+	BenchState( ) : stop(0), produced(0), allocMicroseconds(0), maxBacklog(0) { }
+	TSList<CmdPtr> queue;
+	boost::atomic<int32_t> stop;
+	boost::atomic<int64_t> produced;
+	boost::atomic<int64_t> allocMicroseconds;
+	boost::atomic<int32_t> maxBacklog;
+};
+
+static CmdPtr mallocCmd(int64_t, int32_t bytes)
+{
+	return CmdPtr(new(::malloc(bytes))tagCmd, ::free);
+}
+
+static void ioThread(BenchState* st, BenchAllocator alloc, int32_t idx)
+{
+	RandUitl rnd(idx + 1);
+	const int64_t perMs = BENCH_RATE / BENCH_IOTHREAD / 1000;
+	int64_t start = TimeUtil::tickMicroseconds( ), sent = 0, spent = 0;
+	while( !st->stop.load(boost::memory_order_relaxed) )
+	{
+		int64_t due = (TimeUtil::tickMicroseconds( ) - start) / 1000 * perMs;
+		if( sent >= due )
+		{
+			thisThreadSleep(0);
+			continue;
+		}
+		int64_t t0 = TimeUtil::tickMicroseconds( );
+		for( ; sent < due; sent++)
+		{
+			int32_t bytes = sizeof(tagCmd) + rnd.rand() % (BENCH_MAXCMD - sizeof(tagCmd));
+			CmdPtr cmd = alloc(idx, bytes);
+			cmd->size = bytes;
+			st->queue.pushBack(cmd);
+		}
+		spent += TimeUtil::tickMicroseconds( ) - t0;
+	}
+	st->produced.fetch_add(sent, boost::memory_order_relaxed);
+	st->allocMicroseconds.fetch_add(spent, boost::memory_order_relaxed);
+}
+
+static void logicThread(BenchState* st)
+{
+	CmdPtr cmd;
+	while( !st->stop.load(boost::memory_order_relaxed) || st->queue.sizeUnSafe() > 0 )
+	{
+		int32_t backlog = st->queue.sizeUnSafe();
+		if( backlog > st->maxBacklog.load(boost::memory_order_relaxed) )
+			st->maxBacklog.store(backlog, boost::memory_order_relaxed);
+		if( !st->queue.popFront(cmd) )
+			thisThreadSleep(0);
+		cmd.reset();
+	}
+}
+
+static void bench(BenchAllocator alloc, const char* name)
+{
+	BenchState st;
+	boost::thread_group threads;
+	threads.create_thread(boost::bind(&logicThread, &st));
+	for(int32_t i = 0; i < BENCH_IOTHREAD; i++)
+		threads.create_thread(boost::bind(&ioThread, &st, alloc, i));
+
+	int64_t start = TimeUtil::tickMicroseconds( );
+	thisThreadSleep(BENCH_SECONDS * 1000);
+	st.stop.store(1);
+	threads.join_all( );
+	double elapse = (TimeUtil::tickMicroseconds( ) - start) / 1000000.0;
+
+	int64_t produced = st.produced.load( );
+	// csv: cmdpool,impl,msgs/sec,enqueue ns/msg,max backlog
+	fprintf(stdout, "cmdpool,%s,%0.0f,%0.1f,%d\n", name, produced / elapse,
+		produced > 0 ? st.allocMicroseconds.load() * 1000.0 / produced : 0.0, st.maxBacklog.load());
+}
+
+void tcpCmdPoolUT(void*)
+{
+	{
+		TcpCmdPoolArray pools(BENCH_IOTHREAD + 1, 4 * 1024 * 1024, BENCH_MAXCMD);
+		bench(boost::bind(&TcpCmdPoolArray::allocate, &pools, _1, _2), "pool");
+	}
+	bench(&mallocCmd, "malloc");
+}
+
+AUTOTEST_IMP(TcpCmdPoolUnit, tcpCmdPoolUT);
+
+#endif
+
+BASE_NAME_SPACEE
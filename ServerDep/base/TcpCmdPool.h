@@ -9,6 +9,8 @@ BASE_NAME_SPACES
 #if defined(USE_SELF_POOL)
 typedef boost::function<void (void*)> cmdFreeCallback;
 
+/* any thread allocates and frees: the allocator's thread caches keep the
+** io thread that allocates and the logic thread that frees off each other. */
 class TcpCmdPool
 {
 public:
@@ -47,6 +49,7 @@ public:
 		if( cmd ) allocator_.freeZ( cmd );
 	}
 
+	void stat(PoolStat& out) const { allocator_.stat(out); }
 private:
 	int32_t minSizeOfMax(int32_t maxMsgSize)
 	{
@@ -65,39 +68,56 @@ public:
 class TcpCmdPoolArray
 {
 public:
-	TcpCmdPoolArray(int32_t poolNumber, int32_t poolSize, int32_t maxMsgSize)
+	TcpCmdPoolArray(int32_t poolNumber, int32_t poolSize, int32_t maxMsgSize, const bstd::string& name = "TcpCmdPool")
+		: name_(name)
 	{
 		for(int32_t i = 0; i < poolNumber; i++)
 		{
 			cmdPools_.push_back( CmdPoolPtr(new TcpCmdPool(poolSize, maxMsgSize)));
 		}
+		statId_ = Singleton<PoolRegistry>::instance().add(name_, boost::bind(&TcpCmdPoolArray::stat, this, _1));
+	}
+	~TcpCmdPoolArray( )
+	{
+		Singleton<PoolRegistry>::instance().remove(statId_);
+		PoolStat st;
+		stat(st);
+		if( st.inUse > 0 )
+			LOGW("pool %s: %lld cmds still in use", name_.c_str(), st.inUse);
 	}
 
 public:
+	// @key spreads the connections over the pools
 	CmdPtr allocate(int64_t key, int32_t bytes)
 	{
-#if defined(USE_JEMALLOC)
-		void* p = je_malloc(bytes);
-		return CmdPtr(new(p)tagCmd, je_free);
-#elif defined(USE_TCMALLOC)
-		void* p = malloc(bytes);
-		return CmdPtr(new(p)tagCmd, free);
-#elif defined(SELF_POOL)
-		int32_t idx = key % (int32_t)cmdPools_.size();
+		int32_t idx = (int32_t)((uint64_t)key % cmdPools_.size());
 		return cmdPools_.at(idx)->allocate(bytes);
-#else
-		void* p = ::malloc(bytes);
-		return CmdPtr(new(p)tagCmd, free);
-#endif
 	}
 
-
+	int32_t poolSize( ) const { return (int32_t)cmdPools_.size(); }
+	// all pools of the array as one
+	void stat(PoolStat& out) const
+	{
+		for(int32_t i = 0; i < (int32_t)cmdPools_.size(); i++)
+		{
+			PoolStat st;
+			cmdPools_[i]->stat(st);
+			if( i == 0 ) out = st;
+			else out.merge(st);
+		}
+	}
 
 private:
 	typedef boost::shared_ptr<TcpCmdPool> CmdPoolPtr;
 	bstd::vector<CmdPoolPtr> cmdPools_;
+	bstd::string name_;
+	int32_t statId_;
 };
 
+#ifdef TCPCMDPOOL_UNIT_TEST
+AUTOTEST_DEF(TcpCmdPoolUnit);
+#endif
+
 #else
 inline CmdPtr cmdAllocate(int64_t key, int32_t bytes)
 {
@@ -107,6 +127,38 @@ inline CmdPtr cmdAllocate(int64_t key, int32_t bytes)
 }
 #endif
 
+/* process wide power-of-two buffers for cmds above NetworkConfig::maxCmdSize,
+** used by TcpConnection both to send and to reassemble them, so connections
+** that never carry a large cmd keep only their small buffers. */
+class LargeCmdPool : boost::noncopyable
+{
+public:
+	enum { kMinShift = 10, kMaxShift = 30, kClassSize = kMaxShift - kMinShift + 1 };
+	const static int64_t kDefaultMaxCachedBytes = 64 * 1024 * 1024;
+public:
+	LargeCmdPool( );
+	~LargeCmdPool( );
+public:
+	CmdPtr allocate(int32_t bytes);
+	// freed buffers beyond this are returned to the system.
+	void setMaxCachedBytes(int64_t bytes);
+	int64_t cachedBytes( );
+	void stat(PoolStat& out);
+private:
+	void deallocate(void* p, int32_t cls);
+	static int32_t classOf(int32_t bytes);
+private:
+	Mutex lock_;
+	bstd::vector<void*> free_[kClassSize];
+	int64_t cachedBytes_;
+	int64_t maxCachedBytes_;
+	int64_t allocs_;
+	int64_t frees_;
+	int64_t misses_;
+	int64_t peak_;
+	int32_t statId_;
+};
+
 BASE_NAME_SPACEE
 
 #endif // TCPCMD_POOL_H
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include <TcpConnection.h>
+#include <Singleton.h>
 #include <lzf/lzf.h>
 
 BASE_NAME_SPACES
@@ -6,40 +7,41 @@ BASE_NAME_SPACES
 AtomicInt32 TcpConnection::sRecvCmdSizeAll;
 
 TcpConnection::TcpConnection(basio::io_service& service, const bstd::string &name, const NetworkConfig& config)
-:service_(service), socket_(service), name_(name)
+:service_(service), socket_(service), name_(name), id_(0)
 ,netConfig_(config)
 ,sendBuffer_(kPreHeadSize, config.sendBufferSize)
 ,recvBuffer_(kPreHeadSize, config.recvBufferSize)
 ,isAsynWriting_(0),isAsynReading_(0),isCalledDelCallbak_(0),recvBytes_(0)
+,oldestQueuedUs_(0),writeQueuedUs_(0)
+,coalesceArmed_(0),queuedBytes_(0),coalesceTimer_(service)
+,largePending_(0),sendingOffset_(0),sendingChunk_(0),sendingStreamId_(0)
+,recvTotal_(0),recvOffset_(0),recvChunk_(0),recvStreamId_(0)
 {
 	msgSendListSize_ = 0;
+	if( netConfig_.coalesceBytes <= 0 )
+		netConfig_.coalesceBytes = netConfig_.sendBufferSize - kPreHeadSize;
 }
 
 TcpConnection::~TcpConnection( )
 {
 }
 
-bool TcpConnection::sendCmd(const tagCmd* cmd)
+void TcpConnection::checkConfig(const NetworkConfig& config)
+{
+	_Assert(config.maxCmdSize + kPreHeadSize <= config.sendBufferSize, "sendBufferSize below maxCmdSize + head.");
+	_Assert(config.maxCmdSize + kPreHeadSize <= config.recvBufferSize, "recvBufferSize below maxCmdSize + head.");
+}
+
+bool TcpConnection::sendCmd(const tagCmd* cmd, SendFlag flag)
 {
 	_MY_TRY
 	{
-		if( connected() )
-		{	
-			if( cmd->size <= netConfig_.maxCmdSize )
-			{
-				if(!!cmdAllocateCallback_)
-				{
-					CmdPtr cmdPtr = cmdAllocateCallback_((int64_t)this, cmd->size);
-					_Assert(cmdPtr, "Run out of memory.")
-					if( cmdPtr )
-					{
-						memcpy(cmdPtr.get(), cmd, cmd->size);
-						cmdSendList_.pushBack(cmdPtr);
-						doWrite();
-					}
-					return true;
-				}	
-			}
+		CmdPtr cmdPtr = reserveRaw(cmd->size);
+		if( cmdPtr )
+		{
+			memcpy(cmdPtr.get(), cmd, cmd->size);
+			enqueue(cmdPtr, flag);
+			return true;
 		}
 	}
 	_MY_CATCH
@@ -52,6 +54,103 @@ bool TcpConnection::sendCmd(const tagCmd* cmd)
 	return false;
 }
 
+CmdPtr TcpConnection::reserveRaw(int32_t bytes)
+{
+	CmdPtr cmdPtr;
+	_MY_TRY
+	{
+		if( connected() && bytes <= netConfig_.maxCmdSize && !!cmdAllocateCallback_ )
+		{
+			cmdPtr = cmdAllocateCallback_((int64_t)this, bytes);
+			_Assert(cmdPtr, "Run out of memory.")
+		}
+		else if( connected() && bytes > netConfig_.maxCmdSize && bytes <= netConfig_.maxLargeCmdSize )
+		{
+			cmdPtr = Singleton<LargeCmdPool>::instance().allocate(bytes);
+			_Assert(cmdPtr, "Run out of memory.")
+		}
+	}
+	_MY_CATCH
+	{
+		shutdown( );
+	}
+	return cmdPtr;
+}
+
+bool TcpConnection::commitRaw(const CmdPtr& cmd, SendFlag flag)
+{
+	_MY_TRY
+	{
+		if( cmd && connected() )
+		{
+			_Assert(cmd->size >= (int32_t)sizeof(tagCmd)
+				&& cmd->size <= (std::max)(netConfig_.maxCmdSize, netConfig_.maxLargeCmdSize), "bad reserved cmd size.");
+			enqueue(cmd, flag);
+			return true;
+		}
+	}
+	_MY_CATCH
+	{
+		shutdown( );
+	}
+	return false;
+}
+
+void TcpConnection::enqueue(const CmdPtr& cmd, SendFlag flag)
+{
+	// large cmds share the list so they keep their place, and are not held
+	// for coalescing: a window would not make them any smaller
+	cmdSendList_.pushBack(cmd);
+	if( cmd->size > netConfig_.maxCmdSize )
+	{
+		doWrite( );
+		return;
+	}
+
+	if( oldestQueuedUs_.load(boost::memory_order_relaxed) == 0 )
+	{
+		int64_t none = 0;
+		oldestQueuedUs_.compare_exchange_strong(none, TimeUtil::tickMicroseconds( ));
+	}
+	int32_t queued = queuedBytes_.fetch_add(cmd->size) + cmd->size;
+	if( flag == kSendFlush || !coalescing() || queued >= netConfig_.coalesceBytes )
+		doWrite();
+	else
+		armCoalesceTimer( );
+}
+
+void TcpConnection::flush( )
+{
+	doWrite( );
+}
+
+// only the thread that wins coalesceArmed_ touches the timer.
+void TcpConnection::armCoalesceTimer( )
+{
+	if( coalesceArmed_.compareAndSet(0, 1) == 0 )
+	{
+		coalesceTimer_.expires_from_now(boost::posix_time::microseconds(netConfig_.coalesceMicroseconds));
+		coalesceTimer_.async_wait(boost::bind(&TcpConnection::handleCoalesce,
+			shared_from_this(), basio::placeholders::error));
+	}
+}
+
+void TcpConnection::handleCoalesce(const bsys::error_code& ec)
+{
+	coalesceArmed_.set(0);
+	if( !ec )
+		doWrite( );
+}
+
+void TcpConnection::snapshotMetrics(NetMetrics::Snapshot& out)
+{
+	metrics_.snapshot(out);
+	out.recvBytes += recvBytes_.get( );
+	out.sendBytes += sendBytes_.get( );
+	out.recvCmds += recvCmdSize_.get( );
+	out.connections += 1;
+}
+
 CmdPtr TcpConnection::recvCmd( )
 {
 	CmdPtr cmdPtr;
@@ -136,10 +235,21 @@ size_t TcpConnection::readComletion(const bsys::error_code& ec, size_t bytes_tra
 		}
 		else
 		{
-			const void *data = recvBuffer_.beginBuffer();
-			int32_t msgLenNet = *static_cast<const int32_t*>(data);
-			int32_t msgLenHost = networkToHost32( msgLenNet );
-			if( msgLenHost <= netConfig_.maxCmdSize && msgLenHost > 0) 
+			const PreHead* head = static_cast<const PreHead*>((const void*)recvBuffer_.beginBuffer());
+			int32_t msgLenHost = networkToHost32( head->size );
+			// only the fragment head is buffered, readFragment reads its chunk
+			if( (head->flag & MSG_FLAG_LARGE) == MSG_FLAG_LARGE )
+			{
+				if( (int32_t)bytes_transferred < kPreHeadSize + kFragmentHeadSize )
+					left2ReadBytes = kPreHeadSize + kFragmentHeadSize - bytes_transferred;
+				else
+				{
+					recvBuffer_.hasWritten( kFragmentHeadSize );
+					recvBuffer_.hasPrepend( kPreHeadSize );
+				}
+			}
+			// a frame holds gathered cmds, up to the whole buffer
+			else if( msgLenHost <= netConfig_.recvBufferSize && msgLenHost > 0) 
 			{
 				if( (int32_t)bytes_transferred < (msgLenHost + kPreHeadSize) ) 
 					left2ReadBytes = msgLenHost  + kPreHeadSize - bytes_transferred;
@@ -173,7 +283,14 @@ void TcpConnection::handleRead(const bsys::error_code& ec, size_t bytes_transfer
 			break;
 		default:
 			recvBytes_.addAndGet( (int32_t)bytes_transferred );
+			if( (static_cast<const PreHead*>((const void*)recvBuffer_.peek())->flag & MSG_FLAG_LARGE) == MSG_FLAG_LARGE )
+			{
+				readFragment( );
+				break;
+			}
 			decode( );
+			// replies made by message callbacks leave together
+			if( coalescing() ) flush( );
 			doRead( );
 			break;
 		}
@@ -206,7 +323,7 @@ void TcpConnection::decode( )
 
 	recvBuffer_.retrieveAll();
 	//-- scatter
-	int32_t dealBytes = 0;
+	int32_t dealBytes = 0, cmds = 0;
 	for( ; dealBytes < head->original; )
 	{
 		tagCmd* cmd = static_cast<tagCmd*>((void*)((char*)outBuf+dealBytes));
@@ -214,6 +331,7 @@ void TcpConnection::decode( )
 		{
 			dealBytes += cmd->size;
 			messageCallback_(shared_from_this(), cmd);
+			++cmds;
 			recvCmdSize_.addAndGet( );
 			sRecvCmdSizeAll.addAndGet( );
 		}
@@ -225,6 +343,7 @@ void TcpConnection::decode( )
 				memcpy(msg.get(), cmd, cmd->size);
 				cmdRecvList_.pushBack(msg);
 				dealBytes += cmd->size;
+				++cmds;
 				recvCmdSize_.addAndGet( );
 				sRecvCmdSizeAll.addAndGet( );
 			}
@@ -240,38 +359,128 @@ void TcpConnection::decode( )
 		}
 	}
 
+	metrics_.cmdsPerRead.record(cmds);
 	allocator.deallocate(outBuf);
 }
 
+// the sender streams one large cmd at a time, fragments arrive in order.
+// the chunk is read straight into the cmd being reassembled.
+void TcpConnection::readFragment( )
+{
+	const PreHead* head = static_cast<const PreHead*>((const void*)recvBuffer_.peek());
+	const tagFragmentCmd* frag = static_cast<const tagFragmentCmd*>((const void*)(recvBuffer_.peek() + kPreHeadSize));
+	int32_t chunk = frag->size - kFragmentHeadSize;
+	_Assert(networkToHost32(head->size) == frag->size && frag->id == (uint32_t)kFragmentCmdId, "bad fragment frame.");
+	if( frag->offset == 0 )
+	{
+		_Assert(frag->total > netConfig_.maxCmdSize && frag->total <= netConfig_.maxLargeCmdSize, "bad large cmd size.");
+		recvLarge_ = Singleton<LargeCmdPool>::instance().allocate(frag->total);
+		_Assert(recvLarge_, "Run out of memory.");
+		recvStreamId_ = frag->streamId;
+		recvTotal_ = frag->total;
+		recvOffset_ = 0;
+	}
+	_Assert(recvLarge_ && frag->streamId == recvStreamId_ && frag->total == recvTotal_
+		&& frag->offset == recvOffset_ && chunk > 0 && recvOffset_ + chunk <= recvTotal_, "bad fragment.");
+
+	recvChunk_ = chunk;
+	recvBuffer_.retrieveAll( );
+	if( isAsynReading_.compareAndSet(0, 1) == 0 )
+	{
+		basio::async_read(socket_, basio::buffer((char*)recvLarge_.get() + recvOffset_, chunk),
+			make_custom_alloc_handler( recvHandlerAllocator_, boost::bind(&TcpConnection::handleReadFragment, shared_from_this(),
+			basio::placeholders::error, basio::placeholders::bytes_transferred)));
+	}
+}
+
+void TcpConnection::handleReadFragment(const bsys::error_code& ec, size_t bytes_transferred)
+{
+	_MY_TRY
+	{
+		int32_t lr = isAsynReading_.subAndGet( );
+		_Assert(!lr, "isAsynReading_ multi-thread!!!");
+
+		if( ec )
+		{
+			onDestroy(ec);
+			return;
+		}
+
+		recvBytes_.addAndGet( (int32_t)bytes_transferred );
+		recvOffset_ += recvChunk_;
+		if( recvOffset_ == recvTotal_ )
+		{
+			CmdPtr cmd;
+			cmd.swap(recvLarge_);
+			_Assert(cmd->size == recvTotal_, "bad large cmd.");
+			deliver(cmd);
+			if( coalescing() ) flush( );
+		}
+		doRead( );
+	}
+	_MY_CATCH
+	{
+		forceClose( );
+	}
+}
+
+void TcpConnection::deliver(const CmdPtr& cmd)
+{
+	if( !!messageCallback_ )
+		messageCallback_(shared_from_this(), cmd.get());
+	else
+		cmdRecvList_.pushBack(cmd);
+	recvCmdSize_.addAndGet( );
+	sRecvCmdSizeAll.addAndGet( );
+}
+
 void TcpConnection::doWrite( )
 {
-	if( cmdSendList_.sizeUnSafe() )
+	while( hasPendingWrite() )
 	{
 		// .. double check
-		if( isAsynWriting_.compareAndSet(0, 1) == 0 )
+		if( isAsynWriting_.compareAndSet(0, 1) != 0 )
+			return;
+
+		if( sendBuffer_.readableBytes() <= 0) 
+			encode( );
+
+		if( sendBuffer_.readableBytes() > 0 && sendingChunk_ > 0 )
 		{
-			// ...bug.. fixMe MultiThreads: Logic|IoThread
-			if( cmdSendList_.sizeUnSafe() )
-			{
-				if( sendBuffer_.readableBytes() <= 0) 
-					encode( );
-
-				async_write(socket_, basio::const_buffers_1(sendBuffer_.peek(),sendBuffer_.readableBytes()), 
-					make_custom_alloc_handler( sendHandlerAllocator_, 
-					boost::bind(&TcpConnection::handleWrite, shared_from_this(),
-					basio::placeholders::error, basio::placeholders::bytes_transferred)));
-			} 
-			else
-			{
-				int32_t res = isAsynWriting_.compareAndSet(1, 0);
-				_Assert(res == 1, "isAsynWriting_ multi-thread!!!");
-			}
+			// fragment head from the buffer, its chunk from the cmd itself
+			boost::array<basio::const_buffer, 2> bufs = {{
+				basio::const_buffer(sendBuffer_.peek(), sendBuffer_.readableBytes()),
+				basio::const_buffer((const char*)sendingLarge_.get() + sendingOffset_, sendingChunk_) }};
+			async_write(socket_, bufs, 
+				make_custom_alloc_handler( sendHandlerAllocator_, 
+				boost::bind(&TcpConnection::handleWrite, shared_from_this(),
+				basio::placeholders::error, basio::placeholders::bytes_transferred)));
+			return;
+		}
+		else if( sendBuffer_.readableBytes() > 0 )
+		{
+			async_write(socket_, basio::const_buffers_1(sendBuffer_.peek(),sendBuffer_.readableBytes()), 
+				make_custom_alloc_handler( sendHandlerAllocator_, 
+				boost::bind(&TcpConnection::handleWrite, shared_from_this(),
+				basio::placeholders::error, basio::placeholders::bytes_transferred)));
+			return;
 		}
+
+		// nothing linked yet: no empty frame. its producer calls doWrite once
+		// it has linked, a producer that lost the flag to us meanwhile is
+		// caught by the check below.
+		int32_t res = isAsynWriting_.compareAndSet(1, 0);
+		_Assert(res == 1, "isAsynWriting_ multi-thread!!!");
+		if( !cmdSendList_.frontReady() )
+			return;
 	}
 }
 
 int32_t TcpConnection::encode( )
 {
+	if( sendingLarge_ )
+		return encodeFragment( );
+
 	//--
 	// ʹþ̬buf64k ʹջռ䣬ӶϷ windowsջռ 1M
 	PreHead head = {0,netConfig_.ioFlag,0,0};
@@ -279,6 +488,7 @@ int32_t TcpConnection::encode( )
 	StackAllocator allocator;
 
 	char *buf = static_cast<char*>(allocator.allocate( netConfig_.sendBufferSize ));
+	writeQueuedUs_ = oldestQueuedUs_.exchange(0);
 
 	//-- gather
 	bool fill = true;
@@ -286,6 +496,28 @@ int32_t TcpConnection::encode( )
 	{
 		CmdPtr cmdPtr = cmdSendList_.popFront( );
 		if(!cmdPtr) break;
+		if( cmdPtr->size > netConfig_.maxCmdSize )
+		{
+			// the cmds before it leave first, it starts the next write
+			if( bytesOriginal > 0 )
+			{
+				cmdSendList_.pushFront(cmdPtr);
+				break;
+			}
+			allocator.deallocate(buf);
+			// the queue delay is of small cmds, the ones behind keep it
+			if( writeQueuedUs_ != 0 )
+			{
+				int64_t none = 0;
+				oldestQueuedUs_.compare_exchange_strong(none, writeQueuedUs_);
+				writeQueuedUs_ = 0;
+			}
+			sendingLarge_ = cmdPtr;
+			sendingOffset_ = 0;
+			++sendingStreamId_;
+			largePending_.store(1, boost::memory_order_release);
+			return encodeFragment( );
+		}
 		if(cmdPtr->size + bytesOriginal + kPreHeadSize > netConfig_.sendBufferSize )
 		{
 			cmdSendList_.pushFront(cmdPtr);
@@ -294,6 +526,14 @@ int32_t TcpConnection::encode( )
 
 		memcpy(buf+bytesOriginal, cmdPtr.get(), cmdPtr->size);
 		bytesOriginal += cmdPtr->size;
+		queuedBytes_.fetch_sub(cmdPtr->size);
+	}
+
+	// cmds left behind inherit the oldest time, an upper bound of their delay
+	if( writeQueuedUs_ != 0 && cmdSendList_.sizeUnSafe() > 0 )
+	{
+		int64_t none = 0;
+		oldestQueuedUs_.compare_exchange_strong(none, writeQueuedUs_);
 	}
 
 	//-- compress
@@ -315,6 +555,15 @@ int32_t TcpConnection::encode( )
 		sendBuffer_.hasWritten(bytesAll);
 	}
 
+	if( bytesOriginal == 0 )
+	{
+		allocator.deallocate(buf);
+		return 0;
+	}
+
+	if( (netConfig_.ioFlag & MSG_FLAG_COMPRESS) == MSG_FLAG_COMPRESS )
+		metrics_.compressPercent.record((int64_t)bytesAll * 100 / bytesOriginal);
+
 	head.original = bytesOriginal;
 	head.size = hostToNetwork32(bytesAll);
 	sendBuffer_.prepend( &head, kPreHeadSize );
@@ -322,7 +571,30 @@ int32_t TcpConnection::encode( )
 	allocator.deallocate(buf);
 	msendBytes_.addAndGet( (kPreHeadSize+bytesOriginal) );
 
-	return bytesOriginal>0 ? (kPreHeadSize + bytesAll) : 0;
+	return kPreHeadSize + bytesAll;
+}
+
+// the next chunk of sendingLarge_ in a frame of its own: the buffer gets the
+// heads, doWrite adds the chunk from the cmd and handleWrite moves the offset.
+int32_t TcpConnection::encodeFragment( )
+{
+	int32_t chunk = (std::min)(sendingLarge_->size - sendingOffset_, kFragmentChunkSize);
+	int32_t bytes = kFragmentHeadSize + chunk;
+
+	tagFragmentCmd frag;
+	frag.size = bytes;
+	frag.id = kFragmentCmdId;
+	frag.streamId = sendingStreamId_;
+	frag.total = sendingLarge_->size;
+	frag.offset = sendingOffset_;
+	sendBuffer_.append(&frag, kFragmentHeadSize);
+
+	PreHead head = {hostToNetwork32(bytes), MSG_FLAG_LARGE, bytes, 0};
+	sendBuffer_.prepend(&head, kPreHeadSize);
+
+	sendingChunk_ = chunk;
+	msendBytes_.addAndGet( kPreHeadSize + bytes );
+	return kPreHeadSize + bytes;
 }
 
 void TcpConnection::handleWrite(const bsys::error_code& ec, size_t bytes_transferred)
@@ -339,8 +611,24 @@ void TcpConnection::handleWrite(const bsys::error_code& ec, size_t bytes_transfe
 			break;
 		default:
 			sendBytes_.addAndGet((int32_t)bytes_transferred);
-			sendBuffer_.retrieve((int32_t)bytes_transferred);
+			metrics_.bytesPerWrite.record((int64_t)bytes_transferred);
+			if( writeQueuedUs_ != 0 )
+			{
+				metrics_.queueDelayUs.record(TimeUtil::tickMicroseconds( ) - writeQueuedUs_);
+				writeQueuedUs_ = 0;
+			}
+			sendBuffer_.retrieve((int32_t)bytes_transferred - sendingChunk_);
 			_Assert(sendBuffer_.readableBytes() == 0, "");
+			if( sendingChunk_ > 0 )
+			{
+				sendingOffset_ += sendingChunk_;
+				sendingChunk_ = 0;
+				if( sendingOffset_ == sendingLarge_->size )
+				{
+					sendingLarge_.reset( );
+					largePending_.store(0, boost::memory_order_release);
+				}
+			}
 			isAsynWriting_.subAndGet( ) ;
 			doWrite( );
 			break;
@@ -5,10 +5,47 @@
 #include <Buffer.h>
 #include <AtomicInt32.h>
 #include <TcpCmdPool.h>
+#include <NetMetrics.h>
+#include <CmdDispatcher.h>
 
 BASE_NAME_SPACES
 
-typedef TSList<CmdPtr> TSCmdList;
+typedef TSQueue<CmdPtr> TSCmdList;
+
+// head of one chunk of a cmd above maxCmdSize. it is alone in a MSG_FLAG_LARGE
+// frame and the chunk bytes follow it on the wire, written from the cmd's memory
+// and read into the reassembled cmd without passing through the frame buffers.
+// the dispatcher slot below the rpc ones is kept for it, it never reaches a callback.
+struct tagFragmentCmd : tagCmd
+{
+	uint32_t streamId;
+	int32_t total;	// size of the whole cmd
+	int32_t offset;
+};
+enum { kFragmentCmdId = CmdDispatcher::kMaxCmdId - 3 };
+const static int32_t kFragmentHeadSize = sizeof(tagFragmentCmd);
+const static int32_t kFragmentChunkSize = 256 * 1024;
+
+// a cmd constructed in the connection's cmd pool by TcpConnection::reserveCmd,
+// written in place and queued by commit( ) without another copy.
+// dropping it unsent returns the memory to the pool.
+template<typename T>
+class ReservedCmd
+{
+public:
+	ReservedCmd( ) { }
+	explicit ReservedCmd(const CmdPtr& cmd) : cmd_(cmd) { }
+public:
+	T* get( ) const { return static_cast<T*>(cmd_.get()); }
+	T* operator->( ) const { return get(); }
+	T& operator*( ) const { return *get(); }
+	bool operator!( ) const { return !cmd_; }
+	// the extraBytes behind T
+	char* extra( ) const { return (char*)cmd_.get() + sizeof(T); }
+	const CmdPtr& cmd( ) const { return cmd_; }
+private:
+	CmdPtr cmd_;
+};
 
 class TcpConnection : boost::noncopyable,
 		public boost::enable_shared_from_this<TcpConnection>
@@ -19,11 +56,41 @@ public:
 	const static int32_t kPreHeadSize = sizeof(PreHead);
 	const static int32_t kMSGHeadSize = kPreHeadSize;
 	const static int32_t kStackAllocSize = 8 * 1024;
+	enum SendFlag { kSendDefault = 0, kSendFlush = 1 };
 public:
 	TcpConnection(basio::io_service& service, const bstd::string &name, const NetworkConfig& config);
 	~TcpConnection( );
 public:
-	bool sendCmd(const tagCmd* cmd);
+	// with NetworkConfig::coalesceMicroseconds > 0 cmds are held until flush( ),
+	// the window timer or coalesceBytes; kSendFlush writes at once.
+	bool sendCmd(const tagCmd* cmd, SendFlag flag = kSendDefault);
+
+	// T is default constructed with size = sizeof(T) + extraBytes; the caller may
+	// shrink size before commit( ). empty if not connected or too large.
+	// above maxCmdSize the memory comes from LargeCmdPool and the cmd is
+	// streamed in fragments; it keeps its place in the send order, the small
+	// cmds queued after it wait until its last fragment is written.
+	template<typename T>
+	ReservedCmd<T> reserveCmd(int32_t extraBytes = 0)
+	{
+		int32_t bytes = (int32_t)sizeof(T) + extraBytes;
+		CmdPtr cmd = reserveRaw(bytes);
+		if( cmd )
+		{
+			new (cmd.get()) T;
+			cmd->size = bytes;
+		}
+		return ReservedCmd<T>(cmd);
+	}
+	template<typename T>
+	bool commit(const ReservedCmd<T>& cmd, SendFlag flag = kSendDefault)
+	{
+		return commitRaw(cmd.cmd(), flag);
+	}
+	CmdPtr reserveRaw(int32_t bytes);
+	bool commitRaw(const CmdPtr& cmd, SendFlag flag = kSendDefault);
+	// end of a logic tick: gather everything queued into one write.
+	void flush( );
 	CmdPtr recvCmd( );
 public:
 	void setConnectionCallback(const NewconnectionCallback& cb)
@@ -51,8 +118,16 @@ public:
 	void onEstablish( );
 	void setName(const bstd::string &name) { name_ = name; }
 	const bstd::string& name( ) const { return name_; }
+	// read by the io thread that closes, written by the one that accepts.
+	void setId(int64_t id) { id_.store(id, boost::memory_order_release); }
+	int64_t id( ) const { return id_.load(boost::memory_order_acquire); }
 	int32_t recvListSize( )  { return cmdRecvList_.size(); }
 	int32_t sendListSize( )  { return cmdSendList_.size(); }
+	// safe from any thread while io is running, adds into @out.
+	void snapshotMetrics(NetMetrics::Snapshot& out);
+	// a cmd up to maxCmdSize must fit a frame of either buffer, else its
+	// writer could never send it; throws when it does not.
+	static void checkConfig(const NetworkConfig& config);
 private:
 	void doRead( );
 	void decode( );
@@ -60,6 +135,15 @@ private:
 	int32_t encode( );
 	void handleRead(const bsys::error_code& ec, size_t bytes_transferred);
 	void handleWrite(const bsys::error_code& ec, size_t bytes_transferred);
+	bool coalescing( ) const { return netConfig_.coalesceMicroseconds > 0; }
+	void enqueue(const CmdPtr& cmd, SendFlag flag);
+	bool hasPendingWrite( ) { return cmdSendList_.sizeUnSafe() > 0 || largePending_.load(boost::memory_order_acquire) > 0; }
+	int32_t encodeFragment( );
+	void readFragment( );
+	void handleReadFragment(const bsys::error_code& ec, size_t bytes_transferred);
+	void deliver(const CmdPtr& cmd);
+	void armCoalesceTimer( );
+	void handleCoalesce(const bsys::error_code& ec);
 private:
 	void onDestroy(const bsys::error_code& ec);
 	size_t readComletion(const bsys::error_code& ec, size_t bytes_transferred);
@@ -69,6 +153,7 @@ private:
 	typedef HandlerAllocator<160> IoHandlerAllcator;
 
 	bstd::string	name_;
+	boost::atomic<int64_t> id_;
 	basio::io_service& service_;
 	basio::ip::tcp::socket socket_;
 	CmdAllocateCallback cmdAllocateCallback_;
@@ -81,6 +166,21 @@ private:
 	AtomicInt32 isAsynWriting_;
 	AtomicInt32 isAsynReading_;
 	AtomicInt32 isCalledDelCallbak_;
+	AtomicInt32 coalesceArmed_;
+	boost::atomic<int32_t> queuedBytes_;	// in cmdSendList_
+	// large cmds: largePending_ (1 while sendingLarge_ is set) is shared, the
+	// rest is owned by the writing / reading io thread
+	boost::atomic<int32_t> largePending_;
+	CmdPtr sendingLarge_;
+	int32_t sendingOffset_;
+	int32_t sendingChunk_;	// of the write in flight
+	uint32_t sendingStreamId_;
+	CmdPtr recvLarge_;
+	int32_t recvTotal_;
+	int32_t recvOffset_;
+	int32_t recvChunk_;	// of the read in flight
+	uint32_t recvStreamId_;
+	basio::deadline_timer coalesceTimer_;
 
 	Buffer sendBuffer_;
 	Buffer recvBuffer_;
@@ -98,6 +198,9 @@ private:
 	AtomicInt32 msendBytes_;
 	AtomicInt32 recvCmdSize_;
 	AtomicInt32 msgSendListSize_;
+	NetMetrics metrics_;
+	boost::atomic<int64_t> oldestQueuedUs_;	// enqueue time of the oldest unsent cmd, 0 if none
+	int64_t writeQueuedUs_;	// of the write in flight
 public:
 	static AtomicInt32 sRecvCmdSizeAll;
 };
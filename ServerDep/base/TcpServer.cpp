@@ -1,19 +1,25 @@
 #include <TcpServer.h>
 #include <TcpConnection.h>
+#include <ThreadUtil.h>
 
 BASE_NAME_SPACES
 
 TcpServer::TcpServer(basio::io_service& service, basio::ip::tcp::endpoint addr, const bstd::string& name, const NetworkConfig& config)
 :name_(name), service_(service), acceptor_(service)
 ,netConfig_(config),serverAddr_(addr),state_(kStopped)
+,connections_(config.maxConnectionSize)
 ,threadPool_(new ThreadPool(config.threadPoolSize))
 ,acceptExceptionTimer_(service)
+,metricsTimer_(service)
 #if defined(USE_SELF_POOL)
 ,connectionPool_(new ConnetionPool(config.maxConnectionSize * sizeof(TcpConnection), sizeof(TcpConnection)))
-,tcpCmdPoolArray_(new TcpCmdPoolArray(config.maxCmdPoolNumber, config.maxCmdPoolSize, config.maxCmdSize))
+,tcpCmdPoolArray_(new TcpCmdPoolArray((std::max)(config.maxCmdPoolNumber, config.threadPoolSize + 1), config.maxCmdPoolSize, config.maxCmdSize, name + ".cmd"))
 #endif
 {
+	TcpConnection::checkConfig(netConfig_);
 #if defined(USE_SELF_POOL)
+	connectionPoolStatId_ = Singleton<PoolRegistry>::instance().add(name_ + ".conn",
+		boost::bind(&ConnetionPool::stat, connectionPool_.get(), _1));
 	recyleCallback_ = boost::bind(&TcpServer::deallocate, this, _1);
 	cmdAllocateCallback_ = boost::bind(&TcpCmdPoolArray::allocate, tcpCmdPoolArray_.get(), _1, _2);
 #else
@@ -24,6 +30,9 @@ TcpServer::TcpServer(basio::io_service& service, basio::ip::tcp::endpoint addr,
 
 TcpServer::~TcpServer( )
 {
+#if defined(USE_SELF_POOL)
+	Singleton<PoolRegistry>::instance().remove(connectionPoolStatId_);
+#endif
 }
 void TcpServer::start( )
 {
@@ -44,6 +53,7 @@ void TcpServer::start( )
 		_Assert(!ec, ec.message().c_str());
 
 		acceptConnection( );
+		scheduleMetricsLog( );
 		loop( );
 		state_.set(kStarted);
 	}
@@ -54,7 +64,7 @@ void TcpServer::loop( )
 	_MY_TRY
 	{
 		for(int32_t i = 0; i < netConfig_.threadPoolSize; i++)
-			threadPool_->schedule( boost::bind(&basio::io_service::run, &service_));
+			threadPool_->schedule( boost::bind(&TcpServer::runIoThread, this, i));
 	}
 	_MY_CATCH
 	{
@@ -63,6 +73,22 @@ void TcpServer::loop( )
 	
 }
 
+// io thread @index shows up as "<name>-io<index>" and sits on the core
+// the NetworkConfig::ioCpus map gives it.
+void TcpServer::runIoThread(int32_t index)
+{
+	char threadName[32];
+	snprintf(threadName, sizeof(threadName), "%s-io%d", name_.c_str(), index);
+	setThreadName(threadName);
+
+	bstd::vector<int32_t> cpus;
+	parseCpuList(netConfig_.ioCpus.c_str(), cpus);
+	if( !cpus.empty() && !pinThread(cpus[index % cpus.size()]) )
+		LOGW("%s can not be pinned to cpu %d", threadName, cpus[index % cpus.size()]);
+
+	service_.run( );
+}
+
 void TcpServer::stop( )
 {
 	if( isState(kStarted ) )
@@ -75,6 +101,7 @@ void TcpServer::stop( )
 			LOGD("acceptExceptionTimer_.cancel...");
 			bsys::error_code ec;
 			acceptExceptionTimer_.cancel(ec);
+			metricsTimer_.cancel(ec);
 			LOGD("acceptExceptionTimer_.cancel done.");
 		}
 
@@ -91,13 +118,7 @@ void TcpServer::stop( )
 		if( 1 )//fore all asyn-io return
 		{
 			LOGD("all connection->shutdown()...");
-			ScopedLock lock(lock_);
-			BOOST_AUTO(it, connections_.begin());
-			for ( ;it != connections_.end(); ++it)
-			{
-				TcpConnectionPtr conn = it->second;
-				conn->shutdown( );
-			}
+			connections_.forEach(boost::bind(&TcpConnection::shutdown, _1));
 			LOGD("all connection->shutdown() done.");
 		}
 
@@ -115,6 +136,8 @@ void TcpServer::stop( )
 			LOGD("service_.reset done.");
 		} 
 
+		Singleton<PoolRegistry>::instance().log( );
+
 		state_.set(kStopped);
 	}
 }
@@ -172,6 +195,41 @@ void TcpServer::acceptExceptionHanlder(const bsys::error_code& ec)
 	}
 }
 
+void TcpServer::scheduleMetricsLog( )
+{
+	if( netConfig_.metricsLogSecond > 0 )
+	{
+		metricsTimer_.expires_from_now(boost::posix_time::seconds(netConfig_.metricsLogSecond));
+		metricsTimer_.async_wait(boost::bind(&TcpServer::metricsLogHandler,
+			this, basio::placeholders::error));
+	}
+}
+
+void TcpServer::metricsLogHandler(const bsys::error_code& ec)
+{
+	if( !ec && !isState(kStopping) )
+	{
+		NetMetrics::Snapshot snap;
+		snapshotMetrics(snap);
+		snap.log(name_.c_str());
+		scheduleMetricsLog( );
+	}
+}
+
+void TcpServer::flushConnections( )
+{
+	connections_.forEach(boost::bind(&TcpConnection::flush, _1));
+}
+
+void TcpServer::snapshotMetrics(NetMetrics::Snapshot& out)
+{
+	{
+		ScopedLock lock(metricsLock_);
+		out.merge(retiredMetrics_);
+	}
+	connections_.forEach(boost::bind(&TcpConnection::snapshotMetrics, _1, boost::ref(out)));
+}
+
 void TcpServer::handleAccept(const bsys::error_code& ec, const  TcpConnectionPtr& conn)
 {
 	if( !ec )
@@ -187,13 +245,7 @@ void TcpServer::handleAccept(const bsys::error_code& ec, const  TcpConnectionPtr
 
 void TcpServer::newConnection(const TcpConnectionPtr& conn)
 {
-	int32_t connectionSize = 0;
-	{
-		ScopedLock lock(lock_);
-		connectionSize = (int32_t)connections_.size();
-	}
-
-	if( connectionSize < netConfig_.maxConnectionSize )
+	if( connections_.size() < netConfig_.maxConnectionSize )
 	{
 		_MY_TRY
 		{
@@ -217,17 +269,19 @@ void TcpServer::newConnection(const TcpConnectionPtr& conn)
 			conn->setCmdAllocateCallback(cmdAllocateCallback_);
 			conn->setConnectionCallback( newconnectionCallback_ );
 			conn->setdelconnectionCallback(boost::bind(&TcpServer::delConnection, this, _1));
+			// registered before onEstablish, so an early close always finds its slot.
+			conn->setId(connections_.add(conn));
 			conn->onEstablish( );
-
-			if ( 1 )
-			{
-				ScopedLock lock(lock_);
-				connections_[connName] = conn;
-			}
 		}
 		_MY_CATCH
 		{
-
+			// onEstablish may not have reached doRead, then no delConnection
+			// ever comes for this id; drop it here and let a late one skip.
+			// the shard lock decides which of the two removes it.
+			int64_t id = conn->id();
+			conn->setId(ConnectionRegistry::kInvalidId);
+			connections_.remove(id);
+			conn->forceClose( );
 		}
 		
 	}
@@ -239,12 +293,15 @@ void TcpServer::newConnection(const TcpConnectionPtr& conn)
 
 void TcpServer::delConnection(const TcpConnectionPtr& conn)
 {
-	if ( 1 )
+	int64_t id = conn->id();
+	// false when the catch of newConnection dropped it first
+	if ( id != ConnectionRegistry::kInvalidId && connections_.remove(id) )
 	{
-		ScopedLock lock(lock_);
-		size_t n = connections_.erase(conn->name());
-		(void)n;
-		_Verify(n == 1, "duplicate connection name.");
+		NetMetrics::Snapshot snap;
+		conn->snapshotMetrics(snap);
+		snap.connections = 0;
+		ScopedLock lock(metricsLock_);
+		retiredMetrics_.merge(snap);
 	}
 
 	if(delconnectionCallback_)delconnectionCallback_(conn); 
@@ -4,6 +4,8 @@
 #include <PreCompier.h>
 #include <Allocator.h>
 #include <TcpCmdPool.h>
+#include <ConnectionRegistry.h>
+#include <CmdDispatcher.h>
 
 BASE_NAME_SPACES
 
@@ -26,14 +28,32 @@ public:
 	void setMessageCallback(const MessageCallback& cb)
 	{ messageCallback_ = cb; }
 
+	// dispatcher must outlive the server.
+	void setCmdDispatcher(CmdDispatcher* dispatcher)
+	{ messageCallback_ = boost::bind(&CmdDispatcher::dispatch, dispatcher, _1, _2); }
+
 	void setnetworkConfig(const NetworkConfig& config ) { netConfig_ = config; }
 	const NetworkConfig&  networkConfig( ) const { return netConfig_; }
+
+	// snapshot per shard, fn runs without holding the registry.
+	template<typename Fn>
+	void forEachConnection(Fn fn) { connections_.forEach(fn); }
+	TcpConnectionPtr findConnection(int64_t id) { return connections_.find(id); }
+	int32_t connectionSize( ) { return connections_.size(); }
+	// end of a logic tick with NetworkConfig::coalesceMicroseconds set.
+	void flushConnections( );
+
+	// live connections plus the closed ones, io threads keep running.
+	void snapshotMetrics(NetMetrics::Snapshot& out);
 private:
 	bool isState(StateE se) { return state_.get() == se; }
 private:
 	void loop( );
+	void runIoThread(int32_t index);
 	void acceptConnection( );
 	void acceptExceptionHanlder(const bsys::error_code& ec);
+	void scheduleMetricsLog( );
+	void metricsLogHandler(const bsys::error_code& ec);
 	void handleAccept(const bsys::error_code& ec, const TcpConnectionPtr& conn);
 	void newConnection(const TcpConnectionPtr& conn);
 	void delConnection(const TcpConnectionPtr& conn);
@@ -51,6 +71,7 @@ private:
 	DelconnectionCallback delconnectionCallback_;
 	MessageCallback messageCallback_;
 	basio::deadline_timer acceptExceptionTimer_;
+	basio::deadline_timer metricsTimer_;
 
 #if defined(USE_SELF_POOL)
 	boost::scoped_ptr<TcpCmdPoolArray> tcpCmdPoolArray_;
@@ -61,15 +82,14 @@ private:
 #if defined(USE_SELF_POOL)
 	typedef Allocator<1> ConnetionPool;
 	boost::scoped_ptr<ConnetionPool> connectionPool_;
+	int32_t connectionPoolStatId_;
 	RecyleConnectionfromCallback recyleCallback_;
 #endif
 
-	typedef bstd::map<bstd::string, TcpConnectionPtr> ConnectionMap;
-
-	Mutex lock_;
-	int32_t nextConnId_;
 	NetworkConfig netConfig_;
-	ConnectionMap connections_;
+	ConnectionRegistry connections_;
+	Mutex metricsLock_;
+	NetMetrics::Snapshot retiredMetrics_;
 	AtomicInt32 state_;
 	boost::scoped_ptr<ThreadPool> threadPool_;
 };
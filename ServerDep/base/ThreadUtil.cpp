@@ -0,0 +1,87 @@
+#include "ThreadUtil.h"
+#include <stdlib.h>
+#include <string.h>
+#if defined(__LINUX__)
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#elif defined(__WINDOWS__)
+#include <windows.h>
+#endif
+
+namespace base {
+
+void setThreadName(const char* name)
+{
+#if defined(__LINUX__)
+	char shortName[16] = { 0 };
+	strncpy(shortName, name, sizeof(shortName) - 1);
+	pthread_setname_np(pthread_self(), shortName);
+#elif defined(__WINDOWS__)
+	// the msvc way: a debugger attached at this point picks the name up
+	const DWORD kMsVcException = 0x406D1388;
+#pragma pack(push, 8)
+	struct ThreadNameInfo
+	{
+		DWORD type;
+		LPCSTR name;
+		DWORD threadId;
+		DWORD flags;
+	};
+#pragma pack(pop)
+	ThreadNameInfo info = { 0x1000, name, (DWORD)-1, 0 };
+	__try
+	{
+		RaiseException(kMsVcException, 0, sizeof(info) / sizeof(ULONG_PTR), (ULONG_PTR*)&info);
+	}
+	__except(EXCEPTION_EXECUTE_HANDLER)
+	{
+	}
+#endif
+}
+
+bool pinThread(int32_t cpu)
+{
+	if( cpu < 0 ) return true;
+#if defined(__LINUX__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(cpu, &set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(__WINDOWS__)
+	if( cpu >= (int32_t)(sizeof(DWORD_PTR) * 8) ) return false;
+	return ::SetThreadAffinityMask(::GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0;
+#else
+	return false;
+#endif
+}
+
+int32_t currentKernelTid( )
+{
+#if defined(__LINUX__)
+	return (int32_t)syscall(SYS_gettid);
+#elif defined(__WINDOWS__)
+	return (int32_t)::GetCurrentThreadId();
+#else
+	return -1;
+#endif
+}
+
+void parseCpuList(const char* list, boost::container::vector<int32_t>& out)
+{
+	out.clear();
+	if( list == NULL ) return;
+	const char* p = list;
+	while( *p )
+	{
+		while( *p == ' ' || *p == ',' ) ++p;
+		if( *p < '0' || *p > '9' ) break;
+		int32_t first = (int32_t)strtol(p, (char**)&p, 10);
+		int32_t last = first;
+		if( *p == '-' ) last = (int32_t)strtol(p + 1, (char**)&p, 10);
+		for(int32_t cpu = first; cpu <= last; cpu++) out.push_back(cpu);
+	}
+}
+
+}
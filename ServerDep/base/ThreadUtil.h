@@ -0,0 +1,22 @@
+#ifndef THREAD_UTIL_H
+#define THREAD_UTIL_H
+
+// also built into Server (see ThreadRegistry.h), which has no PreCompier.h:
+// only the system and boost headers are used here.
+#include <stdint.h>
+#include <boost/container/vector.hpp>
+
+namespace base {
+
+// name shown by top -H, perf and the debugger; linux keeps the first 15 chars.
+void setThreadName(const char* name);
+// pin the calling thread to one cpu, cpu < 0 leaves it to the scheduler.
+bool pinThread(int32_t cpu);
+// kernel id of the calling thread, as in /proc/self/task; -1 if unknown.
+int32_t currentKernelTid( );
+// "0,2,4-7" -> 0 2 4 5 6 7
+void parseCpuList(const char* list, boost::container::vector<int32_t>& out);
+
+}
+
+#endif
@@ -79,6 +79,21 @@ UINT TimeUtil::tickCount( )
 #endif
 }
 
+int64_t TimeUtil::tickMicroseconds( )
+{
+#if defined(__WINDOWS__)
+	static LARGE_INTEGER freq = {0};
+	if( freq.QuadPart == 0 )
+		QueryPerformanceFrequency(&freq);
+	LARGE_INTEGER now;
+	QueryPerformanceCounter(&now);
+	return (int64_t)(now.QuadPart / freq.QuadPart * 1000000 + now.QuadPart % freq.QuadPart * 1000000 / freq.QuadPart);
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
 
  TIME64 TimeUtil::initTime64(uint8_t sec, uint8_t mint, uint8_t hour, uint8_t day, uint8_t month, uint16_t year, uint8_t wday)
  {
@@ -38,6 +38,7 @@ class TimeUtil
 {
 public:
 static uint32_t tickCount( );
+static int64_t tickMicroseconds( );	// monotonic, for profiling
 static int64_t utcMilliseconds( );
 static void utcTime(int32_t *seconds, int32_t *milliseconds);
 static void addMillisecondsToNow(int32_t milliseconds, int32_t *sec, int32_t *ms);
@@ -0,0 +1,162 @@
+#include <LBench.h>
+#if !defined(__WINDOWS__)
+#include <sys/resource.h>
+#endif
+
+static char sPayload[BENCH_MAX_PAYLOAD];
+static const char sText[] = "Copyright 2010 by backkom. All rights reserved."
+	"This software is the confidential and proprietary information of backkom."
+	"('Confidential Information'). You shall not disclose such Confidential -"
+	"Information and shall use it only in accordance with the terms of the - "
+	"license agreement you entered into with backkom";
+
+// user + system time of the whole process.
+static int64_t processCpuMicroseconds( )
+{
+#if defined(__WINDOWS__)
+	FILETIME createTime, exitTime, kernelTime, userTime;
+	GetProcessTimes(GetCurrentProcess(), &createTime, &exitTime, &kernelTime, &userTime);
+	ULARGE_INTEGER k, u;
+	k.LowPart = kernelTime.dwLowDateTime; k.HighPart = kernelTime.dwHighDateTime;
+	u.LowPart = userTime.dwLowDateTime; u.HighPart = userTime.dwHighDateTime;
+	return (int64_t)((k.QuadPart + u.QuadPart) / 10);
+#else
+	struct rusage ru;
+	getrusage(RUSAGE_SELF, &ru);
+	return (int64_t)(ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000
+		+ ru.ru_utime.tv_usec + ru.ru_stime.tv_usec;
+#endif
+}
+
+NetworkConfig BenchOptions::networkConfig( ) const
+{
+	NetworkConfig config;
+	config.threadPoolSize = ioThreads;
+	config.ioCpus = ioCpus;
+	config.maxCmdSize = (std::max)(config.maxCmdSize, BENCH_HEAD_SIZE + maxSize);
+	// a frame holds at least one cmd, on both sides of the connection
+	int32_t frameSize = config.maxCmdSize + base::TcpConnection::kPreHeadSize;
+	config.sendBufferSize = (std::max)(config.sendBufferSize, frameSize);
+	config.recvBufferSize = (std::max)(config.recvBufferSize, frameSize);
+	config.ioFlag = (compress ? MSG_FLAG_COMPRESS : 0) | (gather ? MSG_FLAG_GATHER : 0);
+	config.metricsLogSecond = 0;
+	config.coalesceMicroseconds = coalesceMicroseconds;
+	return config;
+}
+
+class LBench::Connection : boost::noncopyable
+{
+public:
+	Connection(basio::ip::tcp::endpoint& addr, const NetworkConfig& config, uint32_t s)
+	:client(service, addr, "LBench", config), seed(s)
+	{
+	}
+	basio::io_service service;
+	base::TcpClient client;
+	uint32_t seed;	// io thread of this connection only
+};
+
+LBench::LBench(basio::ip::tcp::endpoint& addr, const BenchOptions& options)
+:addr_(addr), options_(options), msgs_(0), bytes_(0), recording_(0), stopping_(0)
+{
+	options_.connections = (std::max)(options_.connections, 1);
+	options_.depth = (std::max)(options_.depth, 1);
+	options_.maxSize = (std::min)((std::max)(options_.maxSize, 0), BENCH_MAX_PAYLOAD);
+	options_.minSize = (std::min)((std::max)(options_.minSize, 0), options_.maxSize);
+	for(int32_t i = 0; i < BENCH_MAX_PAYLOAD; i++)
+		sPayload[i] = sText[i % (sizeof(sText) - 1)];
+}
+
+LBench::~LBench( )
+{
+}
+
+int32_t LBench::nextSize(Connection* c)
+{
+	int32_t range = options_.maxSize - options_.minSize;
+	if( options_.sizeDist == "fixed" || range == 0 )
+		return options_.maxSize;
+
+	c->seed ^= c->seed << 13; c->seed ^= c->seed >> 17; c->seed ^= c->seed << 5;
+	double r = (c->seed & 0xffffff) / (double)0x1000000;
+	if( options_.sizeDist == "skewed" )
+		r = r * r * r;
+	return options_.minSize + (int32_t)(r * (range + 1));
+}
+
+void LBench::sendNext(Connection* c, const TcpConnectionPtr& session)
+{
+	int32_t bytes = nextSize(c);
+	base::ReservedCmd<tagBench> cmd = session->reserveCmd<tagBench>(bytes);
+	if( !cmd )
+		return;
+	memcpy(cmd.extra(), sPayload, bytes);
+	cmd->sendUs = base::TimeUtil::tickMicroseconds( );
+	session->commit(cmd);
+}
+
+void LBench::newConnection(Connection* c, const TcpConnectionPtr& session)
+{
+	for(int32_t i = 0; i < options_.depth; i++)
+		sendNext(c, session);
+}
+
+void LBench::messageCall(Connection* c, const TcpConnectionPtr& session, const tagCmd* cmd)
+{
+	if( cmd->id != tagBench::kCmdId )
+		return;
+
+	if( recording_.load(boost::memory_order_relaxed) )
+	{
+		const tagBench* echo = static_cast<const tagBench*>(cmd);
+		rttUs_.record(base::TimeUtil::tickMicroseconds( ) - echo->sendUs);
+		msgs_.fetch_add(1, boost::memory_order_relaxed);
+		bytes_.fetch_add(cmd->size, boost::memory_order_relaxed);
+	}
+	if( !stopping_.load(boost::memory_order_relaxed) )
+		sendNext(c, session);
+}
+
+void LBench::printHeader( )
+{
+	fprintf(stdout, "mode,connections,io_threads,size_dist,min_size,max_size,compress,gather,coalesce_us,depth,"
+		"seconds,msgs,msgs_per_sec,mb_per_sec,mean_us,p50_us,p90_us,p99_us,p999_us,max_us,cpu_us_per_msg\n");
+}
+
+void LBench::run(const char* mode)
+{
+	NetworkConfig config = options_.networkConfig( );
+	for(int32_t i = 0; i < options_.connections; i++)
+	{
+		ConnectionPtr c(new Connection(addr_, config, 2463534242u + i));
+		c->client.setConnectionCallback(boost::bind(&LBench::newConnection, this, c.get(), _1));
+		c->client.setMessageCallback(boost::bind(&LBench::messageCall, this, c.get(), _1, _2));
+		c->client.connect( );
+		connections_.push_back(c);
+	}
+
+	base::thisThreadSleep(options_.warmupSeconds * 1000);
+	int64_t cpuStart = processCpuMicroseconds( );
+	int64_t start = base::TimeUtil::tickMicroseconds( );
+	recording_.store(1);
+	base::thisThreadSleep(options_.seconds * 1000);
+	recording_.store(0);
+	double elapse = (base::TimeUtil::tickMicroseconds( ) - start) / 1000000.0;
+	int64_t cpu = processCpuMicroseconds( ) - cpuStart;
+
+	stopping_.store(1);
+	for(size_t i = 0; i < connections_.size(); i++)
+		connections_[i]->client.stop( );
+
+	base::Histogram::Snapshot rtt;
+	rttUs_.snapshot(rtt);
+	int64_t msgs = msgs_.load( );
+	fprintf(stdout, "%s,%d,%d,%s,%d,%d,%d,%d,%d,%d,%0.3f,%lld,%0.0f,%0.3f,%lld,%lld,%lld,%lld,%lld,%lld,%0.3f\n",
+		mode, options_.connections, options_.ioThreads, options_.sizeDist.c_str(),
+		options_.minSize, options_.maxSize, options_.compress ? 1 : 0, options_.gather ? 1 : 0,
+		options_.coalesceMicroseconds, options_.depth, elapse, (long long)msgs, msgs / elapse, bytes_.load( ) / elapse / (1024 * 1024),
+		(long long)rtt.mean( ), (long long)rtt.percentile(0.5), (long long)rtt.percentile(0.9),
+		(long long)rtt.percentile(0.99), (long long)rtt.percentile(0.999), (long long)rtt.max,
+		msgs > 0 ? (double)cpu / msgs : 0.0);
+	fflush(stdout);
+}
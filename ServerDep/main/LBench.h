@@ -0,0 +1,65 @@
+#ifndef LBENCH_H
+#define LBENCH_H
+
+#include <PreCompier.h>
+#include <TcpConnection.h>
+#include <TcpClient.h>
+#include <Histogram.h>
+#include <LProtocol.h>
+
+struct BenchOptions
+{
+	BenchOptions( )
+	:connections(1), ioThreads(4), minSize(16), maxSize(128), sizeDist("uniform")
+	,compress(false), gather(true), coalesceMicroseconds(0), depth(1), seconds(10), warmupSeconds(1)
+	{
+	}
+	NetworkConfig networkConfig( ) const;
+
+	int32_t connections;
+	int32_t ioThreads;		// server side, every client connection has its own io thread
+	bstd::string ioCpus;	// server side, NetworkConfig::ioCpus
+	int32_t minSize;		// payload bytes
+	int32_t maxSize;
+	bstd::string sizeDist;	// fixed(maxSize) | uniform | skewed(towards minSize)
+	bool compress;
+	bool gather;
+	int32_t coalesceMicroseconds;	// both sides, 0: off
+	int32_t depth;			// echo requests in flight per connection
+	int32_t seconds;
+	int32_t warmupSeconds;	// not measured
+};
+
+//////////////////////////////////////////////////////////////////////////
+// closed loop echo benchmark against LServer: every connection keeps depth
+// tagBench frames in flight and sends the next one from the io thread as
+// each echo arrives. run( ) prints one csv row, see printHeader( ).
+class LBench : boost::noncopyable
+{
+public:
+	LBench(basio::ip::tcp::endpoint& addr, const BenchOptions& options);
+	~LBench( );
+public:
+	void run(const char* mode);
+	static void printHeader( );
+private:
+	class Connection;
+	typedef boost::shared_ptr<Connection> ConnectionPtr;
+
+	void newConnection(Connection* c, const TcpConnectionPtr& session);
+	void messageCall(Connection* c, const TcpConnectionPtr& session, const tagCmd* cmd);
+	void sendNext(Connection* c, const TcpConnectionPtr& session);
+	int32_t nextSize(Connection* c);
+private:
+	basio::ip::tcp::endpoint addr_;
+	BenchOptions options_;
+	bstd::vector<ConnectionPtr> connections_;
+
+	base::Histogram rttUs_;
+	boost::atomic<int64_t> msgs_;
+	boost::atomic<int64_t> bytes_;
+	boost::atomic<int32_t> recording_;
+	boost::atomic<int32_t> stopping_;
+};
+
+#endif
@@ -6,10 +6,17 @@
 #include <TcpClient.h>
 #include <TcpServer.h>
 
-CMD_START(tagHello)
+CMD_START_ID(tagHello, 1)
 	char msg[128];
 CMD_END
 
+// LBench echo frame, followed by the payload bytes.
+#define BENCH_MAX_PAYLOAD (8*1024)
+CMD_START_ID(tagBench, 2)
+	int64_t sendUs;
+CMD_END
+#define BENCH_HEAD_SIZE ((int32_t)sizeof(tagBench))
+
 #define MAX_MSG_SEND (100*10000)
 
 #define CONTINUE_SEC (1*60*1000)
@@ -15,19 +15,7 @@ void LServer::tick( )
 	base::TimeInfo info;
 	while(!stop_)
 	{
-		if ( 1 )
-		{
-			ScopedLock lock(lock_);
-			BOOST_AUTO(it, connections_.begin());
-			for ( ;it != connections_.end(); ++it)
-			{
-				CmdPtr msg = it->second->recvCmd( );
-				for( ; msg; msg = it->second->recvCmd())
-				{
-					it->second->sendCmd(msg.get());
-				}
-			}
-		}
+		connections_.forEach(boost::bind(&LServer::echo, this, _1));
 		base::thisThreadSleep(1);
 		
 		info.update();
@@ -52,7 +40,11 @@ void LServer::start()
 {
 	regLog(true, true);
 
-	server_->setMessageCallback(boost::bind(&LServer::messageCall, this, _1, _2));
+	dispatcher_.registerHandler<tagHello>(boost::bind(&LServer::helloCall, this, _1, _2), true);
+	dispatcher_.registerRaw(tagBench::kCmdId, tagBench::cmdName( ), BENCH_HEAD_SIZE,
+		BENCH_HEAD_SIZE + BENCH_MAX_PAYLOAD, boost::bind(&LServer::messageCall, this, _1, _2));
+	dispatcher_.setFallbackCallback(boost::bind(&LServer::messageCall, this, _1, _2));
+	server_->setCmdDispatcher(&dispatcher_);
 	server_->setConnectionCallback( boost::bind(&LServer::newConnection, this, _1));
 	server_->setdelconnectionCallback( boost::bind(&LServer::delConnection, this, _1));
 	tickThread_ = boost::thread(boost::bind(&LServer::tick, this));
@@ -67,6 +59,17 @@ void LServer::stop( )
 
 	server_->stop( );
 	connections_.clear();
+	dispatcher_.dumpStats( );
+}
+
+void LServer::echo(const TcpConnectionPtr& session)
+{
+	CmdPtr msg = session->recvCmd( );
+	for( ; msg; msg = session->recvCmd())
+	{
+		session->sendCmd(msg.get());
+	}
+	session->flush( );
 }
 
 void LServer::messageCall(const TcpConnectionPtr& session, const tagCmd* cmd)
@@ -74,12 +77,16 @@ void LServer::messageCall(const TcpConnectionPtr& session, const tagCmd* cmd)
 	session->sendCmd(cmd);
 }
 
+void LServer::helloCall(const TcpConnectionPtr& session, const tagHello* cmd)
+{
+	session->sendCmd(cmd);
+}
+
 void LServer::delConnection( const TcpConnectionPtr& session )
 {
 	if ( 1 )
 	{
-		ScopedLock lock(lock_);
-		connections_.erase(session->name());
+		connections_.remove(session->id());
 		LOGD("Byte-%s", session->name().c_str());
 	}
 }
@@ -87,8 +94,7 @@ void LServer::newConnection( const TcpConnectionPtr& session )
 {
 	if ( 1 )
 	{
-		ScopedLock lock(lock_);
-		connections_[session->name()] = session;
+		connections_.attach(session->id(), session);
 		LOGD("Hello-%s", session->name().c_str());
 	}
 }
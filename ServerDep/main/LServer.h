@@ -4,6 +4,9 @@
 #include <PreCompier.h>
 #include <TcpConnection.h>
 #include <TcpServer.h>
+#include <ConnectionRegistry.h>
+#include <CmdDispatcher.h>
+#include <LProtocol.h>
 #include <Script/Script.h>
 
 class LServer
@@ -19,6 +22,8 @@ private:
 	void delConnection( const TcpConnectionPtr& session );
 	void newConnection( const TcpConnectionPtr& session );
 	void messageCall(const TcpConnectionPtr& session, const tagCmd* cmd);
+	void echo(const TcpConnectionPtr& session);
+	void helloCall(const TcpConnectionPtr& session, const tagHello* cmd);
 public:
 	void regLog(bool diffHour, bool diffDay);
 private:
@@ -26,10 +31,8 @@ private:
 	volatile bool stoped_;
 	basio::io_service service_;
 
-	typedef bstd::map<bstd::string, TcpConnectionPtr> ConnectionMap;
-
-	Mutex lock_;
-	ConnectionMap connections_;
+	base::ConnectionRegistry connections_;
+	base::CmdDispatcher dispatcher_;
 	boost::scoped_ptr<typename base::TcpServer> server_;
 	boost::thread tickThread_;
 
@@ -1,5 +1,7 @@
 #include <LClient.h>
 #include <LServer.h>
+#include <LBench.h>
+#include <RpcChannel.h>
 #if defined(HAS_GFLAGS)
 #include <gflags/gflags.h>
 
@@ -26,11 +28,81 @@ void uCall( )
 #ifdef EXCEPTION_UNIT_TEST
 	AUTOTEST_RUN(exceptionUnitTest, NULL);
 #endif
+
+#ifdef ALLOCATOR_UNIT_TEST
+	AUTOTEST_RUN(AllocatorUnit, NULL);
+#endif
+
+#if defined(USE_SELF_POOL) && defined(TCPCMDPOOL_UNIT_TEST)
+	AUTOTEST_RUN(TcpCmdPoolUnit, NULL);
+#endif
+
+#ifdef RPC_UNIT_TEST
+	AUTOTEST_RUN(RpcUnit, NULL);
+#endif
 }
 
 #if defined(HAVE_LIB_GFLAGS)
 DEFINE_bool(isserver, false, "run in server mode.");
+DEFINE_bool(local, false, "run LServer and the benchmark client in one process.");
+DEFINE_string(host, "127.0.0.1", "server address.");
+DEFINE_int32(port, 2251, "server port.");
+DEFINE_int32(connections, 1, "client connections.");
+DEFINE_int32(io_threads, 4, "server io threads.");
+DEFINE_string(io_cpus, "", "NetworkConfig::ioCpus like \"0-3\", empty: config.ini [Thread] ioCpus.");
+DEFINE_int32(min_size, 16, "min payload bytes.");
+DEFINE_int32(max_size, 128, "max payload bytes.");
+DEFINE_string(size_dist, "uniform", "payload size distribution: fixed | uniform | skewed.");
+DEFINE_bool(compress, true, "MSG_FLAG_COMPRESS.");
+DEFINE_bool(gather, true, "MSG_FLAG_GATHER.");
+DEFINE_int32(coalesce_us, 0, "NetworkConfig::coalesceMicroseconds, 0: off.");
+DEFINE_int32(depth, 1, "requests in flight per connection.");
+DEFINE_int32(seconds, 50, "measured seconds.");
+DEFINE_int32(warmup, 1, "warmup seconds, not measured.");
+DEFINE_bool(csv_header, true, "print the csv header before the result row.");
 #endif 
+
+// the io thread core map, config.ini [Thread] ioCpus=0-3; empty: not pinned.
+static bstd::string configIoCpus( )
+{
+	_MY_TRY
+	{
+		if( bfs::exists("config.ini") )
+		{
+			boost::property_tree::ptree pt;
+			boost::property_tree::ini_parser::read_ini("config.ini", pt);
+			return pt.get<std::string>("Thread.ioCpus", "").c_str();
+		}
+	}
+	_MY_CATCH
+	{
+	}
+	return "";
+}
+
+static BenchOptions benchOptions( )
+{
+	BenchOptions options;
+	options.ioCpus = configIoCpus( );
+#if defined(HAVE_LIB_GFLAGS)
+	options.connections = FLAGS_connections;
+	options.ioThreads = FLAGS_io_threads;
+	if( !FLAGS_io_cpus.empty() ) options.ioCpus = FLAGS_io_cpus.c_str();
+	options.minSize = FLAGS_min_size;
+	options.maxSize = FLAGS_max_size;
+	options.sizeDist = FLAGS_size_dist.c_str();
+	options.compress = FLAGS_compress;
+	options.gather = FLAGS_gather;
+	options.coalesceMicroseconds = FLAGS_coalesce_us;
+	options.depth = FLAGS_depth;
+	options.seconds = FLAGS_seconds;
+	options.warmupSeconds = FLAGS_warmup;
+#else
+	options.compress = true;
+	options.seconds = 50;
+#endif
+	return options;
+}
 //
 //using namespace zsummer::log4z;
 ////! multi logger id
@@ -97,42 +169,39 @@ int main(int argn, char** argv)
 
 		uCall();
 
+		BenchOptions options = benchOptions( );
 		bsys::error_code ec;
-		basio::ip::tcp::endpoint addr(basio::ip::address::from_string("127.0.0.1", ec), 2251);
-
-#define PINGDONG_MS (50*1000)
-		boost::timer t;
 #if defined(HAVE_LIB_GFLAGS)
-		if(!FLAGS_isserver)
+		bool isServer = FLAGS_isserver, isLocal = FLAGS_local, header = FLAGS_csv_header;
+		basio::ip::tcp::endpoint addr(basio::ip::address::from_string(FLAGS_host, ec), FLAGS_port);
 #else
-		if(argn < 2)
+		bool isServer = argn >= 2, isLocal = false, header = true;
+		basio::ip::tcp::endpoint addr(basio::ip::address::from_string("127.0.0.1", ec), 2251);
 #endif
-		{
-			LOGD("%s", "running in client mode. starting connecting.");
-			NetworkConfig config;
-			config.ioFlag = MSG_FLAG_COMPRESS;
-			LClient lc(addr, config);
-			lc.start();
-			LOGD("%s", "client is started.");
-			base::thisThreadSleep( PINGDONG_MS );
-			lc.stop( );
-		}
-		else
+
+		if( isServer )
 		{
 			LOGD("%s", "running in server mode.");
-			NetworkConfig config;
-			config.ioFlag = MSG_FLAG_COMPRESS;
-			LServer ls(addr, config);
+			LServer ls(addr, options.networkConfig());
 			ls.start();
 			LOGD("%s", "server is started.start accept connection.");
-			base::thisThreadSleep( PINGDONG_MS );
+			base::thisThreadSleep( (options.warmupSeconds + options.seconds) * 1000 );
 			ls.stop( );
 		}
-
-		double elapse = t.elapsed();
-		int32_t cmdSizeAll = base::TcpConnection::sRecvCmdSizeAll.get();
-		LOGPD(pingpong, "running %0.5f seconds , %d ops, %f opps....", 
-			elapse, cmdSizeAll, cmdSizeAll / elapse);
+		else
+		{
+			LOGD("%s", "running in client mode. starting benchmark.");
+			boost::scoped_ptr<LServer> ls;
+			if( isLocal )
+			{
+				ls.reset(new LServer(addr, options.networkConfig()));
+				ls->start();
+			}
+			LBench bench(addr, options);
+			if( header ) LBench::printHeader( );
+			bench.run(isLocal ? "local" : "client");
+			if( ls ) ls->stop( );
+		}
 	}
 	__LEAVE_FUNCTION
 